@@ -0,0 +1,265 @@
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "crowpanel.h"
+#include "moonraker.h"
+
+// Micro-benchmark of the Moonraker client hot paths against an in-process
+// keep-alive HTTP server on the loopback interface, so the numbers contain
+// the client's own work and the kernel's loopback cost but no network.
+//
+//   program [cycles]
+//
+// Per cycle it reports the client thread's CPU time, wall time (median and
+// p99), heap allocations (every malloc, operator new and String included),
+// ArduinoJson blocks wherever they came from, and bytes parsed. The poll
+// paths must not touch the heap once warmed up; the program fails if they
+// do.
+
+#define BENCH_CYCLES 2000
+
+extern wifi_status_t wifi_status; // No wifi_task here, the loopback is always up
+#define BENCH_WARMUP 20
+
+// objects/query reply of a printer in the middle of a print, eventtime
+// and nozzle temperature filled in per reply
+static const char status_format[] =
+    "{\"result\":{\"eventtime\":%.6f,\"status\":{"
+    "\"webhooks\":{\"state\":\"ready\"},"
+    "\"print_stats\":{\"state\":\"printing\"},"
+    "\"virtual_sdcard\":{\"progress\":0.4215,\"file_path\":\"/home/pi/printer_data/gcodes/Voron_Cube_v7.gcode\"},"
+    "\"extruder\":{\"temperature\":%.2f,\"target\":240.0},"
+    "\"heater_bed\":{\"temperature\":109.87,\"target\":110.0},"
+    "\"gcode_macro _CROWPANEL_STATUS\":{\"homing\":false,\"probing\":false,\"qgling\":false,"
+    "\"heating_nozzle\":false,\"heating_bed\":false}}}}";
+static char status_body[1024];
+static std::atomic<bool> vary_status(false); // Change the temperature on every reply
+static const char ok_body[] = "{\"result\":\"ok\"}";
+
+// Allocations made by the calling thread, the server thread has its own.
+// glibc's malloc is wrapped, operator new and std::string end up there too.
+static thread_local uint32_t heap_calls = 0;
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t n, size_t size);
+extern "C" void * __libc_realloc(void * p, size_t size);
+
+extern "C" void * malloc(size_t size) {
+    heap_calls++;
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t n, size_t size) {
+    heap_calls++;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void * realloc(void * p, size_t size) {
+    heap_calls++;
+    return __libc_realloc(p, size);
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// One keep-alive connection: answer every request until the client closes
+static void serve(int fd) {
+    std::string request;
+    char buf[2048];
+    for (;;) {
+        size_t end;
+        while ((end = request.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            request.append(buf, n);
+        }
+        bool status = request.compare(0, 26, "GET /printer/objects/query") == 0;
+        request.erase(0, end + 4);
+
+        static std::atomic<uint32_t> replies(0);
+        uint32_t n = ++replies;
+        char status_reply[sizeof(status_body)];
+        snprintf(status_reply, sizeof(status_reply), status_format, 3600 + n * 0.25,
+                 vary_status ? 240 + (n % 100) / 100.0 : 240.12);
+        const char * body = status ? status_reply : ok_body;
+        char header[128];
+        int len = snprintf(header, sizeof(header),
+                           "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+                           (unsigned)strlen(body));
+        std::string reply(header, len);
+        reply += body;
+        if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) != (ssize_t)reply.size()) {
+            close(fd);
+            return;
+        }
+    }
+}
+
+static uint16_t server_start(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("bench server");
+        exit(1);
+    }
+
+    std::thread([fd]() {
+        for (;;) {
+            int client = accept(fd, NULL, NULL);
+            if (client < 0) continue;
+            std::thread(serve, client).detach();
+        }
+    }).detach();
+    return ntohs(addr.sin_port);
+}
+
+typedef struct {
+    const char * name;
+    std::vector<uint64_t> wall;
+    uint64_t cpu;
+    uint64_t heap;
+    uint64_t json_allocs;
+    uint64_t bytes;
+} bench_result_t;
+
+template <typename F>
+static void run(bench_result_t & r, uint32_t cycles, moonraker_conn_t * conn, F cycle) {
+    for (uint32_t i = 0; i < BENCH_WARMUP; i++) cycle();
+
+    r.wall.reserve(cycles);
+    r.cpu = r.heap = r.json_allocs = r.bytes = 0;
+    for (uint32_t i = 0; i < cycles; i++) {
+        uint32_t heap = heap_calls;
+        uint32_t json_allocs = conn ? conn->alloc.allocs : 0;
+        uint32_t bytes = conn ? conn->rx_bytes : 0;
+        uint64_t cpu = thread_cpu_ns();
+        uint64_t wall = wall_ns();
+
+        cycle();
+
+        r.wall.push_back(wall_ns() - wall);
+        r.cpu += thread_cpu_ns() - cpu;
+        r.heap += heap_calls - heap;
+        if (conn) {
+            r.json_allocs += conn->alloc.allocs - json_allocs;
+            r.bytes += conn->rx_bytes - bytes;
+        }
+    }
+}
+
+static void report(bench_result_t & r) {
+    size_t n = r.wall.size();
+    std::sort(r.wall.begin(), r.wall.end());
+    Serial.printf("%-14s %8.2f %8.2f %8.2f %8.1f %8.1f %8zu\n", r.name,
+                  r.cpu / 1000.0 / n, r.wall[n / 2] / 1000.0, r.wall[n * 99 / 100] / 1000.0,
+                  (double)r.heap / n, (double)r.json_allocs / n, (size_t)(r.bytes / n));
+}
+
+int main(int argc, char ** argv) {
+    uint32_t cycles = argc > 1 ? atoi(argv[1]) : BENCH_CYCLES;
+    if (cycles == 0) cycles = BENCH_CYCLES;
+
+    uint16_t port = server_start();
+    crowpanel_init();
+    strcpy(crowpanel_config.moonraker_ip, "127.0.0.1");
+    snprintf(crowpanel_config.moonraker_port, sizeof(crowpanel_config.moonraker_port), "%u", port);
+    moonraker_setup();
+    wifi_status = WIFI_STATUS_CONNECTED;
+
+    snprintf(status_body, sizeof(status_body), status_format, 3621.417354917, 240.12);
+    auto poll_cycle = []() {
+        if (moonraker.get_status() != REQUEST_OK) {
+            Serial.printf("poll failed\n");
+            exit(1);
+        }
+    };
+
+    // Status poll: request, filtered parse, apply. Only eventtime changes
+    // between replies, so after the first one they are hashed, not parsed
+    bench_result_t poll = { "poll same" };
+    run(poll, cycles, &moonraker.conn_poll, poll_cycle);
+    uint32_t same = moonraker.stats[ENDPOINT_STATUS].unchanged;
+
+    // Every reply differs, each one is parsed
+    bench_result_t poll_changed = { "poll changed" };
+    vary_status = true;
+    run(poll_changed, cycles, &moonraker.conn_poll, poll_cycle);
+
+    // Command path: queue three buttons' worth of G-code, coalesce, one POST
+    bench_result_t post = { "post" };
+    run(post, cycles, &moonraker.conn_cmd, []() {
+        moonraker.post_gcode_to_queue("M104 S240");
+        moonraker.post_gcode_to_queue("M140 S110");
+        moonraker.post_gcode_to_queue("G28");
+        moonraker.http_post_loop();
+        if (!moonraker.post_queue.empty()) {
+            Serial.printf("post failed\n");
+            exit(1);
+        }
+    });
+
+    // Applying an already parsed status object, no I/O
+    JsonDocument doc;
+    deserializeJson(doc, status_body, DeserializationOption::Filter(moonraker.status_filter));
+    JsonVariantConst status = doc["result"]["status"];
+    bench_result_t apply = { "apply_status" };
+    run(apply, cycles * 10, NULL, [status]() {
+        moonraker.apply_status(status);
+    });
+
+    // Parsing the reply body alone, without the socket
+    bench_result_t parse = { "parse" };
+    run(parse, cycles * 10, &moonraker.conn_poll, []() {
+        JsonDocument json_parse(&moonraker.conn_poll.alloc);
+        deserializeJson(json_parse, status_body, strlen(status_body),
+                        DeserializationOption::Filter(moonraker.status_filter));
+        moonraker.conn_poll.rx_bytes += strlen(status_body);
+    });
+
+    Serial.printf("%u cycles, loopback port %u\n", cycles, port);
+    Serial.printf("%-14s %8s %8s %8s %8s %8s %8s\n", "path", "cpu us", "p50 us", "p99 us", "heap", "json", "bytes");
+    report(poll);
+    report(poll_changed);
+    report(post);
+    report(apply);
+    report(parse);
+    Serial.printf("poll sockets: %u requests, %u reused, %u reconnects; json peak %u B; %u of %u same replies unparsed\n",
+                  moonraker.conn_poll.requests, moonraker.conn_poll.reused, moonraker.conn_poll.reconnects,
+                  moonraker.conn_poll.parse_peak_max, same, cycles + BENCH_WARMUP);
+
+    // Steady-state polling is allocation free, see MOONRAKER::send_request
+    if (poll.heap || poll_changed.heap) {
+        Serial.printf("FAIL: %llu heap allocations on the poll path, %u JSON blocks outside poll_arena\n",
+                      (unsigned long long)(poll.heap + poll_changed.heap), moonraker.conn_poll.alloc.heap_allocs);
+        return 1;
+    }
+    return 0;
+}
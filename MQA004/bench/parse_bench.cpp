@@ -0,0 +1,246 @@
+#include <Arduino.h>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include "crowpanel.h"
+#include "moonraker.h"
+#include "temp_history.h"
+#include "files.h"
+
+// Google Benchmark suite of the parse paths over synthetic replies in
+// bench/data, and of the temperature chart's downsampling. Besides ns/op
+// each parse benchmark reports:
+//   allocs    ArduinoJson heap blocks per operation
+//   peak_heap largest JSON heap of one operation, bytes
+//   bytes/s   reply bytes parsed
+//
+// Results go to bench_results.json unless --benchmark_out is given, so two
+// runs can be compared with Google Benchmark's tools/compare.py.
+// BENCH_DATA overrides the directory of the replies, e.g. to use ones
+// saved from a real printer.
+
+static std::string load(const char * name) {
+    const char * dir = getenv("BENCH_DATA");
+    std::string path = std::string(dir ? dir : "bench/data") + "/" + name;
+    FILE * f = fopen(path.c_str(), "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        exit(1);
+    }
+    std::string body;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) body.append(buf, n);
+    fclose(f);
+    return body;
+}
+
+static std::string query_panel;   // objects/query as polled by the panel
+static std::string query_full;    // objects/query of every object, bed mesh included
+static std::string notify;        // notify_status_update of a printing machine
+static std::string files_list;    // server/files/list of 600 files
+
+// Per operation allocator statistics as benchmark counters
+static void report(benchmark::State & state, COUNTING_ALLOCATOR & alloc, uint32_t allocs, size_t bytes) {
+    state.counters["allocs"] = benchmark::Counter(alloc.allocs - allocs, benchmark::Counter::kAvgIterations);
+    state.counters["peak_heap"] = alloc.peak;
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+static void parse(benchmark::State & state, const std::string & body, const JsonDocument * filter) {
+    COUNTING_ALLOCATOR alloc;
+    uint32_t allocs = alloc.allocs;
+    for (auto _ : state) {
+        JsonDocument doc(&alloc);
+        DeserializationError error = filter ?
+            deserializeJson(doc, body.data(), body.size(), DeserializationOption::Filter(*filter)) :
+            deserializeJson(doc, body.data(), body.size());
+        if (error) state.SkipWithError(error.c_str());
+        benchmark::DoNotOptimize(doc);
+    }
+    report(state, alloc, allocs, body.size());
+}
+
+// Parse and apply, as get_status does with a reply
+static void parse_apply(benchmark::State & state, const std::string & body) {
+    COUNTING_ALLOCATOR alloc;
+    uint32_t allocs = alloc.allocs;
+    for (auto _ : state) {
+        JsonDocument doc(&alloc);
+        deserializeJson(doc, body.data(), body.size(), DeserializationOption::Filter(moonraker.status_filter));
+        moonraker.apply_status(doc["result"]["status"]);
+        benchmark::DoNotOptimize(moonraker.data);
+    }
+    report(state, alloc, allocs, body.size());
+}
+
+static void BM_QueryPanel(benchmark::State & state) {
+    parse_apply(state, query_panel);
+}
+BENCHMARK(BM_QueryPanel);
+
+static void BM_QueryFull(benchmark::State & state) {
+    parse_apply(state, query_full);
+}
+BENCHMARK(BM_QueryFull);
+
+// What the status filter saves on a reply with every object
+static void BM_QueryFullUnfiltered(benchmark::State & state) {
+    parse(state, query_full, NULL);
+}
+BENCHMARK(BM_QueryFullUnfiltered);
+
+static void BM_QueryPanelHash(benchmark::State & state) {
+    for (auto _ : state) {
+        BODY_HASH hash;
+        hash.update(query_panel.data(), query_panel.size());
+        benchmark::DoNotOptimize(hash.value());
+    }
+    state.SetBytesProcessed(state.iterations() * query_panel.size());
+}
+BENCHMARK(BM_QueryPanelHash);
+
+static void BM_ApplyStatus(benchmark::State & state) {
+    JsonDocument doc;
+    deserializeJson(doc, query_panel, DeserializationOption::Filter(moonraker.status_filter));
+    JsonVariantConst status = doc["result"]["status"];
+    for (auto _ : state) {
+        moonraker.apply_status(status);
+        benchmark::DoNotOptimize(moonraker.data);
+    }
+}
+BENCHMARK(BM_ApplyStatus);
+
+static void BM_NotifyStatusUpdate(benchmark::State & state) {
+    std::vector<uint8_t> message(notify.begin(), notify.end());
+    uint32_t allocs = moonraker.conn_poll.alloc.allocs;
+    moonraker.conn_poll.alloc.reset_peak();
+    for (auto _ : state) {
+        moonraker.ws_text(message.data(), message.size());
+    }
+    report(state, moonraker.conn_poll.alloc, allocs, message.size());
+}
+BENCHMARK(BM_NotifyStatusUpdate);
+
+// Whole-document parse of a large file list, the baseline for the
+// streaming file list parser
+static void BM_FilesListDocument(benchmark::State & state) {
+    JsonDocument filter;
+    filter["result"][0]["path"] = true;
+    filter["result"][0]["modified"] = true;
+    filter["result"][0]["size"] = true;
+    parse(state, files_list, &filter);
+}
+BENCHMARK(BM_FilesListDocument);
+
+// Reply body as HTTP_CONN hands it to a parser
+class BODY_STREAM : public Stream {
+public:
+    using Print::write;
+
+    BODY_STREAM(const std::string & body) : body(body), pos(0) {}
+
+    int available(void) override {
+        return body.size() - pos;
+    }
+    int read(void) override {
+        return pos < body.size() ? (uint8_t)body[pos++] : -1;
+    }
+    int peek(void) override {
+        return pos < body.size() ? (uint8_t)body[pos] : -1;
+    }
+    size_t write(uint8_t c) override {
+        (void)c;
+        return 0;
+    }
+
+private:
+    const std::string & body;
+    size_t pos;
+};
+
+// The same list taken apart by files_scan() into the browser's index,
+// one element in the JSON heap at a time. Also reports the index's fixed
+// RAM as index_bytes and the files it kept.
+static void BM_FilesListStream(benchmark::State & state) {
+    static FILES_INDEX index;
+    COUNTING_ALLOCATOR alloc;
+    uint32_t allocs = alloc.allocs;
+    for (auto _ : state) {
+        BODY_STREAM body(files_list);
+        index.clear();
+        if (!files_scan(body, index, &alloc)) state.SkipWithError("scan failed");
+        index.sort();
+        benchmark::DoNotOptimize(index);
+    }
+    report(state, alloc, allocs, files_list.size());
+    state.counters["index_bytes"] = sizeof(index);
+    state.counters["kept"] = index.count;
+}
+BENCHMARK(BM_FilesListStream);
+
+static void BM_PathOnlyGcode(benchmark::State & state) {
+    const char * path = "/home/pi/printer_data/gcodes/customer_parts/batch_07/Spool_Holder_final_0.2mm_PETG_3h41m.gcode";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(path_only_gcode(path));
+    }
+}
+BENCHMARK(BM_PathOnlyGcode);
+
+// Temperature chart data of N samples, both heaters reduced to
+// TEMP_CHART_POINTS: the per-redraw cost should grow with N only linearly,
+// the chart's with TEMP_CHART_POINTS. Reports the history's RAM as bytes
+// and bytes_per_hour.
+template <uint16_t N>
+static void BM_TempHistoryDownsample(benchmark::State & state) {
+    static TEMP_HISTORY<N> history;
+    for (uint32_t i = 0; i < N; i++) {
+        // Heat up, hold with some noise, a few dips as when a fan kicks in
+        int16_t nozzle = i < 200 ? 25 + i : 225 + (int16_t)(i * 7919 % 5) - (i % 500 < 20 ? 15 : 0);
+        history.add(i * TEMP_HISTORY_INTERVAL, nozzle, i < 100 ? 25 + i * 3 / 4 : 100);
+    }
+    uint16_t index[TEMP_CHART_POINTS];
+    for (auto _ : state) {
+        for (uint8_t h = 0; h < HEATER_COUNT; h++) {
+            benchmark::DoNotOptimize(history);
+            benchmark::DoNotOptimize(history.downsample(h, index, TEMP_CHART_POINTS));
+            benchmark::DoNotOptimize(index);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * N);
+    state.counters["bytes"] = sizeof(history);
+    state.counters["bytes_per_hour"] = TEMP_HISTORY<N>::bytes_per_hour(TEMP_HISTORY_INTERVAL);
+}
+BENCHMARK_TEMPLATE(BM_TempHistoryDownsample, 240);
+BENCHMARK_TEMPLATE(BM_TempHistoryDownsample, TEMP_HISTORY_LEN);
+BENCHMARK_TEMPLATE(BM_TempHistoryDownsample, 17280); // 24 h
+
+int main(int argc, char ** argv) {
+    query_panel = load("objects_query_panel.json");
+    query_full = load("objects_query_full.json");
+    notify = load("notify_status_update.json");
+    files_list = load("files_list.json");
+
+    crowpanel_init();
+    moonraker_setup();
+
+    // Machine readable results by default
+    std::vector<char *> args(argv, argv + argc);
+    bool out = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--benchmark_out=", 16) == 0) out = true;
+    }
+    static char out_file[] = "--benchmark_out=bench_results.json";
+    static char out_format[] = "--benchmark_out_format=json";
+    if (!out) {
+        args.push_back(out_file);
+        args.push_back(out_format);
+    }
+    int count = args.size();
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "series.h"
+
+// Google Benchmark suite of the flash telemetry log over a synthetic day:
+// idle, heat up, a 20 h print with noisy temperatures, cool down, at
+// SERIES_INTERVAL. Besides ns/op the benchmarks report:
+//   bytes_per_sample encoded size, segment headers included for the store
+//   samples/s        samples encoded, decoded or queried
+//   bytes/s          flash bytes read by queries
+//
+// The store is kept in a scratch directory, LITTLEFS_DIR or
+// "bench_littlefs", emptied first.
+
+#define DAY_SAMPLES (86400000UL / SERIES_INTERVAL)
+
+static std::vector<series_sample_t> day;
+
+static void make_day(uint32_t start) {
+    uint32_t noise = 1;
+    for (uint32_t i = 0; i < DAY_SAMPLES; i++) {
+        series_sample_t s;
+        memset(&s, 0, sizeof(s));
+        s.time = start + i * (SERIES_INTERVAL / 1000);
+        noise = noise * 1103515245 + 12345;
+        int16_t jitter = (noise >> 16) % 3 - 1;
+        uint32_t minute = i * SERIES_INTERVAL / 60000;
+        if (minute < 30 || minute >= 1290) {
+            s.value[SERIES_NOZZLE] = 25;
+            s.value[SERIES_BED] = 25;
+        } else if (minute < 40) {
+            s.value[SERIES_NOZZLE_TARGET] = 220;
+            s.value[SERIES_BED_TARGET] = 60;
+            s.value[SERIES_NOZZLE] = 25 + (int16_t)((minute - 30) * 20) + jitter;
+            s.value[SERIES_BED] = 25 + (int16_t)((minute - 30) * 4);
+            s.value[SERIES_STATE] = SERIES_STATE_HEATING_NOZZLE | SERIES_STATE_HEATING_BED;
+        } else {
+            s.value[SERIES_NOZZLE_TARGET] = 220;
+            s.value[SERIES_BED_TARGET] = 60;
+            s.value[SERIES_NOZZLE] = 220 + jitter;
+            s.value[SERIES_BED] = 60 + (jitter > 0);
+            s.value[SERIES_PROGRESS] = (minute - 40) * 100 / 1250;
+            s.value[SERIES_STATE] = SERIES_STATE_PRINTING;
+        }
+        day.push_back(s);
+    }
+}
+
+static void BM_SeriesEncode(benchmark::State & state) {
+    uint8_t out[SERIES_SAMPLE_MAX];
+    size_t bytes = 0;
+    for (auto _ : state) {
+        series_codec_t codec;
+        series_codec_reset(&codec, day[0].time);
+        bytes = 0;
+        for (const series_sample_t & s : day) {
+            bytes += series_encode(&codec, s, out);
+            benchmark::DoNotOptimize(out);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * day.size());
+    state.counters["bytes_per_sample"] = (double)bytes / day.size();
+}
+BENCHMARK(BM_SeriesEncode)->Unit(benchmark::kMillisecond);
+
+static void BM_SeriesDecode(benchmark::State & state) {
+    std::vector<uint8_t> encoded(day.size() * SERIES_SAMPLE_MAX);
+    series_codec_t codec;
+    series_codec_reset(&codec, day[0].time);
+    size_t len = 0;
+    for (const series_sample_t & s : day) len += series_encode(&codec, s, encoded.data() + len);
+
+    for (auto _ : state) {
+        series_codec_reset(&codec, day[0].time);
+        series_sample_t s;
+        for (size_t pos = 0; pos < len;) {
+            size_t n = series_decode(&codec, encoded.data() + pos, len - pos, &s);
+            if (n == 0) {
+                state.SkipWithError("decode failed");
+                break;
+            }
+            pos += n;
+            benchmark::DoNotOptimize(s);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * day.size());
+}
+BENCHMARK(BM_SeriesDecode)->Unit(benchmark::kMillisecond);
+
+// The last state.range(0) minutes of the stored day, as a chart asks
+static void BM_SeriesQuery(benchmark::State & state) {
+    uint32_t to = day.back().time;
+    uint32_t from = to - state.range(0) * 60 + 1;
+    uint32_t samples = 0;
+    uint32_t bytes = 0;
+    for (auto _ : state) {
+        SERIES_QUERY query(series, from, to);
+        series_sample_t s;
+        samples = 0;
+        while (query.next(&s)) samples++;
+        bytes += query.bytes;
+    }
+    if (samples != state.range(0) * 60000 / SERIES_INTERVAL) state.SkipWithError("wrong sample count");
+    state.SetItemsProcessed(state.iterations() * samples);
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_SeriesQuery)->Arg(120)->Arg(1440)->Unit(benchmark::kMillisecond);
+
+// A day through SERIES into the file system, flushes included. Runs after
+// the queries, its segments follow theirs.
+static void BM_SeriesAppend(benchmark::State & state) {
+    uint32_t flash_bytes = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        SERIES * store = new SERIES();
+        store->begin();
+        state.ResumeTiming();
+        for (const series_sample_t & s : day) store->append(s);
+        store->flush();
+        flash_bytes = store->flash_bytes;
+        delete store;
+    }
+    state.SetItemsProcessed(state.iterations() * day.size());
+    state.counters["bytes_per_sample"] = (double)flash_bytes / day.size();
+}
+BENCHMARK(BM_SeriesAppend)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+int main(int argc, char ** argv) {
+    if (getenv("LITTLEFS_DIR") == NULL) setenv("LITTLEFS_DIR", "bench_littlefs", 1);
+    LittleFS.begin();
+    for (uint32_t slot = 0; slot < SERIES_SLOTS; slot++) {
+        char path[16];
+        snprintf(path, sizeof(path), SERIES_PATH, (unsigned)slot);
+        LittleFS.remove(path);
+    }
+
+    // The day BM_SeriesQuery reads, stored once
+    make_day(1700000000UL);
+    series.begin();
+    for (const series_sample_t & s : day) series.append(s);
+    series.flush();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
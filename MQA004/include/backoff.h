@@ -0,0 +1,101 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define BREAKER_THRESHOLD 5     // Consecutive failures that open the breaker
+#define BREAKER_COOLDOWN 30000  // Time an open breaker rejects requests
+
+typedef enum {
+    BREAKER_CLOSED,    // Requests flow, failures back off exponentially
+    BREAKER_OPEN,      // Too many failures, requests are skipped until the cooldown ends
+    BREAKER_HALF_OPEN  // Cooldown over, the next request decides
+} breaker_state_t;
+
+// Retry schedule and circuit breaker of one endpoint. It never sleeps:
+// callers ask ready() before a request and skip it while backing off.
+// Owned by the task sending on the endpoint; other tasks only call
+// request_reset(), which the owner applies on its next ready() or wait().
+class BACKOFF {
+public:
+    uint32_t attempts;  // Requests let through
+    uint32_t failures;  // Requests that failed
+    uint32_t skipped;   // Requests held back by the schedule
+    uint32_t trips;     // Times the breaker opened
+    uint8_t state;      // breaker_state_t
+
+    // Without a breaker failures only ever back off up to max_ms, for
+    // requests that must not be held for BREAKER_COOLDOWN
+    BACKOFF(uint32_t base_ms, uint32_t max_ms, bool breaker = true)
+        : attempts(0), failures(0), skipped(0), trips(0), state(BREAKER_CLOSED),
+          base(base_ms), max(max_ms), breaker(breaker), streak(0), next_try(0), reset_pending(false) {}
+
+    bool ready(unsigned long now) {
+        apply_reset();
+        if ((long)(now - next_try) < 0) {
+            skipped++;
+            return false;
+        }
+        if (state == BREAKER_OPEN) {
+            state = BREAKER_HALF_OPEN; // Let one probe through
+        }
+        attempts++;
+        return true;
+    }
+
+    void success(void) {
+        streak = 0;
+        state = BREAKER_CLOSED;
+    }
+
+    void failure(unsigned long now) {
+        failures++;
+        if (streak < 255) streak++;
+
+        if (breaker && (state == BREAKER_HALF_OPEN || streak >= BREAKER_THRESHOLD)) {
+            if (state != BREAKER_OPEN) trips++;
+            state = BREAKER_OPEN;
+            next_try = now + BREAKER_COOLDOWN;
+            return;
+        }
+
+        // Exponential delay with equal jitter, so clients that failed
+        // together do not all come back at the same moment. Doubling stops
+        // at max, long before the shift could reach 32 bits.
+        uint8_t shift = streak - 1;
+        uint32_t delay = shift < 32 && (max >> shift) >= base ? base << shift : max;
+        next_try = now + delay / 2 + random(delay / 2 + 1);
+    }
+
+    // Any task: the link came back, stop waiting
+    void request_reset(void) {
+        reset_pending.store(true, std::memory_order_release);
+    }
+
+    // Time until ready() lets a request through
+    unsigned long wait(unsigned long now) {
+        apply_reset();
+        return (long)(next_try - now) > 0 ? next_try - now : 0;
+    }
+
+private:
+    uint32_t base;
+    uint32_t max;
+    bool breaker;
+    uint8_t streak; // Consecutive failures
+    unsigned long next_try;
+    std::atomic<bool> reset_pending;
+
+    // Owning task only. A request made between the load and the store is
+    // served by this same reset.
+    void apply_reset(void) {
+        if (!reset_pending.load(std::memory_order_acquire)) return;
+        reset_pending.store(false, std::memory_order_relaxed);
+        streak = 0;
+        state = BREAKER_CLOSED;
+        next_try = millis();
+    }
+};
+
+#endif
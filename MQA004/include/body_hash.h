@@ -0,0 +1,53 @@
+#ifndef BODY_HASH_H
+#define BODY_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BODY_HASH_NONE 0 // Never returned by value(), means "no previous body"
+
+static const char body_hash_key[] = "\"eventtime\":";
+
+// FNV-1a hash of a response body, fed in chunks as it is read. The value
+// of "eventtime" changes on every Moonraker reply, so its digits are left
+// out and two replies that differ only in eventtime hash the same.
+class BODY_HASH {
+public:
+    BODY_HASH() : hash(2166136261u), matched(0), masking(false) {}
+
+    void update(const char * buf, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            char c = buf[i];
+            if (masking) {
+                if ((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E' || c == ' ') {
+                    continue;
+                }
+                masking = false;
+            }
+
+            hash = (hash ^ (uint8_t)c) * 16777619u;
+
+            // The key has no repeated prefix, so restarting the match on
+            // a mismatch is enough
+            if (c == body_hash_key[matched]) {
+                if (body_hash_key[++matched] == 0) {
+                    masking = true;
+                    matched = 0;
+                }
+            } else {
+                matched = c == body_hash_key[0] ? 1 : 0;
+            }
+        }
+    }
+
+    uint32_t value(void) const {
+        return hash != BODY_HASH_NONE ? hash : 1;
+    }
+
+private:
+    uint32_t hash;
+    uint8_t matched; // Characters of body_hash_key seen so far
+    bool masking;    // Inside the eventtime number
+};
+
+#endif
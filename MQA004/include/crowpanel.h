@@ -8,6 +8,8 @@
 // WiFi scan configuration
 #define SCAN_SSIDS_NUM 20
 
+#define FARM_PRINTERS_MAX 11 // Printers watched besides the one the panel controls
+
 typedef struct {
     int32_t rssi[SCAN_SSIDS_NUM]; // RSSI returned RSSI values
     char ssid[SCAN_SSIDS_NUM][65]; // SSIDs returned by the wifi scan.
@@ -26,6 +28,7 @@ typedef struct {
     char moonraker_ip[65]; // "192.168.255.255" or "<hostname>.local"
     char moonraker_port[6]; // "65536", max_len=6
     char moonraker_tool[7]; // "tool0"
+    char farm_printers[FARM_PRINTERS_MAX][72]; // Further printers of a print farm, "host" or "host:port"; "" if unused
     char mode[6]; // "ap":WIFI_MODE_AP, "sta":WIFI_MODE_STA, "apsta":WIFI_MODE_APSTA
     lv_color_t theme_color;
 } crowpanel_config_t;
@@ -0,0 +1,108 @@
+#ifndef FARM_H
+#define FARM_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "moonraker.h"
+
+#define FARM_MAX (FARM_PRINTERS_MAX + 1) // Printers on the grid, moonraker's own first
+#define FARM_SOCKETS 3          // Kept-alive connections the watched printers share, lwIP has 10 sockets
+#define FARM_LABEL_LEN 12       // Grid tile caption
+#define FARM_DEFAULT_PORT 7125
+#define FARM_TIMEOUT 3000       // Status request timeout
+#define FARM_BACKOFF_BASE 1000  // An unreachable printer is retried slowly, the others wait for it
+#define FARM_BACKOFF_MAX 30000
+#define FARM_MAX_WAIT 1000      // Longest sleep of farm_task, bounds the reaction to WiFi coming back
+#define FARM_RATE_WINDOW 60000  // Window of the aggregate request rate and task load
+
+typedef enum {
+    FARM_LINK_DOWN,    // No reply yet, or the last request failed
+    FARM_LINK_UNREADY, // Moonraker answers, Klippy is not ready
+    FARM_LINK_READY
+} farm_link_t;
+
+// A watched printer: status polling only, commands still go to the printer
+// of moonraker. Only snapshot and link are read outside farm_task.
+typedef struct {
+    RESOLVER resolver; // Looked up on wifi_task like the main one
+    uint16_t port;
+    char label[FARM_LABEL_LEN];
+    moonraker_data_t data;              // Working copy
+    bool unready;
+    SEQLOCK<moonraker_data_t> snapshot; // Published copy for the UI
+    std::atomic<uint8_t> link;          // farm_link_t
+    POLL_GOVERNOR<moonraker_data_t> governor;
+    BACKOFF backoff = BACKOFF(FARM_BACKOFF_BASE, FARM_BACKOFF_MAX);
+    uint32_t body_hash; // BODY_HASH of the last parsed reply
+    LATENCY_HIST latency;
+    uint32_t ok;
+    uint32_t failed;
+    uint32_t unchanged;
+    uint32_t unhashed; // Replies too long or chunked to be hashed, see moonraker_hashable()
+} farm_printer_t;
+
+// Status of up to FARM_PRINTERS_MAX further printers of a print farm, for
+// the grid screen. One task polls them all in turn, each at the pace its
+// POLL_GOVERNOR picks, round robin among the ones that are due. Replies
+// are read into one shared body buffer and JSON arena, and a few pooled
+// connections are handed to the printers most recently polled.
+class FARM {
+public:
+    farm_printer_t printers[FARM_PRINTERS_MAX];
+    uint8_t count;              // Configured printers, set by begin()
+    uint8_t rejected;           // Entries begin() skipped: no host, one longer than RESOLVE_NAME_LEN, or a bad port
+    std::atomic<uint8_t> focus; // Grid tile shown on the main screen, 0 for moonraker's printer
+
+    // Aggregate load of farm_task
+    uint32_t requests;
+    uint32_t rate; // Requests in the last complete FARM_RATE_WINDOW
+    uint32_t load; // Percent of that window spent in requests
+
+    FARM();
+
+    // Before the tasks start, reads crowpanel_config.farm_printers
+    void begin(void);
+
+    // wifi_task: DNS or mDNS lookup of the next printer name that is due,
+    // at most one per call. Returns whether one was looked up.
+    bool resolve(void);
+
+    // farm_task: poll the next printer that is due. Returns how long the
+    // task may sleep before the next one is, 0 right after a poll.
+    unsigned long step(void);
+
+    void stats_json(Print & out);
+
+    // RAM of one more watched printer, and of what they share
+    static size_t printer_bytes(void) {
+        return sizeof(farm_printer_t);
+    }
+    size_t pool_bytes(void) const {
+        return sizeof(conns) + sizeof(body) + sizeof(arena);
+    }
+
+private:
+    HTTP_CONN conns[FARM_SOCKETS];
+    uint8_t conn_owner[FARM_SOCKETS]; // Printer the connection last served, FARM_PRINTERS_MAX if none
+    uint32_t conn_used[FARM_SOCKETS];     // millis() of its last request
+    char body[POLL_BODY_LEN];   // Reply being hashed
+    alignas(max_align_t) uint8_t arena[POLL_ARENA_LEN];
+    COUNTING_ALLOCATOR alloc;   // JSON heap of the replies, in arena
+    uint8_t last;               // Printer polled last
+    uint8_t resolve_next;       // Printer resolve() tries first, only used by wifi_task
+    unsigned long window_start;
+    uint32_t window_requests;
+    uint32_t window_busy;       // ms spent in requests in the current window
+
+    HTTP_CONN & connection(uint8_t i);
+    void poll(uint8_t i);
+};
+
+extern FARM farm;
+
+// Grid caption of a host: the name without its domain, or the address
+void farm_label(const char * host, char * label, size_t len);
+
+void farm_task(void * parameter);
+
+#endif
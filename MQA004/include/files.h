@@ -0,0 +1,139 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "moonraker.h"
+
+#define FILES_MAX 320             // Index entries, past this the newest files are kept
+#define FILES_ARENA_LEN 16384     // Path bytes of the index, about FILES_MAX paths of 50 characters
+#define FILES_PATH_MAX (CMD_TEXT_LEN - 32) // Longer paths are skipped, as are those whose encoded start request does not fit a command
+#define FILES_JSON_ARENA 1024     // JSON heap of one list entry or metadata reply
+#define FILES_TIMEOUT 10000
+#define FILES_REFRESH 60000       // An index older than this is reloaded when the browser opens
+#define FILES_META_QUEUE 16       // Metadata requests of rows scrolled into view
+#define FILES_META_NEAR 16        // Requests further than this from the first visible row are dropped
+#define FILES_LIST_PATH "/server/files/list?root=gcodes"
+#define FILES_META_PATH "/server/files/metadata?filename="
+#define FILES_START_PATH "/printer/print/start?filename="
+
+typedef enum {
+    FILES_EMPTY,
+    FILES_LOADING,
+    FILES_READY,
+    FILES_FAILED
+} files_state_t;
+
+typedef enum {
+    META_NONE,
+    META_PENDING,
+    META_READY,
+    META_FAILED
+} files_meta_state_t;
+
+typedef struct {
+    uint32_t modified;       // Unix time
+    uint32_t size;           // Bytes
+    uint32_t estimated_time; // s, metadata
+    uint32_t filament;       // mm, metadata
+    uint16_t path;           // Offset of the path in the arena
+} files_entry_t;
+
+// Compact list of G-code files: fixed entries, paths packed in an arena.
+// When either runs out, the oldest quarter of the files is dropped and the
+// arena compacted, and older files are skipped from then on, so what is
+// kept is always the newest files whatever the printer holds.
+class FILES_INDEX {
+public:
+    uint16_t count;
+    uint32_t seen;    // Files offered to add() since clear()
+    uint32_t dropped; // Of them, not kept: too old for the budget or too long a path
+
+    FILES_INDEX();
+
+    void clear(void);
+    bool add(const char * path, uint32_t modified, uint32_t size);
+    // Newest first, once all files are added
+    void sort(void);
+
+    files_entry_t & at(uint16_t i) {
+        return entries[i];
+    }
+    const files_entry_t & at(uint16_t i) const {
+        return entries[i];
+    }
+    const char * path(uint16_t i) const {
+        return arena + entries[i].path;
+    }
+    size_t arena_used(void) const {
+        return used;
+    }
+
+private:
+    files_entry_t entries[FILES_MAX];
+    char arena[FILES_ARENA_LEN];
+    uint16_t used;
+    uint32_t cutoff; // Files modified up to this were dropped, skip them
+
+    void make_room(void);
+};
+
+// prefix followed by path percent-encoded as a query value, so names with
+// "+", "&" or "%" reach Moonraker as they are. Returns false, with buf
+// empty, if it does not fit len bytes.
+bool files_query(char * buf, size_t len, const char * prefix, const char * path);
+
+// Stream the entries of a /server/files/list reply into index, one JSON
+// object at a time, so the reply is never held whole. alloc serves the
+// per-entry documents. Returns false on a malformed or cut reply.
+bool files_scan(Stream & in, FILES_INDEX & index, ArduinoJson::Allocator * alloc);
+
+// File browser backend: lists the printer's G-code files into an index and
+// fetches the metadata of the rows the browser shows, on files_task and
+// its own connection. The LVGL task asks with request_list() and
+// request_meta() and reads the index only while state is FILES_READY.
+class FILES {
+public:
+    FILES_INDEX index;
+    std::atomic<uint8_t> state;             // files_state_t
+    std::atomic<uint8_t> meta[FILES_MAX];   // files_meta_state_t of each index entry
+    std::atomic<uint16_t> visible;          // First row the browser shows
+    SPSC_RING<uint16_t, FILES_META_QUEUE> meta_queue; // Filled by the LVGL task
+    std::atomic<TaskHandle_t> task;
+    unsigned long loaded_at;                // millis() of the last listing
+
+    // Written by files_task
+    uint32_t lists;       // Listings done
+    uint32_t list_ms;     // Time of the last listing, request and scan
+    uint32_t list_bytes;  // Its body bytes
+    uint32_t meta_fetched;
+    uint32_t meta_failed;
+    uint32_t meta_skipped; // Scrolled out of view before their turn
+    LATENCY_HIST meta_time;
+
+    FILES();
+
+    // LVGL task: list the files again, unless a listing is running
+    void request_list(void);
+    // LVGL task: fetch the metadata of entry i if not done yet
+    void request_meta(uint16_t i);
+
+    // files_task: serve the requests
+    void loop(void);
+    void stats_json(Print & out);
+
+private:
+    HTTP_CONN http;
+    alignas(max_align_t) uint8_t json_arena[FILES_JSON_ARENA];
+    COUNTING_ALLOCATOR alloc;
+
+    int request(const char * path);
+    bool list(void);
+    bool fetch_meta(uint16_t i);
+};
+
+extern FILES files;
+
+void files_task(void * parameter);
+
+#endif
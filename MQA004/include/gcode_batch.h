@@ -0,0 +1,45 @@
+#ifndef GCODE_BATCH_H
+#define GCODE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GCODE_SCRIPT_PATH "/printer/gcode/script?script="
+#define GCODE_KEY_LEN 24 // Longest heater key, "H:" + Klipper heater name
+
+typedef enum {
+    GCODE_EMERGENCY, // Stops the printer, goes out before anything else
+    GCODE_CONTROL,   // Print job control, overtakes queued G-code
+    GCODE_BULK       // Everything else, sent in order and coalesced
+} gcode_class_t;
+
+// Priority class of a G-code line. Unless it is GCODE_BULK, *path is set
+// to the Moonraker endpoint doing the same, e.g. M112 gives
+// "/printer/emergency_stop" and CANCEL_PRINT "/printer/print/cancel".
+uint8_t gcode_priority(const char * line, const char ** path);
+
+// Priority class of a request path, GCODE_BULK unless it is one of the
+// endpoints gcode_priority() maps to
+uint8_t path_priority(const char * path);
+
+// Heater a temperature setpoint command applies to, e.g. "M104 S220 T0"
+// gives "E0" and "SET_HEATER_TEMPERATURE HEATER=chamber TARGET=40" gives
+// "H:chamber". Returns false if line is not a setpoint.
+bool gcode_setpoint_key(const char * line, char * key, size_t len);
+
+// Commands whose repetition has no further effect, so identical queued
+// copies can be collapsed. Relative moves and extrusion never qualify.
+bool gcode_idempotent(const char * line);
+
+// Decide which of count queued lines still need to be sent: a setpoint
+// followed by another one for the same heater is superseded unless it
+// waits for the temperature (M109, M190), and an idempotent command right
+// after an identical one is dropped. Returns the number of lines kept.
+uint8_t gcode_coalesce(const char * const * lines, uint8_t count, bool * keep);
+
+// Append line, percent-encoded, to the script query in buf (pos bytes
+// used), preceded by an encoded newline if it is not the first line.
+// Returns the new length, or 0 if it does not fit and buf is unchanged.
+size_t gcode_append(char * buf, size_t len, size_t pos, const char * line, bool newline);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HTTP_CONN_H
+#define HTTP_CONN_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define HTTP_PATH_LEN 576     // Longest request path once percent-encoded
+#define HTTP_HEADER_LEN 128   // Request line tail and headers, see HTTP_CONN::begin()
+#define HTTP_LINE_LEN 96      // Response header lines are cut to this, only short ones matter
+#define HTTP_CONNECT_TIMEOUT 2000 // Time to open the TCP connection
+
+// request() failures, below zero like HTTPClient's HTTPC_ERROR_*
+#define HTTP_ERROR_CONNECT (-1)   // Connection refused or timed out, nothing was sent
+#define HTTP_ERROR_SEND (-2)      // Request not written, the server cannot have seen it
+#define HTTP_ERROR_TOO_LONG (-3)  // Path does not fit HTTP_PATH_LEN, never sent
+#define HTTP_ERROR_LOST (-5)      // Closed before any byte of a reply arrived
+#define HTTP_ERROR_NO_SERVER (-7) // Reply is not HTTP
+#define HTTP_ERROR_TIMEOUT (-11)  // No status line within the timeout, or a cut one
+
+// Whether a request that failed on a kept-alive socket may go out again on
+// a new one: the write failed, or the server had closed the socket before
+// answering anything. After a timeout the server may be running it still.
+inline bool http_stale(int code) {
+    return code == HTTP_ERROR_SEND || code == HTTP_ERROR_LOST;
+}
+
+// Percent-encode, in place, the characters of buf[0..len) a request target
+// may not contain: spaces, controls, non-ASCII and "#<>\^`{|}. Reserved
+// characters and existing escapes are kept, so an already encoded query
+// passes unchanged. Returns the new length, or 0 if it would not fit in
+// size bytes with its terminator, leaving buf as it was.
+size_t url_encode(char * buf, size_t len, size_t size);
+
+// Keep-alive HTTP/1.1 client over one WiFiClient, without heap use: the
+// request is assembled in a fixed buffer from the path and a header
+// template built once per host, and the reply body is read in place from
+// the socket as a Stream, Content-Length and chunked bodies alike.
+// HTTPClient allocates Strings for the URL and every header line instead.
+class HTTP_CONN : public Stream {
+public:
+    using Print::write;
+
+    WiFiClient tcp;
+    int size;          // Content-Length of the reply, -1 if chunked or unknown
+    uint32_t sent;     // Bytes of the last request
+    uint32_t received; // Body bytes read of the last reply
+
+    HTTP_CONN();
+
+    // Where requests go. The header template is only rebuilt, and the
+    // socket closed, when host or port differ from the last call.
+    void begin(const char * host, uint16_t port);
+
+    // Send a bodyless request and read the status line and headers.
+    // Returns the HTTP status code or an HTTP_ERROR_* code.
+    int request(const char * type, const char * path, uint32_t timeout);
+
+    // Bulk body read, waits up to the timeout for each part; returns fewer
+    // than len bytes at the end of the body or on an error
+    size_t read_body(char * buf, size_t len);
+
+    // Done with the reply. The socket is kept for the next request if the
+    // server allows it and the rest of the body has already arrived.
+    void end(void);
+
+    // Stream of the reply body, at most available() bytes without waiting
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+    size_t write(uint8_t c) override { (void)c; return 0; }
+
+private:
+    char req[HTTP_PATH_LEN + HTTP_HEADER_LEN]; // Request being sent
+    char tail[HTTP_HEADER_LEN]; // " HTTP/1.1\r\nHost: ...\r\n\r\n" of the current host
+    size_t tail_len;
+    char host[65];             // As RESOLVE_NAME_LEN
+    uint16_t port;
+    uint32_t timeout;          // Of the current request, ms
+    int32_t left;              // Body bytes left in the current chunk, -1 until the socket closes
+    bool chunked;
+    bool done;                 // The body has been read to its end
+    bool reuse;                // The server keeps the socket open after this reply
+    uint32_t chunks;           // Chunk headers read of this reply
+
+    bool wait(void);
+    bool read_line(char * buf, size_t len);
+    int32_t remaining(void);
+    void next_chunk(void);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <Arduino.h>
+
+#define JOURNAL_PATH "/journal"
+#define JOURNAL_TMP_PATH "/journal.tmp"
+#define JOURNAL_PARTITION "storage"
+#define JOURNAL_MAX_BYTES 8192  // Appends beyond this are refused
+#define JOURNAL_EXPIRE 600      // Seconds from the button press a command stays worth sending
+#define JOURNAL_TEXT_LEN 128    // Longest command, as CMD_TEXT_LEN
+#define JOURNAL_MAGIC 0x4a43
+#define JOURNAL_CLOCK_VALID 1600000000UL // time() past this means SNTP has set the clock
+#define JOURNAL_CLOCK_WAIT 60000 // ms after boot an earlier boot's commands wait for SNTP, then they are dropped
+
+typedef enum {
+    JOURNAL_CMD, // A queued command
+    JOURNAL_ACK  // Commands up to seq are done
+} journal_kind_t;
+
+// On-flash record, followed by len bytes of text
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t kind;         // journal_kind_t
+    uint8_t type;         // moonraker_cmd_type_t
+    uint32_t seq;
+    uint32_t deadline_ms; // millis() deadline, only valid in the boot that wrote it
+    uint32_t deadline_s;  // time() deadline, 0 if the clock was not set
+    uint8_t len;
+    uint8_t check;        // Sum of the other bytes and the text, catches a torn append
+} journal_record_t;
+
+// Command read back for replay
+typedef struct {
+    uint32_t seq;
+    uint8_t type;
+    char text[JOURNAL_TEXT_LEN];
+} journal_entry_t;
+
+// Append-only file of commands that could not be sent, kept in LittleFS
+// on the storage partition so they survive a reset. Every command carries
+// a deadline; a command from an earlier boot is only replayed if the
+// clock (SNTP) proves it has not expired. Replayed commands are marked
+// with an ACK record, so a reset during replay sends nothing twice. The
+// file is deleted once everything in it is done, and rewritten without
+// the done and expired records at boot or when it is full.
+// Used by one task only.
+class JOURNAL {
+public:
+    uint32_t appended;        // Commands written
+    uint32_t full;            // Commands refused, journal full or flash error
+    uint32_t expired;         // Commands dropped at their deadline
+    uint32_t replayed;        // Commands handed back for sending
+    uint32_t append_us;       // Total and worst time of append(), flash included
+    uint32_t append_us_max;
+    uint32_t replay_ms;       // Time spent replaying, for the throughput
+
+    JOURNAL();
+
+    // Mount the file system and compact what an earlier boot left
+    bool begin(void);
+    bool pending(void) const {
+        return last_seq > acked;
+    }
+    // Whether read() can judge the pending commands: those of an earlier
+    // boot need the clock, which SNTP sets some time after the link is up.
+    // Without it they would all be dropped as expired, so the replay waits
+    // up to JOURNAL_CLOCK_WAIT for it.
+    bool replay_ready(void) const {
+        return acked + 1 >= boot_seq || (unsigned long)time(NULL) >= JOURNAL_CLOCK_VALID ||
+               millis() >= JOURNAL_CLOCK_WAIT;
+    }
+    uint32_t size(void) const {
+        return bytes;
+    }
+
+    // Store a command queued at queued_at (millis())
+    bool append(uint8_t type, const char * text, uint32_t queued_at);
+
+    // Oldest commands not done yet, up to max into out. *last is set to the
+    // seq to ack() once they are sent; expired commands are skipped and
+    // covered by it, so 0 entries with *last != 0 only needs the ack.
+    uint8_t read(journal_entry_t * out, uint8_t max, uint32_t * last);
+
+    // Commands up to seq are done
+    void ack(uint32_t seq);
+
+    // Give up every command, e.g. after an emergency stop
+    void discard(void) {
+        ack(last_seq);
+    }
+
+private:
+    bool mounted;
+    uint32_t bytes;       // File size
+    uint32_t next_seq;
+    uint32_t last_seq;    // Newest command in the file
+    uint32_t acked;       // Commands up to here are done
+    uint32_t acked_pos;   // File offset just past the record of acked
+    uint32_t read_end;    // File offset just past what read() returned
+    uint32_t read_last;   // *last of the last read()
+    uint32_t boot_seq;    // First seq of this boot, older ones have no valid deadline_ms
+    uint32_t expired_seq; // Newest expired command counted
+
+    bool write(const journal_record_t & header, const char * text);
+    bool expired_at(const journal_record_t & header, uint32_t now_ms, time_t now_s) const;
+    bool compact(void);
+};
+
+#endif
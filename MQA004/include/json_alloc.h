@@ -0,0 +1,128 @@
+#ifndef JSON_ALLOC_H
+#define JSON_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+// ArduinoJson allocator that keeps track of the heap held by a document,
+// used to report the peak RAM a response needs while being parsed.
+//
+// With an arena, blocks are carved from that fixed buffer instead of the
+// heap, and the arena is rewound once every block in it has been freed,
+// i.e. when the last document using it is destroyed. Blocks that do not
+// fit still come from the heap and are counted in heap_allocs.
+class COUNTING_ALLOCATOR : public ArduinoJson::Allocator {
+public:
+    size_t current; // Bytes held right now
+    size_t peak;    // Highest value of current since reset_peak()
+    uint32_t allocs; // Number of allocate/reallocate calls
+    uint32_t heap_allocs; // Of them, the ones served by the heap
+
+    COUNTING_ALLOCATOR()
+        : current(0), peak(0), allocs(0), heap_allocs(0), arena(NULL), arena_len(0), arena_top(0), arena_blocks(0) {}
+
+    // Before the first document uses the allocator
+    void use_arena(void * buf, size_t len) {
+        arena = (uint8_t *)buf;
+        arena_len = len;
+        arena_top = 0;
+        arena_blocks = 0;
+    }
+
+    void reset_peak(void) {
+        peak = current;
+    }
+
+    void * allocate(size_t size) override {
+        header_t * block = arena_allocate(size);
+        if (block == NULL) {
+            block = (header_t *)malloc(sizeof(header_t) + size);
+            if (block == NULL) return NULL;
+            heap_allocs++;
+        }
+        block->size = size;
+        allocs++;
+        add(size);
+        return block + 1;
+    }
+
+    void deallocate(void * ptr) override {
+        if (ptr == NULL) return;
+        header_t * block = (header_t *)ptr - 1;
+        current -= block->size;
+        if (in_arena(block)) {
+            if (--arena_blocks == 0) arena_top = 0;
+        } else {
+            free(block);
+        }
+    }
+
+    void * reallocate(void * ptr, size_t new_size) override {
+        if (ptr == NULL) return allocate(new_size);
+        header_t * block = (header_t *)ptr - 1;
+        size_t old_size = block->size;
+
+        if (in_arena(block)) {
+            bool last = (uint8_t *)block + span(old_size) == arena + arena_top;
+            if (last && (uint8_t *)block - arena + span(new_size) <= arena_len) {
+                // Grown or shrunk where it is
+                arena_top = (uint8_t *)block - arena + span(new_size);
+            } else if (new_size > old_size) {
+                void * moved = allocate(new_size);
+                if (moved == NULL) return NULL;
+                memcpy(moved, ptr, old_size);
+                deallocate(ptr);
+                return moved;
+            }
+            // A block that is not the last one keeps its room when shrunk
+        } else {
+            block = (header_t *)realloc(block, sizeof(header_t) + new_size);
+            if (block == NULL) return NULL;
+            heap_allocs++;
+        }
+        block->size = new_size;
+        allocs++;
+        current -= old_size;
+        add(new_size);
+        return block + 1;
+    }
+
+private:
+    // Size prefix, padded so the returned pointer keeps malloc's alignment
+    union header_t {
+        size_t size;
+        max_align_t align;
+    };
+
+    uint8_t * arena;
+    size_t arena_len;
+    size_t arena_top;      // Bytes of the arena handed out since it was last empty
+    uint32_t arena_blocks; // Blocks in the arena not freed yet
+
+    // Arena bytes of a block of size bytes, header included
+    static size_t span(size_t size) {
+        return sizeof(header_t) + (size + sizeof(header_t) - 1) / sizeof(header_t) * sizeof(header_t);
+    }
+
+    bool in_arena(const header_t * block) const {
+        return arena != NULL && (const uint8_t *)block >= arena && (const uint8_t *)block < arena + arena_len;
+    }
+
+    header_t * arena_allocate(size_t size) {
+        if (arena == NULL || arena_len - arena_top < span(size)) return NULL;
+        header_t * block = (header_t *)(arena + arena_top);
+        arena_top += span(size);
+        arena_blocks++;
+        return block;
+    }
+
+    void add(size_t size) {
+        current += size;
+        if (current > peak) peak = current;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 10
+
+// Upper bounds (ms) of the histogram buckets, the last bucket is open ended
+static const uint16_t latency_bounds[LATENCY_BUCKETS - 1] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+
+// Fixed bucket latency histogram: add() is a short scan and two adds, no
+// allocation. Written by one task, other tasks may read it at any time.
+class LATENCY_HIST {
+public:
+    uint32_t count;
+    uint32_t total_ms;
+    uint32_t max_ms;
+    uint32_t buckets[LATENCY_BUCKETS];
+
+    LATENCY_HIST() {
+        reset();
+    }
+
+    void reset(void) {
+        count = total_ms = max_ms = 0;
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) buckets[i] = 0;
+    }
+
+    void add(uint32_t ms) {
+        uint8_t i = 0;
+        while (i < LATENCY_BUCKETS - 1 && ms > latency_bounds[i]) i++;
+        buckets[i]++;
+        count++;
+        total_ms += ms;
+        if (ms > max_ms) max_ms = ms;
+    }
+
+    uint32_t mean(void) const {
+        return count ? total_ms / count : 0;
+    }
+
+    // Upper bound of the bucket holding the p-th percentile, max_ms for the
+    // open bucket
+    uint32_t percentile(uint8_t p) const {
+        uint32_t rank = ((uint64_t)count * p + 99) / 100;
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+            seen += buckets[i];
+            if (seen >= rank && rank > 0) return latency_bounds[i] < max_ms ? latency_bounds[i] : max_ms;
+        }
+        return max_ms;
+    }
+};
+
+#endif
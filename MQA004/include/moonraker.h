@@ -2,59 +2,315 @@
 #define MOONRAKER_H
 
 #include <Arduino.h>
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include <WebSocketsClient.h>
+#include "json_alloc.h"
+#include "http_conn.h"
+#include "spsc_ring.h"
+#include "seqlock.h"
+#include "gcode_batch.h"
+#include "backoff.h"
+#include "poll_governor.h"
+#include "latency_hist.h"
+#include "body_hash.h"
+#include "resolver.h"
+#include "journal.h"
 #include "crowpanel.h"
 
 #define QUEUE_LEN 20
+#define PRIORITY_QUEUE_LEN 4 // Per priority class, a few presses of the same button
+#define CMD_TEXT_LEN 128  // Longest path or G-code line a queued command can hold
+#define CMD_BATCH_LEN 512 // Longest request path of a coalesced G-code script
+#define POLL_BODY_LEN 1024 // GET replies up to this size are hashed before being parsed, see moonraker_hashable()
+#define POLL_ARENA_LEN (768 * sizeof(void *)) // JSON heap of a status reply or notification, 3 KB on the C3
+#define DONE_QUEUE_LEN 8   // Completions per dispatch task waiting for the LVGL task
+#define CMD_ERROR_LEN 64   // Longest error message a completion carries
+#define JOURNAL_BATCH 8    // Journaled commands read back per replay request
+
+#define WS_PATH "/websocket"
+#define WS_RECONNECT_INTERVAL 5000   // Delay between WebSocket connection attempts
+#define WS_RESUBSCRIBE_INTERVAL 5000 // Retry printer.objects.subscribe while Klippy is not ready
+
+// Retry schedule of each endpoint, see BACKOFF
+#define STATUS_BACKOFF_BASE 200   // Status polls come back quickly after a glitch
+#define STATUS_BACKOFF_MAX 5000
+#define GCODE_BACKOFF_BASE 1000
+#define GCODE_BACKOFF_MAX 30000
+#define PRIORITY_BACKOFF_BASE 100 // Emergency stop and print control are retried almost at once
+#define PRIORITY_BACKOFF_MAX 1000
+
+#define PRIORITY_EXPIRE 10000     // Priority commands not sent by then are dropped
+#define POST_OFFLINE_WAIT 500     // Recheck of queued commands while the printer is offline
+#define POST_OFFLINE_JOURNAL 10000 // Offline this long, queued commands move to the journal; a failed poll or two only holds them
+
+typedef enum {
+    ENDPOINT_STATUS, // Batched objects query
+    ENDPOINT_GCODE,  // Queued POST requests
+    ENDPOINT_PRIORITY, // Print control, see gcode_priority()
+    ENDPOINT_EMERGENCY, // Emergency stop, never waits for print control
+    ENDPOINT_COUNT
+} moonraker_endpoint_t;
+
+typedef enum {
+    REQUEST_OK,       // 2xx, body parsed if one was asked for
+    REQUEST_REJECTED, // Answered with an error retrying will not fix
+    REQUEST_RETRY,    // Failed before reaching the printer, safe to send again
+    REQUEST_FAILED,   // Failed, but a POST may already have run
+    REQUEST_SKIPPED,  // Held back by the endpoint's backoff
+    REQUEST_UNCHANGED, // 2xx with the same body as last time, response left empty
+    REQUEST_DROPPED,  // Queued command never sent: superseded, expired or flushed
+    REQUEST_DEFERRED  // Printer offline, command moved to the journal and sent later
+} moonraker_result_t;
+
+typedef struct {
+    bool pause;
+    bool printing;
+    bool homing;
+    bool probing;
+    bool qgling;
+    bool heating_nozzle;
+    bool heating_bed;
+    int16_t bed_actual;
+    int16_t bed_target;
+    int16_t nozzle_actual;
+    int16_t nozzle_target;
+    uint8_t progress;
+    char file_path[32];
+} moonraker_data_t;
+
+// How a status field is stored into moonraker_data_t
+typedef enum {
+    CONV_INT16,       // Number rounded to int16_t, e.g. temperatures
+    CONV_PERCENT,     // 0..1 to a uint8_t percentage
+    CONV_BOOL,        // bool
+    CONV_BASENAME,    // File name part of a path, into a char array
+    CONV_PRINT_STATE, // print_stats state to the printing and pause flags
+    CONV_READY        // webhooks state to MOONRAKER::unready, offset unused
+} moonraker_conv_t;
+
+// One Klipper status field the panel consumes. The table drives the query,
+// the WebSocket subscription, the JSON filter and apply_status(). Fields of
+// the same object must be adjacent; a NULL object stands for the configured
+// extruder (moonraker_extruder).
+typedef struct {
+    const char * object;
+    const char * field;
+    uint8_t conv;    // moonraker_conv_t
+    uint8_t offset;  // offsetof(moonraker_data_t, ...)
+    uint8_t size;    // sizeof the member, bounds CONV_BASENAME
+} moonraker_field_t;
+
+extern const moonraker_field_t moonraker_schema[];
+extern const uint8_t moonraker_schema_num;
+
+// Index of the first field of the next object in moonraker_schema[]
+uint8_t moonraker_schema_next(uint8_t i);
+
+typedef enum {
+    CMD_PATH,  // Request path sent as is
+    CMD_GCODE  // G-code line, merged with its neighbours into one script
+} moonraker_cmd_type_t;
+
+#define CMD_NO_JOURNAL 0x01 // Dropped rather than kept in the journal while the printer is offline, e.g. a print start
+
+// Outcome of a queued command
+typedef struct {
+    uint32_t handle;  // As returned when the command was queued
+    uint8_t result;   // moonraker_result_t
+    uint32_t latency; // Time from queueing to the reply, ms
+    char message[CMD_ERROR_LEN]; // Moonraker's reason for a rejected command, else empty
+} moonraker_done_t;
+
+// Called on the LVGL task once a command has completed
+typedef void (*moonraker_done_cb_t)(const moonraker_done_t & done, void * user);
+
+// Completion on its way from a dispatch task to the LVGL task
+typedef struct {
+    moonraker_done_t done;
+    moonraker_done_cb_t cb;
+    void * user;
+} moonraker_completion_t;
+
+// Queued POST request, stored in place in a preallocated ring slot
+typedef struct {
+    uint8_t type;
+    uint8_t flags;      // CMD_NO_JOURNAL
+    uint32_t queued_at; // millis() when queued, for dispatch latency and expiry
+    uint32_t handle;
+    moonraker_done_cb_t cb; // NULL if nobody waits for the outcome
+    void * user;
+    char text[CMD_TEXT_LEN];
+} moonraker_cmd_t;
+
+static_assert(CMD_BATCH_LEN < HTTP_PATH_LEN && 3 * CMD_TEXT_LEN < HTTP_PATH_LEN,
+              "a queued request must fit HTTP_CONN once encoded");
+
+// Keep-alive HTTP connection, one per task so a long G-code POST
+// never holds up status polling
+typedef struct {
+    HTTP_CONN http;
+    uint32_t requests;   // Requests sent on this connection
+    uint32_t reused;     // Requests that went out on an already open socket
+    uint32_t reconnects; // Requests that had to open a new socket
+    COUNTING_ALLOCATOR alloc; // Heap of the JSON documents parsed by this task
+    uint32_t rx_bytes;        // Response bytes parsed
+    uint32_t parse_peak;      // Peak JSON heap of the last response
+    uint32_t parse_peak_max;  // Worst parse_peak seen
+    uint32_t unhashed;        // Replies that could not be hashed, parsed even when unchanged
+    char error[CMD_ERROR_LEN]; // Message of the last request's 400 reply, else empty
+} moonraker_conn_t;
+
+// Request telemetry of one endpoint, written only by the task sending on it
+typedef struct {
+    LATENCY_HIST latency;  // Time from sending to having read the body
+    uint32_t ok;           // Results, see moonraker_result_t
+    uint32_t rejected;
+    uint32_t retry;
+    uint32_t failed;
+    uint32_t timeouts;     // No reply within the timeout
+    uint32_t conn_errors;  // Other transport errors: refused, reset, ...
+    uint32_t http_errors;  // Non-2xx replies
+    uint32_t stale;        // Kept-alive sockets found closed and reopened
+    uint32_t unchanged;    // Replies identical to the previous one, not parsed
+    uint32_t dns_hits;     // Requests sent to the cached address
+    uint32_t dns_misses;   // Requests held back, the host name is not resolved yet
+    uint32_t tx_bytes;     // Request bytes sent, headers included
+    uint32_t rx_bytes;     // Body bytes received
+} moonraker_stats_t;
 
 class MOONRAKER {
 public:
-    struct {
-        bool pause;
-        bool printing;
-        bool homing;
-        bool probing;
-        bool qgling;
-        bool heating_nozzle;
-        bool heating_bed;
-        int16_t bed_actual;
-        int16_t bed_target;
-        int16_t nozzle_actual;
-        int16_t nozzle_target;
-        uint8_t progress;
-        char file_path[32];
-    } data;
-
-    struct {
-        String queue[QUEUE_LEN];
-        uint8_t count;
-        uint8_t index_r;
-        uint8_t index_w;
-    } post_queue;
+    // Working copy, only touched by moonraker_task
+    moonraker_data_t data;
+    // Copy of data published for other tasks, read it with snapshot.read()
+    SEQLOCK<moonraker_data_t> snapshot;
+    // Paces HTTP status polls while the WebSocket subscription is down
+    POLL_GOVERNOR<moonraker_data_t> governor;
+
+    // Filled by the LVGL task, drained by moonraker_post_task
+    SPSC_RING<moonraker_cmd_t, QUEUE_LEN> post_queue;
+    // Dispatch tasks, notified when their queue gets a command and otherwise
+    // asleep. NULL until moonraker_task has created them.
+    std::atomic<TaskHandle_t> post_task;
+    std::atomic<TaskHandle_t> prio_task;
+    std::atomic<TaskHandle_t> estop_task;
+    char batch_path[CMD_BATCH_LEN]; // Script request being sent by moonraker_post_task
+    uint32_t gcode_requests;  // Script requests sent
+    uint32_t gcode_commands;  // G-code lines sent in them
+    uint32_t gcode_dropped;   // Duplicate or superseded lines never sent
+
+    // Filled by the LVGL task, drained ahead of post_queue: one ring per
+    // class above GCODE_BULK, each by its own moonraker_priority_task
+    SPSC_RING<moonraker_cmd_t, PRIORITY_QUEUE_LEN> prio_queue[GCODE_BULK];
+    std::atomic<bool> bulk_flush;     // Emergency stop sent, drop post_queue
+    LATENCY_HIST dispatch[GCODE_BULK + 1]; // Queue to send time per gcode_class_t
+    uint32_t prio_expired;            // Priority commands older than PRIORITY_EXPIRE
+
+    // Outcomes of commands queued with a callback, one ring per dispatch
+    // task, handed to the callbacks on the LVGL task by run_completions()
+    SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> done_post;
+    SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> done_prio;
+    SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> done_estop;
+    uint32_t last_handle; // Written by the LVGL task only
+
+    // Bulk commands queued while the printer is offline, replayed once it
+    // is ready again. Only used by moonraker_post_task.
+    JOURNAL journal;
+    journal_entry_t replay[JOURNAL_BATCH];
+    unsigned long offline_since; // millis() the post task first found the printer offline, 0 while online
+
+    moonraker_conn_t conn_poll; // GET traffic from moonraker_task
+    moonraker_conn_t conn_cmd;  // POST traffic from moonraker_post_task
+    moonraker_conn_t conn_prio; // Print control from its moonraker_priority_task
+    moonraker_conn_t conn_estop; // Emergency stops from theirs, never behind a running macro
+    BACKOFF backoff[ENDPOINT_COUNT] = {
+        BACKOFF(STATUS_BACKOFF_BASE, STATUS_BACKOFF_MAX),
+        BACKOFF(GCODE_BACKOFF_BASE, GCODE_BACKOFF_MAX),
+        BACKOFF(PRIORITY_BACKOFF_BASE, PRIORITY_BACKOFF_MAX, false), // No breaker, its cooldown outlasts PRIORITY_EXPIRE
+        BACKOFF(PRIORITY_BACKOFF_BASE, PRIORITY_BACKOFF_MAX, false),
+    };
+    moonraker_stats_t stats[ENDPOINT_COUNT];
+    uint32_t body_hash[ENDPOINT_COUNT]; // BODY_HASH of the last parsed reply, BODY_HASH_NONE to force a parse
+    char poll_body[POLL_BODY_LEN];      // GET reply being hashed, only used by moonraker_task
+    alignas(max_align_t) uint8_t poll_arena[POLL_ARENA_LEN]; // conn_poll.alloc's arena, keeps polling off the heap
 
     // Moonraker configuration
     char moonraker_ip[64];
     char moonraker_port[8];
     char moonraker_tool[8];
+    char moonraker_extruder[16]; // Klipper object for moonraker_tool, "tool0" -> "extruder"
+    char status_query[320];      // Batched objects query built from moonraker_schema[]
+    JsonDocument status_filter;  // Keeps only moonraker_schema[] fields of query results and notifications
 
     bool unconnected;
-    bool unready;
-    bool data_unlock;
+    std::atomic<bool> unready; // Written by moonraker_task, read by every task
+
+    // WebSocket JSON-RPC connection, pushes status deltas instead of polling
+    WebSocketsClient ws;
+    uint32_t ws_addr; // Address ws.begin() was given, 0 until the host name is resolved
+    bool ws_connected;
+    bool ws_subscribed;
+    uint32_t ws_rpc_id;
+    uint32_t ws_subscribe_id;
+    uint32_t ws_updates;
+    unsigned long ws_last_subscribe;
+    unsigned long ws_last_update;
 
-    String send_request(const char * type, String path);
+    moonraker_result_t send_request(uint8_t endpoint, const char * type, const char * path,
+                                    JsonDocument * response = NULL, const JsonDocument * filter = NULL);
+    void backoff_reset(void);
+    void stats_json(Print & out);
+    void stats_reset(void);
+    moonraker_result_t read_json(moonraker_conn_t & conn, JsonDocument & doc, const JsonDocument * filter,
+                                 uint32_t * hash = NULL);
+    void skip_body(moonraker_conn_t & conn);
     void http_post_loop(void);
-    bool post_to_queue(String path);
-    bool post_gcode_to_queue(String gcode);
-    void get_printer_ready(void);
-    void get_printer_info(void);
-    void get_progress(void);
-    void get_crowpanel_status(void);
+    uint8_t build_script(const char * const * lines, uint8_t count, bool * keep, uint8_t * sent);
+    void journal_queue(void);
+    void journal_replay(void);
+    void http_priority_loop(uint8_t prio);
+    TickType_t post_wait(uint8_t endpoint, bool idle);
+    uint32_t queue_command(uint8_t type, const char * text, moonraker_done_cb_t cb, void * user, uint8_t flags = 0);
+    uint32_t post_to_queue(const char * path, moonraker_done_cb_t cb = NULL, void * user = NULL, uint8_t flags = 0);
+    uint32_t post_gcode_to_queue(const char * gcode, moonraker_done_cb_t cb = NULL, void * user = NULL);
+    uint32_t post_gcode_to_queue(const char * const * lines, uint8_t count, moonraker_done_cb_t cb = NULL,
+                                 void * user = NULL);
+    void complete(SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> & ring, const moonraker_cmd_t & cmd,
+                  uint8_t result, const char * message);
+    void run_completions(void);
+    void build_status_query(void);
+    void build_status_filter(void);
+    moonraker_result_t get_status(void);
     void http_get_loop(void);
+    void publish(void);
+    void apply_status(JsonVariantConst status);
+    void apply_status(JsonVariantConst status, moonraker_data_t & out, bool & out_unready) const;
+    void apply_field(const moonraker_field_t & field, JsonVariantConst value,
+                     moonraker_data_t & out, bool & out_unready) const;
+    const char * schema_object(uint8_t i) const;
+
+    void ws_begin(void);
+    void ws_loop(void);
+    void ws_subscribe(void);
+    void ws_event(WStype_t type, uint8_t * payload, size_t length);
+    void ws_text(uint8_t * payload, size_t length);
 };
 
 extern MOONRAKER moonraker;
 
+const char * path_only_gcode(const char * path);
+moonraker_result_t moonraker_read_json(HTTP_CONN & http, JsonDocument & doc, const JsonDocument * filter,
+                                       char * buf, size_t len, uint32_t * hash);
+
+// Whether moonraker_read_json() can hash the reply in a buffer of len
+// bytes. A body is only hashed whole before being parsed, so a chunked
+// one, of unknown length, or one longer than len is always parsed. The
+// filtered status query answers a few hundred bytes, far below
+// POLL_BODY_LEN; the unhashed counters show when a printer does not.
+static inline bool moonraker_hashable(const HTTP_CONN & http, size_t len) {
+    return http.size > 0 && (size_t)http.size <= len;
+}
+
 void moonraker_setup(void);
 void moonraker_task(void *parameter);
 
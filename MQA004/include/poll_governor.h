@@ -0,0 +1,110 @@
+#ifndef POLL_GOVERNOR_H
+#define POLL_GOVERNOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+// Default poll periods, see poll_rates_t
+#define POLL_FAST_MS 250            // Temperatures moving, homing, probing, QGL
+#define POLL_ACTIVE_MS 1000         // Printing with settled temperatures
+#define POLL_IDLE_MS 5000           // Nothing going on
+#define POLL_SLEEP_MS 60000         // Idle for longer than POLL_SLEEP_AFTER
+#define POLL_SLEEP_AFTER 600000     // 10 minutes
+#define POLL_UNREADY_MS 2000        // Klippy not ready, waiting for it
+#define POLL_TEMP_BAND 2            // °C from target that counts as settled
+#define POLL_RATE_WINDOW 60000      // Window of the achieved request rate
+
+typedef struct {
+    uint32_t fast_ms;
+    uint32_t active_ms;
+    uint32_t idle_ms;
+    uint32_t sleep_ms;
+    uint32_t sleep_after_ms;
+    uint32_t unready_ms;
+} poll_rates_t;
+
+// Picks the status poll period from what the printer is doing: fast while
+// temperatures move or a motion macro runs, slower while printing, and
+// backing off to sleep_ms after a long idle stretch. T is the printer data
+// struct (moonraker_data_t).
+template <typename T>
+class POLL_GOVERNOR {
+public:
+    poll_rates_t rates;
+    uint32_t interval;      // Current poll period
+    uint32_t requests;      // Polls made
+    uint32_t rate;          // Polls in the last complete POLL_RATE_WINDOW
+    std::atomic<bool> kick; // Set by other tasks to poll fast right away, e.g. after a command
+
+    POLL_GOVERNOR()
+        : interval(POLL_FAST_MS), requests(0), rate(0), kick(false),
+          last_poll(0), last_busy(0), window_start(0), window_count(0),
+          last_nozzle(0), last_bed(0) {
+        rates.fast_ms = POLL_FAST_MS;
+        rates.active_ms = POLL_ACTIVE_MS;
+        rates.idle_ms = POLL_IDLE_MS;
+        rates.sleep_ms = POLL_SLEEP_MS;
+        rates.sleep_after_ms = POLL_SLEEP_AFTER;
+        rates.unready_ms = POLL_UNREADY_MS;
+    }
+
+    bool due(unsigned long now) {
+        if (kick.load(std::memory_order_acquire)) {
+            kick.store(false, std::memory_order_relaxed); // A kick meanwhile is served by this poll
+            last_busy = now;
+            interval = rates.fast_ms;
+            return true;
+        }
+        return now - last_poll >= interval;
+    }
+
+    // Time until due() turns true, unless kicked first
+    unsigned long wait(unsigned long now) const {
+        return now - last_poll >= interval ? 0 : interval - (now - last_poll);
+    }
+
+    // Account for a poll and choose the period until the next one
+    void polled(const T & data, bool unready, unsigned long now) {
+        last_poll = now;
+        requests++;
+        window_count++;
+        if (now - window_start >= POLL_RATE_WINDOW) {
+            rate = window_count;
+            window_count = 0;
+            window_start = now;
+        }
+
+        bool moving = abs(data.nozzle_actual - last_nozzle) >= 1 ||
+                      abs(data.bed_actual - last_bed) >= 1 ||
+                      (data.nozzle_target > 0 && abs(data.nozzle_actual - data.nozzle_target) > POLL_TEMP_BAND) ||
+                      (data.bed_target > 0 && abs(data.bed_actual - data.bed_target) > POLL_TEMP_BAND);
+        bool busy = data.homing || data.probing || data.qgling || data.heating_nozzle || data.heating_bed;
+        last_nozzle = data.nozzle_actual;
+        last_bed = data.bed_actual;
+
+        if (unready) {
+            interval = rates.unready_ms;
+        } else if (moving || busy) {
+            interval = rates.fast_ms;
+            last_busy = now;
+        } else if (data.printing) {
+            interval = rates.active_ms;
+            last_busy = now;
+        } else if (now - last_busy >= rates.sleep_after_ms) {
+            interval = rates.sleep_ms;
+        } else {
+            interval = rates.idle_ms;
+        }
+    }
+
+private:
+    unsigned long last_poll;
+    unsigned long last_busy;
+    unsigned long window_start;
+    uint32_t window_count;
+    int16_t last_nozzle;
+    int16_t last_bed;
+};
+
+#endif
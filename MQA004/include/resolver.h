@@ -0,0 +1,68 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+#include "latency_hist.h"
+
+#define RESOLVE_TTL 300000   // A resolved address is looked up again after this long
+#define RESOLVE_RETRY 10000  // Delay after a failed lookup, and between forced refreshes
+#define RESOLVE_TIMEOUT 1000 // Longest mDNS query, answers on the LAN take a few ms
+#define RESOLVE_NAME_LEN 65  // As crowpanel_config.moonraker_ip
+
+// Address cache of the Moonraker host, which may be "<hostname>.local".
+// Lookups only run in loop() on a task that may block (wifi_task); the
+// request tasks read the cached address and never wait for DNS or mDNS.
+// Neither lookup API reports a TTL, so an address is kept RESOLVE_TTL.
+// A failed refresh keeps the old address. Until the first lookup succeeds
+// there is no address and requests are held back: passing the name to
+// WiFiClient::connect() would block the request task on the lookup. Every
+// RESOLVER, the farm's ones included, is looked up on the same task, one
+// lookup per pass so the task never blocks for more than one of them.
+class RESOLVER {
+public:
+    // Written by the resolving task only
+    uint32_t lookups;
+    uint32_t failures;
+    LATENCY_HIST time;         // Duration of the lookups
+    unsigned long resolved_at; // millis() of the last successful lookup
+
+    RESOLVER();
+
+    // Before the tasks start. An IP address literal is never looked up.
+    void begin(const char * host);
+
+    // Request tasks: the cached address as a dotted quad into buf. Returns
+    // false, with buf empty, while the name is not resolved yet.
+    bool host(char * buf, size_t len) const;
+    uint32_t address(void) const {
+        return addr.load(std::memory_order_acquire);
+    }
+
+    // Any task: the address failed, look it up again soon, e.g. after the
+    // printer got a new DHCP lease
+    void refresh(void) {
+        stale.store(true, std::memory_order_release);
+    }
+
+    // Resolving task: look the name up when due, blocks up to RESOLVE_TIMEOUT.
+    // Returns whether it did.
+    bool loop(void);
+
+private:
+    static bool mdns_started; // MDNS.begin() only works once, whichever RESOLVER calls it
+
+    char name[RESOLVE_NAME_LEN];
+    bool literal;
+    std::atomic<uint32_t> addr; // Network byte order, 0 until resolved
+    std::atomic<bool> stale;
+    unsigned long next_lookup;
+    unsigned long last_lookup;
+
+    bool lookup(uint32_t * result);
+};
+
+extern RESOLVER resolver;
+
+#endif
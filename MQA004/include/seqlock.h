@@ -0,0 +1,63 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#define SEQLOCK_READ_TRIES 4 // Attempts before read() gives up on a busy writer
+
+// Single-writer sequence lock around a plain struct. The sequence is odd
+// while a write is in progress and only moves when the value changes, so
+// it doubles as a version number readers can use to skip redundant work.
+//
+// Neither side ever blocks: the writer just copies, and a reader that keeps
+// racing the writer gives up after SEQLOCK_READ_TRIES instead of spinning,
+// which could starve a lower priority writer on the single core C3.
+template <typename T>
+class SEQLOCK {
+public:
+    SEQLOCK() : seq(0) {
+        memset(&value, 0, sizeof(value));
+    }
+
+    // Writer: publish v if it differs from the current value.
+    // Returns true when a new version was published.
+    bool write(const T & v) {
+        // Only the writer modifies value, so it can compare without the lock
+        if (memcmp(&value, &v, sizeof(T)) == 0) return false;
+
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&value, &v, sizeof(T));
+        seq.store(s + 2, std::memory_order_release);
+        return true;
+    }
+
+    // Reader: consistent copy of the value into out, and its version.
+    // Returns false if the writer kept the value busy, out is then undefined.
+    bool read(T * out, uint32_t * version) const {
+        for (uint8_t i = 0; i < SEQLOCK_READ_TRIES; i++) {
+            uint32_t s1 = seq.load(std::memory_order_acquire);
+            if (s1 & 1) continue;
+            memcpy(out, &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s1) {
+                if (version != NULL) *version = s1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t version(void) const {
+        return seq.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> seq;
+    T value;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <atomic>
+
+#define SERIES_PATH "/series%02u"      // Segment file of a slot
+#define SERIES_SLOTS 64                // Segments kept, the oldest slot is overwritten
+#define SERIES_SEGMENT_BYTES 16384     // A segment is closed past this, 1 MB in all of the 1.9 MB partition
+#define SERIES_BUFFER_LEN 512          // Encoded samples held in RAM between flash writes
+#define SERIES_FLUSH_INTERVAL 300000   // Longest a sample waits in RAM, ms
+#define SERIES_INTERVAL 10000          // ms between samples while the state stays the same
+#define SERIES_MAGIC 0x5453
+#define SERIES_VERSION 1
+#define SERIES_SAMPLE_MAX (1 + 5 + SERIES_CHANNELS * 3) // Longest encoded sample
+
+typedef enum {
+    SERIES_NOZZLE,
+    SERIES_NOZZLE_TARGET,
+    SERIES_BED,
+    SERIES_BED_TARGET,
+    SERIES_PROGRESS,
+    SERIES_STATE, // SERIES_STATE_* bits
+    SERIES_CHANNELS
+} series_channel_t;
+
+#define SERIES_STATE_PRINTING 0x01
+#define SERIES_STATE_PAUSE 0x02
+#define SERIES_STATE_HOMING 0x04
+#define SERIES_STATE_PROBING 0x08
+#define SERIES_STATE_QGL 0x10
+#define SERIES_STATE_HEATING_NOZZLE 0x20
+#define SERIES_STATE_HEATING_BED 0x40
+#define SERIES_STATE_UNREADY 0x80 // Moonraker down or Klippy not ready, the other channels are 0
+
+typedef struct {
+    uint32_t time; // time(), seconds
+    int16_t value[SERIES_CHANNELS];
+} series_sample_t;
+
+// Start of every segment file, followed by the encoded samples
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t channels;
+    uint32_t seq;   // Segment number, its slot is seq % SERIES_SLOTS
+    uint32_t start; // time() the first sample's delta is taken from
+} series_header_t;
+
+// Encoder or decoder state, reset at the start of each segment
+typedef struct {
+    uint32_t time;
+    int32_t delta; // Previous time delta
+    int16_t value[SERIES_CHANNELS];
+} series_codec_t;
+
+void series_codec_reset(series_codec_t * codec, uint32_t start);
+
+// A sample is the zigzag varint of its time's delta of delta, a byte with
+// a bit per channel that changed, then the zigzag varint deltas of those
+// channels. A regular sample of a steady printer is two bytes. Returns
+// the length, at most SERIES_SAMPLE_MAX.
+size_t series_encode(series_codec_t * codec, const series_sample_t & sample, uint8_t * out);
+
+// Decode one sample from buf[0..len), returns the bytes used, 0 if the
+// sample is cut short
+size_t series_decode(series_codec_t * codec, const uint8_t * buf, size_t len, series_sample_t * sample);
+
+// Append-only printer telemetry in LittleFS on the storage partition,
+// next to the journal. Samples are taken every SERIES_INTERVAL and on
+// every state change, delta encoded into a RAM buffer, and written to
+// flash a buffer at a time. A segment holds one boot's samples up to
+// SERIES_SEGMENT_BYTES, then the next slot is truncated for the next
+// segment; LittleFS spreads the writes over the partition. A reset loses
+// at most the buffer, and a torn last sample ends its segment.
+// Written by wifi_task only, queried with SERIES_QUERY from any task.
+class SERIES {
+public:
+    // Written by wifi_task
+    uint32_t samples;     // Samples appended
+    uint32_t flushes;     // Flash writes
+    uint32_t flash_bytes; // Bytes written to flash, segment headers included
+    uint32_t failed;      // Flash writes that failed, their samples are lost
+    uint32_t flush_us;    // Total and worst time of a flash write
+    uint32_t flush_us_max;
+
+    SERIES();
+
+    // After the journal has mounted the file system, finds the segments of
+    // earlier boots. This boot's samples go to a new segment.
+    bool begin(void);
+
+    // wifi_task: sample moonraker's printer when due, write to flash when
+    // the buffer is full or old. Needs the wall clock.
+    void loop(void);
+
+    // Encode a sample, samples must come in time order
+    bool append(const series_sample_t & sample);
+    bool flush(void);
+
+    // Oldest and newest segment on flash, newest < oldest if none
+    uint32_t oldest(void) const {
+        return oldest_seq.load(std::memory_order_acquire);
+    }
+    uint32_t newest(void) const {
+        return newest_seq.load(std::memory_order_acquire);
+    }
+
+    // Bytes waiting in RAM, not visible to queries yet
+    size_t buffered(void) const {
+        return used;
+    }
+
+    void stats_json(Print & out);
+
+private:
+    bool mounted;
+    std::atomic<uint32_t> oldest_seq;
+    std::atomic<uint32_t> newest_seq;
+    uint32_t seq;           // Segment being written
+    uint32_t segment_bytes; // Its size on flash, 0 until its first write
+    uint32_t segment_start; // time() of its first sample
+    bool started;           // codec holds the segment's state
+    series_codec_t codec;
+    uint8_t buffer[SERIES_BUFFER_LEN];
+    size_t used;
+    unsigned long first_buffered; // millis() of the oldest sample in buffer
+    unsigned long last_sample;    // millis()
+    int16_t last_state;
+};
+
+extern SERIES series;
+
+// Samples with from <= time <= to in time order, read from flash through a
+// small buffer, one segment file open at a time. Samples still in the
+// writer's RAM buffer are not seen.
+class SERIES_QUERY {
+public:
+    uint32_t bytes;    // Read from flash
+    uint32_t segments; // Segment files opened
+
+    SERIES_QUERY(const SERIES & series, uint32_t from, uint32_t to);
+
+    bool next(series_sample_t * sample);
+
+private:
+    const SERIES & series;
+    uint32_t from;
+    uint32_t to;
+    uint32_t seq;  // Segment open or to open next
+    uint32_t last; // Newest segment when the query started
+    File file;
+    series_codec_t codec;
+    uint8_t buf[64];
+    size_t pos;
+    size_t len;
+
+    bool open(uint32_t seq, series_header_t * header);
+    bool open_next(void);
+};
+
+#endif
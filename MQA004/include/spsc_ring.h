@@ -0,0 +1,98 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring of N preallocated slots for exactly one producer task and
+// one consumer task. head and tail are free-running counters, each written
+// by one side only, so plain acquire/release loads and stores suffice.
+//
+// The ESP32-C3 (RV32IMC) has no atomic instructions. Aligned loads and
+// stores of up to 32 bits, with fences for acquire/release, are lock-free
+// there. Read-modify-writes (exchange, fetch_add, compare_exchange) are
+// libatomic calls that mask interrupts, correct on the single core but not
+// lock-free. Cross-task state in this project therefore only uses loads and
+// stores: a flag is cleared with load() then store(), and the owner of a
+// flag handles a set racing the clear in the same pass.
+//
+// A full ring rejects new items: push()/reserve() fail and overflows counts
+// the dropped item, nothing already queued is ever overwritten.
+template <typename T, uint16_t N>
+class SPSC_RING {
+public:
+    // Producer side statistics
+    uint32_t pushed;
+    uint32_t overflows;
+    uint16_t high_water; // Most items ever queued at once
+    // Consumer side statistics
+    uint32_t popped;
+
+    SPSC_RING() : pushed(0), overflows(0), high_water(0), popped(0), head(0), tail(0) {}
+
+    // Producer: slot to fill in place, NULL when full. Invisible to the
+    // consumer until commit(). ahead > 0 reserves behind as many slots
+    // that are not committed yet, so several items can be published at once.
+    T * reserve(uint16_t ahead = 0) {
+        uint32_t h = head.load(std::memory_order_relaxed) + ahead;
+        if (h - tail.load(std::memory_order_acquire) >= N) {
+            overflows++;
+            return NULL;
+        }
+        return &slots[h % N];
+    }
+
+    // Producer: publish the n oldest slots returned by reserve(), the
+    // consumer sees all of them or none
+    void commit(uint16_t n = 1) {
+        uint32_t h = head.load(std::memory_order_relaxed) + n;
+        head.store(h, std::memory_order_release);
+        pushed += n;
+        uint16_t queued = h - tail.load(std::memory_order_acquire);
+        if (queued > high_water) high_water = queued;
+    }
+
+    bool push(const T & item) {
+        T * slot = reserve();
+        if (slot == NULL) return false;
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    // Consumer: oldest item, NULL when empty. Stays valid until pop().
+    T * front(void) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return NULL;
+        return &slots[t % N];
+    }
+
+    // Consumer: i-th oldest item, NULL past the newest. front() == peek(0).
+    T * peek(uint16_t i) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) - t <= i) return NULL;
+        return &slots[(t + i) % N];
+    }
+
+    // Consumer: release the item returned by front()
+    void pop(void) {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        popped++;
+    }
+
+    // Safe from either side, exact only from the consumer
+    uint16_t count(void) const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty(void) const {
+        return count() == 0;
+    }
+
+private:
+    T slots[N];
+    std::atomic<uint32_t> head; // Next slot to fill, written by the producer
+    std::atomic<uint32_t> tail; // Next slot to read, written by the consumer
+};
+
+#endif
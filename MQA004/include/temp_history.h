@@ -0,0 +1,122 @@
+#ifndef TEMP_HISTORY_H
+#define TEMP_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TEMP_HISTORY_LEN 1440       // Samples kept, 2 h at TEMP_HISTORY_INTERVAL
+#define TEMP_HISTORY_INTERVAL 5000  // ms between samples
+#define TEMP_CHART_POINTS 240       // One chart point per pixel column of the display
+
+typedef enum {
+    HEATER_NOZZLE,
+    HEATER_BED,
+    HEATER_COUNT
+} heater_t;
+
+// Both heaters share the timestamp
+typedef struct {
+    uint32_t time; // millis()
+    int16_t temp[HEATER_COUNT];
+} temp_sample_t;
+
+// Fixed ring of the last N temperature samples, the oldest is overwritten.
+// Used by one task only, the LVGL one on the device.
+template <uint16_t N>
+class TEMP_HISTORY {
+public:
+    uint32_t added; // Samples ever added, also tells a chart it is stale
+
+    TEMP_HISTORY() : added(0), head(0), count(0) {}
+
+    void add(uint32_t time, int16_t nozzle, int16_t bed) {
+        temp_sample_t & s = samples[head];
+        s.time = time;
+        s.temp[HEATER_NOZZLE] = nozzle;
+        s.temp[HEATER_BED] = bed;
+        head = (head + 1) % N;
+        if (count < N) count++;
+        added++;
+    }
+
+    uint16_t size(void) const {
+        return count;
+    }
+
+    // i-th sample, 0 the oldest
+    const temp_sample_t & at(uint16_t i) const {
+        return samples[(head + N - count + i) % N];
+    }
+
+    // ms between the oldest and the newest sample
+    uint32_t span(void) const {
+        return count ? at(count - 1).time - at(0).time : 0;
+    }
+
+    // RAM per hour of history at interval ms between samples
+    static size_t bytes_per_hour(uint32_t interval) {
+        return sizeof(temp_sample_t) * 3600000UL / interval;
+    }
+
+    // Largest-Triangle-Three-Buckets: indices (0 the oldest) of at most
+    // points samples that keep the shape of heater's curve, the first and
+    // last one included. Each bucket keeps the sample spanning the largest
+    // triangle with the one kept before and the next bucket's average. One
+    // pass whatever the size, integer only as the C3 has no FPU.
+    uint16_t downsample(uint8_t heater, uint16_t * out, uint16_t points) const {
+        uint16_t n = count;
+        if (n <= points || points < 3) {
+            uint16_t kept = n < points ? n : points;
+            for (uint16_t i = 0; i < kept; i++) out[i] = i;
+            return kept;
+        }
+
+        uint32_t buckets = points - 2;
+        uint16_t a = 0;
+        uint16_t kept = 0;
+        out[kept++] = 0;
+        for (uint32_t j = 0; j < buckets; j++) {
+            uint16_t start = 1 + j * (n - 2) / buckets;
+            uint16_t end = 1 + (j + 1) * (n - 2) / buckets;
+            // The bucket after this one, the last sample after the last bucket
+            uint16_t next_end = j + 1 < buckets ? 1 + (j + 2) * (n - 2) / buckets : n;
+
+            // Its average as sums over k samples, scaled rather than divided
+            int64_t k = next_end - end;
+            int64_t sx = 0, sy = 0;
+            for (uint16_t i = end; i < next_end; i++) {
+                sx += x(i);
+                sy += at(i).temp[heater];
+            }
+
+            int64_t ax = x(a), ay = at(a).temp[heater];
+            int64_t best_area = -1;
+            uint16_t best = start;
+            for (uint16_t i = start; i < end; i++) {
+                // Twice the triangle's area, times k
+                int64_t area = (ax * k - sx) * (at(i).temp[heater] - ay) - (ax - x(i)) * (sy - ay * k);
+                if (area < 0) area = -area;
+                if (area > best_area) {
+                    best_area = area;
+                    best = i;
+                }
+            }
+            out[kept++] = best;
+            a = best;
+        }
+        out[kept++] = n - 1;
+        return kept;
+    }
+
+private:
+    temp_sample_t samples[N];
+    uint16_t head;  // Slot of the next sample
+    uint16_t count; // Samples held, up to N
+
+    // Time of sample i since the oldest, safe across the millis() wrap
+    int64_t x(uint16_t i) const {
+        return (uint32_t)(at(i).time - at(0).time);
+    }
+};
+
+#endif
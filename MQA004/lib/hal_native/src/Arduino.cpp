@@ -0,0 +1,139 @@
+#include <stdarg.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+static std::minstd_rand rng;
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char * dst, const char * src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = 0;
+    }
+    return len;
+}
+#endif
+
+unsigned long millis(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+unsigned long micros(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield(void) {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    return max > 0 ? (long)(rng() % (unsigned long)max) : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    rng.seed(seed);
+}
+
+size_t Print::printf(const char * format, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t *)buf, (size_t)len < sizeof(buf) ? len : sizeof(buf) - 1);
+}
+
+int HardwareSerial::available(void) {
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0 ? 1 : 0;
+}
+
+int HardwareSerial::read(void) {
+    if (!available()) return -1;
+    unsigned char c;
+    return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int HardwareSerial::peek(void) {
+    return -1;
+}
+
+struct native_task {
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notify = 0; // Notification value, used as a counting semaphore
+};
+
+// Task of the calling thread, created on first use for threads that were
+// not started by xTaskCreate(), e.g. main()
+static thread_local native_task * current_task = NULL;
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char * name, uint32_t stack, void * parameter,
+                       UBaseType_t priority, TaskHandle_t * handle) {
+    (void)name;
+    (void)stack;
+    (void)priority;
+    native_task * t = new native_task();
+    if (handle != NULL) *handle = t;
+    std::thread([task, parameter, t]() {
+        current_task = t;
+        task(parameter);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char * name, uint32_t stack, void * parameter,
+                                   UBaseType_t priority, TaskHandle_t * handle, BaseType_t core) {
+    (void)core;
+    return xTaskCreate(task, name, stack, parameter, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) current_task = new native_task();
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notify++;
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    native_task * t = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(t->lock);
+    auto pending = [t]() { return t->notify > 0; };
+    if (ticks == portMAX_DELAY) {
+        t->cv.wait(guard, pending);
+    } else {
+        t->cv.wait_for(guard, std::chrono::milliseconds(ticks), pending);
+    }
+    uint32_t value = t->notify;
+    if (value > 0) t->notify = clear ? 0 : value - 1;
+    return value;
+}
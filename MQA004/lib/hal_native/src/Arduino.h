@@ -0,0 +1,210 @@
+#ifndef HAL_NATIVE_ARDUINO_H
+#define HAL_NATIVE_ARDUINO_H
+
+// Host build stand-in for the parts of the Arduino-ESP32 core the Moonraker
+// client uses: String, Stream, timing and the FreeRTOS task calls.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char * dst, const char * src, size_t size);
+#endif
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void yield(void);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// The host clock is already set, SNTP is left to the host
+inline void configTime(long gmtOffset, int daylightOffset, const char * server1,
+                       const char * server2 = NULL, const char * server3 = NULL) {
+    (void)gmtOffset;
+    (void)daylightOffset;
+    (void)server1;
+    (void)server2;
+    (void)server3;
+}
+
+class String {
+public:
+    String() {}
+    String(const char * s) : str(s ? s : "") {}
+    String(const char * s, size_t len) : str(s, len) {}
+    explicit String(char c) : str(1, c) {}
+    explicit String(int value) : str(std::to_string(value)) {}
+    explicit String(unsigned int value) : str(std::to_string(value)) {}
+    explicit String(long value) : str(std::to_string(value)) {}
+    explicit String(unsigned long value) : str(std::to_string(value)) {}
+
+    String & operator=(const char * s) { str = s ? s : ""; return *this; }
+    String & operator+=(const String & s) { str += s.str; return *this; }
+    String & operator+=(const char * s) { if (s) str += s; return *this; }
+    String & operator+=(char c) { str += c; return *this; }
+
+    bool concat(const char * s) { if (s) str += s; return true; }
+    bool concat(const char * s, size_t len) { str.append(s, len); return true; }
+    bool concat(char c) { str += c; return true; }
+    bool concat(const String & s) { str += s.str; return true; }
+    bool reserve(unsigned int size) { str.reserve(size); return true; }
+
+    unsigned int length(void) const { return str.length(); }
+    bool isEmpty(void) const { return str.empty(); }
+    const char * c_str(void) const { return str.c_str(); }
+    char charAt(unsigned int i) const { return i < str.length() ? str[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    bool equals(const String & s) const { return str == s.str; }
+    bool equals(const char * s) const { return str == (s ? s : ""); }
+    bool equalsIgnoreCase(const String & s) const { return strcasecmp(str.c_str(), s.str.c_str()) == 0; }
+    bool operator==(const String & s) const { return equals(s); }
+    bool operator==(const char * s) const { return equals(s); }
+    bool operator!=(const String & s) const { return !equals(s); }
+    bool operator!=(const char * s) const { return !equals(s); }
+    bool startsWith(const char * s) const { return str.compare(0, strlen(s), s) == 0; }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t i = str.find(c, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    int indexOf(const char * s, unsigned int from = 0) const {
+        size_t i = str.find(s, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned int begin) const { return begin < str.length() ? String(str.c_str() + begin) : String(); }
+    String substring(unsigned int begin, unsigned int end) const {
+        if (end > str.length()) end = str.length();
+        return begin < end ? String(str.c_str() + begin, end - begin) : String();
+    }
+
+    void replace(const char * find, const char * replace) {
+        size_t find_len = strlen(find);
+        size_t replace_len = strlen(replace);
+        if (find_len == 0) return;
+        for (size_t i = str.find(find); i != std::string::npos; i = str.find(find, i + replace_len)) {
+            str.replace(i, find_len, replace);
+        }
+    }
+    void replace(const String & find, const String & replace) { this->replace(find.c_str(), replace.c_str()); }
+    void remove(unsigned int index) { if (index < str.length()) str.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < str.length()) str.erase(index, count); }
+    void trim(void) {
+        size_t begin = str.find_first_not_of(" \t\r\n");
+        size_t end = str.find_last_not_of(" \t\r\n");
+        str = begin == std::string::npos ? "" : str.substr(begin, end - begin + 1);
+    }
+    void toLowerCase(void) { for (char & c : str) c = tolower((unsigned char)c); }
+    long toInt(void) const { return atol(str.c_str()); }
+
+    friend String operator+(const String & a, const String & b) { String r(a); r += b; return r; }
+    friend String operator+(const String & a, const char * b) { String r(a); r += b; return r; }
+    friend String operator+(const char * a, const String & b) { String r(a); r += b; return r; }
+
+private:
+    std::string str;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t * buf, size_t len) {
+        size_t n = 0;
+        while (len-- && write(*buf++)) n++;
+        return n;
+    }
+    size_t write(const char * s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(const char * s) { return write(s); }
+    size_t print(const String & s) { return write(s.c_str()); }
+    size_t println(const char * s = "") { return print(s) + write("\r\n"); }
+    size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    Stream() : _timeout(1000) {}
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout(void) const { return _timeout; }
+
+    size_t readBytes(char * buf, size_t len) {
+        size_t n = 0;
+        while (n < len) {
+            int c = timedRead();
+            if (c < 0) break;
+            buf[n++] = (char)c;
+        }
+        return n;
+    }
+    size_t readBytes(uint8_t * buf, size_t len) { return readBytes((char *)buf, len); }
+
+protected:
+    unsigned long _timeout;
+
+    // Next byte, waiting up to _timeout for it; -1 on timeout
+    virtual int timedRead(void) {
+        unsigned long start = millis();
+        do {
+            int c = read();
+            if (c >= 0) return c;
+            yield();
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+};
+
+// Serial maps to stdin/stdout
+class HardwareSerial : public Stream {
+public:
+    using Print::write;
+    void begin(unsigned long baud) { (void)baud; }
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t * buf, size_t len) override { return fwrite(buf, 1, len, stdout); }
+};
+
+extern HardwareSerial Serial;
+
+// FreeRTOS tasks run as detached threads, ticks are milliseconds. Each
+// task has a notification counter, enough for xTaskNotifyGive() and
+// ulTaskNotifyTake().
+typedef struct native_task * TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char * name, uint32_t stack, void * parameter,
+                       UBaseType_t priority, TaskHandle_t * handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char * name, uint32_t stack, void * parameter,
+                                   UBaseType_t priority, TaskHandle_t * handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#endif
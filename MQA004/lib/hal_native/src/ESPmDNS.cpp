@@ -0,0 +1,19 @@
+#include "ESPmDNS.h"
+#include "WiFi.h"
+
+MDNSResponder MDNS;
+
+bool MDNSResponder::begin(const char * hostname) {
+    (void)hostname;
+    return true;
+}
+
+IPAddress MDNSResponder::queryHost(const char * host, uint32_t timeout) {
+    (void)timeout;
+    char name[80];
+    snprintf(name, sizeof(name), "%s.local", host);
+
+    IPAddress result;
+    WiFi_lookup(name, result);
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef HAL_NATIVE_ESPMDNS_H
+#define HAL_NATIVE_ESPMDNS_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// mDNS lookups through the host resolver, which answers "<name>.local"
+// when nss-mdns or systemd-resolved is set up. The timeout is ignored.
+class MDNSResponder {
+public:
+    bool begin(const char * hostname);
+    void end(void) {}
+    IPAddress queryHost(const char * host, uint32_t timeout = 2000);
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HAL_NATIVE_IPADDRESS_H
+#define HAL_NATIVE_IPADDRESS_H
+
+#include <arpa/inet.h>
+#include "Arduino.h"
+
+// IPv4 address in network byte order, as the ESP32 core stores it
+class IPAddress {
+public:
+    IPAddress() : addr(0) {}
+    IPAddress(uint32_t address) : addr(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+        uint8_t * bytes = (uint8_t *)&addr;
+        bytes[0] = a;
+        bytes[1] = b;
+        bytes[2] = c;
+        bytes[3] = d;
+    }
+
+    operator uint32_t(void) const { return addr; }
+    uint8_t operator[](int i) const { return ((const uint8_t *)&addr)[i]; }
+
+    bool fromString(const char * address) {
+        struct in_addr in;
+        if (inet_pton(AF_INET, address, &in) != 1) return false;
+        addr = in.s_addr;
+        return true;
+    }
+
+    String toString(void) const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+private:
+    uint32_t addr;
+};
+
+#endif
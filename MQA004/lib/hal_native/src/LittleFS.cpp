@@ -0,0 +1,65 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include "LittleFS.h"
+
+LittleFSFS LittleFS;
+
+int File::peek(void) {
+    if (!file) return -1;
+    int c = fgetc(file.get());
+    if (c != EOF) ungetc(c, file.get());
+    return c == EOF ? -1 : c;
+}
+
+size_t File::size(void) const {
+    struct stat st;
+    return file && fstat(fileno(file.get()), &st) == 0 ? st.st_size : 0;
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel) {
+    (void)formatOnFail;
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    const char * dir = getenv("LITTLEFS_DIR");
+    root = dir ? dir : "littlefs";
+    mkdir(root.c_str(), 0755);
+    struct stat st;
+    return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Modes as on the device: "r", "w" (truncate) and "a" (append), plus "r+"
+File LittleFSFS::open(const char * path, const char * mode, bool create) {
+    (void)create;
+    std::string host = host_path(path);
+    const char * host_mode = strcmp(mode, "r") == 0 ? "rb" : strcmp(mode, "w") == 0 ? "wb" :
+                             strcmp(mode, "a") == 0 ? "ab" : "r+b";
+    FILE * f = fopen(host.c_str(), host_mode);
+    return f ? File(f) : File();
+}
+
+bool LittleFSFS::exists(const char * path) {
+    struct stat st;
+    return stat(host_path(path).c_str(), &st) == 0;
+}
+
+bool LittleFSFS::remove(const char * path) {
+    return ::remove(host_path(path).c_str()) == 0;
+}
+
+bool LittleFSFS::rename(const char * from, const char * to) {
+    return ::rename(host_path(from).c_str(), host_path(to).c_str()) == 0;
+}
+
+size_t LittleFSFS::usedBytes(void) {
+    size_t used = 0;
+    DIR * dir = opendir(root.c_str());
+    if (dir == NULL) return 0;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        if (stat((root + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) used += st.st_size;
+    }
+    closedir(dir);
+    return used;
+}
@@ -0,0 +1,66 @@
+#ifndef HAL_NATIVE_LITTLEFS_H
+#define HAL_NATIVE_LITTLEFS_H
+
+#include <memory>
+#include "Arduino.h"
+
+// LittleFS on a host directory: LITTLEFS_DIR, or "littlefs" in the working
+// directory. Paths are absolute within it, as on the device.
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+    using Print::write;
+
+    File() {}
+    explicit File(FILE * f) : file(f, fclose) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t * buf, size_t len) override { return file ? fwrite(buf, 1, len, file.get()) : 0; }
+    size_t read(uint8_t * buf, size_t len) { return file ? fread(buf, 1, len, file.get()) : 0; }
+    int read(void) override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int peek(void) override;
+    int available(void) override { return file ? (int)(size() - position()) : 0; }
+    void flush(void) { if (file) fflush(file.get()); }
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) { return file && fseek(file.get(), pos, mode) == 0; }
+    size_t position(void) const { return file ? ftell(file.get()) : 0; }
+    size_t size(void) const;
+    void close(void) { file.reset(); }
+    operator bool(void) const { return (bool)file; }
+
+protected:
+    int timedRead(void) override { return read(); }
+
+private:
+    std::shared_ptr<FILE> file;
+};
+
+class LittleFSFS {
+public:
+    bool begin(bool formatOnFail = false, const char * basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char * partitionLabel = "spiffs");
+    void end(void) {}
+    File open(const char * path, const char * mode = "r", bool create = false);
+    bool exists(const char * path);
+    bool remove(const char * path);
+    bool rename(const char * from, const char * to);
+    size_t totalBytes(void) { return 0x1E0000; } // Size of the storage partition
+    size_t usedBytes(void);
+
+private:
+    std::string root;
+    std::string host_path(const char * path) const { return root + path; }
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
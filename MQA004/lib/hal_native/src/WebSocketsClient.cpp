@@ -0,0 +1,197 @@
+#include "WebSocketsClient.h"
+
+#define WS_CONNECT_TIMEOUT 3000
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+static void base64_encode(const uint8_t * in, size_t len, char * out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3) {
+        *out++ = table[in[i] >> 2];
+        *out++ = table[((in[i] & 0x03) << 4) | (in[i + 1] >> 4)];
+        *out++ = table[((in[i + 1] & 0x0F) << 2) | (in[i + 2] >> 6)];
+        *out++ = table[in[i + 2] & 0x3F];
+    }
+    if (i < len) {
+        *out++ = table[in[i] >> 2];
+        if (i + 1 < len) {
+            *out++ = table[((in[i] & 0x03) << 4) | (in[i + 1] >> 4)];
+            *out++ = table[(in[i + 1] & 0x0F) << 2];
+        } else {
+            *out++ = table[(in[i] & 0x03) << 4];
+            *out++ = '=';
+        }
+        *out++ = '=';
+    }
+    *out = 0;
+}
+
+WebSocketsClient::WebSocketsClient()
+    : port(80), reconnect_interval(500), last_attempt(0), attempted(false), connected(false),
+      message_opcode(WS_OP_TEXT) {}
+
+void WebSocketsClient::begin(const char * host, uint16_t port, const char * url, const char * protocol) {
+    this->host = host;
+    this->port = port;
+    this->url = url;
+    this->protocol = protocol;
+    attempted = false;
+}
+
+void WebSocketsClient::loop(void) {
+    if (!connected) {
+        if (attempted && millis() - last_attempt < reconnect_interval) return;
+        attempted = true;
+        last_attempt = millis();
+        if (!client.connect(host.c_str(), port, WS_CONNECT_TIMEOUT) || !handshake()) {
+            client.stop();
+            return;
+        }
+        connected = true;
+        if (event) event(WStype_CONNECTED, (uint8_t *)url.c_str(), url.length());
+        return;
+    }
+
+    while (client.available() > 0) {
+        if (!read_frame()) {
+            closed();
+            return;
+        }
+    }
+    if (!client.connected()) closed();
+}
+
+bool WebSocketsClient::handshake(void) {
+    uint8_t nonce[16];
+    char key[32];
+    char line[256];
+
+    for (uint8_t i = 0; i < sizeof(nonce); i++) nonce[i] = random(256);
+    base64_encode(nonce, sizeof(nonce), key);
+
+    String request = String("GET ") + url + " HTTP/1.1\r\nHost: " + host + ":" + String((unsigned int)port) +
+                     "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: " +
+                     key + "\r\n";
+    if (!protocol.isEmpty()) request += String("Sec-WebSocket-Protocol: ") + protocol + "\r\n";
+    request += "\r\n";
+    if (client.write((const uint8_t *)request.c_str(), request.length()) != request.length()) return false;
+
+    // Expect "HTTP/1.1 101 Switching Protocols" and skip the headers
+    client.setTimeout(WS_CONNECT_TIMEOUT);
+    bool status = true;
+    for (;;) {
+        size_t n = 0;
+        char c;
+        while (client.readBytes(&c, 1) == 1 && c != '\n') {
+            if (c != '\r' && n + 1 < sizeof(line)) line[n++] = c;
+        }
+        line[n] = 0;
+        if (status) {
+            int code = 0;
+            if (sscanf(line, "HTTP/%*d.%*d %d", &code) != 1 || code != 101) return false;
+            status = false;
+        } else if (n == 0) {
+            return true;
+        }
+        if (!client.connected()) return false;
+    }
+}
+
+bool WebSocketsClient::read_frame(void) {
+    uint8_t header[2];
+    uint8_t mask[4] = { 0, 0, 0, 0 };
+
+    if (client.readBytes(header, 2) != 2) return false;
+    bool fin = header[0] & 0x80;
+    uint8_t opcode = header[0] & 0x0F;
+    bool masked = header[1] & 0x80;
+    uint64_t length = header[1] & 0x7F;
+
+    if (length >= 126) {
+        uint8_t ext[8];
+        size_t bytes = length == 126 ? 2 : 8;
+        if (client.readBytes(ext, bytes) != bytes) return false;
+        length = 0;
+        for (size_t i = 0; i < bytes; i++) length = (length << 8) | ext[i];
+    }
+    if (masked && client.readBytes(mask, 4) != 4) return false;
+
+    std::string payload(length, 0);
+    if (length > 0 && client.readBytes((uint8_t *)&payload[0], length) != length) return false;
+    for (size_t i = 0; masked && i < length; i++) payload[i] ^= mask[i % 4];
+
+    switch (opcode) {
+        case WS_OP_TEXT:
+        case WS_OP_BINARY:
+            message = payload;
+            message_opcode = opcode;
+            break;
+        case WS_OP_CONTINUATION:
+            message += payload;
+            break;
+        case WS_OP_PING:
+            return send_frame(WS_OP_PONG, (const uint8_t *)payload.data(), payload.size());
+        case WS_OP_PONG:
+            return true;
+        case WS_OP_CLOSE:
+            send_frame(WS_OP_CLOSE, (const uint8_t *)payload.data(), payload.size());
+            return false;
+        default:
+            return false;
+    }
+
+    if (fin && event) {
+        event(message_opcode == WS_OP_TEXT ? WStype_TEXT : WStype_BIN, (uint8_t *)&message[0], message.size());
+    }
+    return true;
+}
+
+bool WebSocketsClient::send_frame(uint8_t opcode, const uint8_t * payload, size_t length) {
+    uint8_t header[14];
+    size_t n = 0;
+
+    header[n++] = 0x80 | opcode;
+    if (length < 126) {
+        header[n++] = 0x80 | length;
+    } else if (length <= 0xFFFF) {
+        header[n++] = 0x80 | 126;
+        header[n++] = length >> 8;
+        header[n++] = length;
+    } else {
+        header[n++] = 0x80 | 127;
+        for (int i = 7; i >= 0; i--) header[n++] = (uint64_t)length >> (8 * i);
+    }
+
+    // Client frames are always masked
+    uint8_t * mask = header + n;
+    for (uint8_t i = 0; i < 4; i++) header[n++] = random(256);
+
+    std::string frame((const char *)header, n);
+    frame.append((const char *)payload, length);
+    for (size_t i = 0; i < length; i++) frame[n + i] ^= mask[i % 4];
+    return client.write((const uint8_t *)frame.data(), frame.size()) == frame.size();
+}
+
+bool WebSocketsClient::sendTXT(const uint8_t * payload, size_t length) {
+    if (!connected) return false;
+    return send_frame(WS_OP_TEXT, payload, length);
+}
+
+void WebSocketsClient::disconnect(void) {
+    if (connected) send_frame(WS_OP_CLOSE, NULL, 0);
+    closed();
+}
+
+void WebSocketsClient::closed(void) {
+    client.stop();
+    message.clear();
+    if (connected) {
+        connected = false;
+        if (event) event(WStype_DISCONNECTED, NULL, 0);
+    }
+}
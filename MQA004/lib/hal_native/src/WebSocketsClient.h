@@ -0,0 +1,67 @@
+#ifndef HAL_NATIVE_WEBSOCKETSCLIENT_H
+#define HAL_NATIVE_WEBSOCKETSCLIENT_H
+
+#include <functional>
+#include <string>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum {
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG,
+} WStype_t;
+
+// RFC 6455 client with the links2004/WebSockets interface. Frames are
+// read whole once their first byte arrives; heartbeats are left to TCP.
+class WebSocketsClient {
+public:
+    typedef std::function<void(WStype_t type, uint8_t * payload, size_t length)> WebSocketClientEvent;
+
+    WebSocketsClient();
+
+    void begin(const char * host, uint16_t port, const char * url = "/", const char * protocol = "arduino");
+    void onEvent(WebSocketClientEvent cbEvent) { event = cbEvent; }
+    void setReconnectInterval(unsigned long time) { reconnect_interval = time; }
+    void enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount) {
+        (void)pingInterval;
+        (void)pongTimeout;
+        (void)disconnectTimeoutCount;
+    }
+
+    void loop(void);
+    bool sendTXT(const uint8_t * payload, size_t length);
+    bool sendTXT(const char * payload) { return sendTXT((const uint8_t *)payload, strlen(payload)); }
+    bool sendTXT(String & payload) { return sendTXT((const uint8_t *)payload.c_str(), payload.length()); }
+    bool isConnected(void) { return connected; }
+    void disconnect(void);
+
+private:
+    WiFiClient client;
+    String host;
+    uint16_t port;
+    String url;
+    String protocol;
+    WebSocketClientEvent event;
+    unsigned long reconnect_interval;
+    unsigned long last_attempt;
+    bool attempted;
+    bool connected;
+    std::string message; // Reassembles fragmented messages
+    uint8_t message_opcode;
+
+    bool handshake(void);
+    bool read_frame(void);
+    bool send_frame(uint8_t opcode, const uint8_t * payload, size_t length);
+    void closed(void);
+};
+
+#endif
@@ -0,0 +1,18 @@
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+int WiFi_lookup(const char * host, IPAddress & result) {
+    struct addrinfo hints;
+    struct addrinfo * res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0) return 0;
+    result = IPAddress(((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef HAL_NATIVE_WIFI_H
+#define HAL_NATIVE_WIFI_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+#include "IPAddress.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL,
+    WL_SCAN_COMPLETED,
+    WL_CONNECTED,
+    WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST,
+    WL_DISCONNECTED
+} wl_status_t;
+
+typedef enum {
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA
+} wifi_mode_t;
+
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+#define WIFI_AP_STA WIFI_MODE_APSTA
+
+typedef enum {
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK,
+    WIFI_AUTH_WPA2_ENTERPRISE,
+    WIFI_AUTH_WPA3_PSK,
+    WIFI_AUTH_WPA2_WPA3_PSK
+} wifi_auth_mode_t;
+
+// IPv4 address of host through getaddrinfo(), 1 on success
+int WiFi_lookup(const char * host, IPAddress & result);
+
+// The host network is always up. set_status() lets a harness simulate
+// the station dropping off the access point.
+class WiFiClass {
+public:
+    WiFiClass() : state(WL_CONNECTED) {}
+    wl_status_t status(void) { return state; }
+    wl_status_t begin(const char * ssid, const char * pwd) { (void)ssid; (void)pwd; return state; }
+    bool disconnect(bool wifioff = false) { (void)wifioff; return true; }
+    bool mode(wifi_mode_t mode) { (void)mode; return true; }
+    bool setHostname(const char * hostname) { (void)hostname; return true; }
+    void set_status(wl_status_t status) { state = status; }
+    int hostByName(const char * host, IPAddress & result) { return WiFi_lookup(host, result); }
+
+private:
+    volatile wl_status_t state;
+};
+
+extern WiFiClass WiFi;
+
+#endif
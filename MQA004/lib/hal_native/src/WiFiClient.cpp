@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "WiFiClient.h"
+
+WiFiClient::WiFiClient() : fd(-1), rx_pos(0), rx_len(0) {}
+
+WiFiClient::~WiFiClient() {
+    stop();
+}
+
+int WiFiClient::connect(const char * host, uint16_t port) {
+    return connect(host, port, 3000);
+}
+
+int WiFiClient::connect(const char * host, uint16_t port, int32_t timeout_ms) {
+    struct addrinfo hints;
+    struct addrinfo * res;
+    char service[8];
+
+    stop();
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0) return 0;
+
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return 0;
+    }
+
+    // Connect without blocking past timeout_ms
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int rc = ::connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, timeout_ms) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+            rc = 0;
+        }
+    }
+    if (rc < 0) {
+        stop();
+        return 0;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+uint8_t WiFiClient::connected(void) {
+    if (fd < 0) return 0;
+    if (rx_pos < rx_len) return 1;
+
+    // Readable with nothing to read means the peer closed
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) > 0) {
+        uint8_t c;
+        ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            stop();
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void WiFiClient::stop(void) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    rx_pos = rx_len = 0;
+}
+
+bool WiFiClient::fill(int timeout_ms) {
+    if (fd < 0) return false;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+
+    ssize_t n = recv(fd, rx, sizeof(rx), MSG_DONTWAIT);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) stop();
+        return false;
+    }
+    rx_pos = 0;
+    rx_len = n;
+    return true;
+}
+
+int WiFiClient::available(void) {
+    if (rx_pos == rx_len) fill(0);
+    return rx_len - rx_pos;
+}
+
+int WiFiClient::read(void) {
+    if (rx_pos == rx_len && !fill(0)) return -1;
+    return rx[rx_pos++];
+}
+
+int WiFiClient::read(uint8_t * buf, size_t size) {
+    if (rx_pos == rx_len && !fill(0)) return -1;
+    size_t n = rx_len - rx_pos < size ? rx_len - rx_pos : size;
+    memcpy(buf, rx + rx_pos, n);
+    rx_pos += n;
+    return n;
+}
+
+int WiFiClient::peek(void) {
+    if (rx_pos == rx_len && !fill(0)) return -1;
+    return rx[rx_pos];
+}
+
+int WiFiClient::timedRead(void) {
+    if (rx_pos == rx_len && !fill(_timeout)) return -1;
+    return rx[rx_pos++];
+}
+
+size_t WiFiClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t * buf, size_t size) {
+    size_t sent = 0;
+    while (fd >= 0 && sent < size) {
+        ssize_t n = send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                stop();
+                break;
+            }
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            if (poll(&pfd, 1, _timeout) <= 0) break;
+            continue;
+        }
+        sent += n;
+    }
+    return sent;
+}
@@ -0,0 +1,45 @@
+#ifndef HAL_NATIVE_WIFICLIENT_H
+#define HAL_NATIVE_WIFICLIENT_H
+
+#include "Arduino.h"
+
+#define WIFICLIENT_RX_BUF 1460
+
+// Blocking-connect, buffered TCP client over a POSIX socket
+class WiFiClient : public Stream {
+public:
+    using Print::write;
+
+    WiFiClient();
+    ~WiFiClient();
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient & operator=(const WiFiClient &) = delete;
+
+    int connect(const char * host, uint16_t port);
+    int connect(const char * host, uint16_t port, int32_t timeout_ms);
+    uint8_t connected(void);
+    void stop(void);
+    operator bool(void) { return connected(); }
+
+    int available(void) override;
+    int read(void) override;
+    int read(uint8_t * buf, size_t size);
+    int peek(void) override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t * buf, size_t size) override;
+    void flush(void) {}
+
+protected:
+    int timedRead(void) override;
+
+private:
+    int fd;
+    uint8_t rx[WIFICLIENT_RX_BUF];
+    size_t rx_pos;
+    size_t rx_len;
+
+    // Receive into rx, waiting up to timeout_ms; false on timeout or close
+    bool fill(int timeout_ms);
+};
+
+#endif
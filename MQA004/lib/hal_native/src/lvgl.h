@@ -0,0 +1,11 @@
+#ifndef HAL_NATIVE_LVGL_H
+#define HAL_NATIVE_LVGL_H
+
+#include <stdint.h>
+
+// Only the types crowpanel.h refers to, the host build has no display
+typedef union {
+    uint16_t full;
+} lv_color_t;
+
+#endif
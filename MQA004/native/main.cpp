@@ -0,0 +1,155 @@
+// Left out of the unit tests under test/, they bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include "crowpanel.h"
+#include "moonraker.h"
+#include "farm.h"
+#include "series.h"
+#include "files.h"
+
+// Host build of the Moonraker client without the UI. Prints the printer
+// state whenever it changes and the link statistics every STATS_INTERVAL.
+// Lines typed on stdin are queued like button presses: a line starting
+// with '/' is posted as a request path, anything else as G-code, except
+// "stats", "stats reset", "farm" and "series" which work as on the
+// device's serial console, and "files" which lists the printer's G-code
+// files as the file browser does. Each command's outcome is printed when
+// it completes. Further "host[:port]" arguments are watched as print farm
+// printers, their state printed on change too.
+//
+//   program <moonraker ip> [port] [farm printer...]   (or MOONRAKER_IP / MOONRAKER_PORT)
+
+#define STATS_INTERVAL 10000
+#define FILES_PRINTED 20 // Newest files printed by "files"
+
+static void print_data(const char * name, bool unready, const moonraker_data_t & data, uint32_t version) {
+    Serial.printf("[%lu] %s%sv%u %s%s nozzle %d/%d bed %d/%d progress %u%% %s%s%s%s%s%s\n",
+                  millis(), name, name[0] ? " " : "", version,
+                  unready ? "unready" : "ready",
+                  data.printing ? (data.pause ? " paused" : " printing") : "",
+                  data.nozzle_actual, data.nozzle_target, data.bed_actual, data.bed_target,
+                  data.progress, data.file_path,
+                  data.homing ? " homing" : "", data.probing ? " probing" : "", data.qgling ? " qgling" : "",
+                  data.heating_nozzle ? " heating_nozzle" : "", data.heating_bed ? " heating_bed" : "");
+}
+
+static void print_stats(void) {
+    Serial.printf("[%lu] ws %s updates %u | polls %u (%u/min, every %u ms) | "
+                  "get %u reused %u rx %u B peak %u B | post %u lines %u dropped %u | queue hw %u overflows %u\n",
+                  millis(), moonraker.ws_subscribed ? "subscribed" : (moonraker.ws_connected ? "connected" : "down"),
+                  moonraker.ws_updates, moonraker.governor.requests, moonraker.governor.rate, moonraker.governor.interval,
+                  moonraker.conn_poll.requests, moonraker.conn_poll.reused, moonraker.conn_poll.rx_bytes,
+                  moonraker.conn_poll.parse_peak_max,
+                  moonraker.gcode_requests, moonraker.gcode_commands, moonraker.gcode_dropped,
+                  moonraker.post_queue.high_water, moonraker.post_queue.overflows);
+}
+
+static void print_done(const moonraker_done_t & done, void * user) {
+    static const char * const results[] = { "ok", "rejected", "retry", "failed", "skipped", "unchanged", "dropped", "deferred" };
+    Serial.printf("[%lu] #%u %s after %u ms%s%s\n", millis(), done.handle, results[done.result], done.latency,
+                  done.message[0] ? ": " : "", done.message);
+}
+
+// Once a listing asked for by "files" is done
+static void print_files(void) {
+    static uint8_t shown = FILES_EMPTY;
+    uint8_t state = files.state.load(std::memory_order_acquire);
+    if (state == shown) return;
+    shown = state;
+    if (state != FILES_READY && state != FILES_FAILED) return;
+
+    for (uint16_t i = 0; i < files.index.count && i < FILES_PRINTED; i++) {
+        const files_entry_t & entry = files.index.at(i);
+        Serial.printf("%10u %8u %s\n", entry.modified, entry.size, files.index.path(i));
+    }
+    files.stats_json(Serial);
+}
+
+static void read_commands(void) {
+    static char line[CMD_TEXT_LEN];
+    static size_t len = 0;
+
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c < 0) break;
+        if (c != '\n') {
+            if (c != '\r' && len + 1 < sizeof(line)) line[len++] = c;
+            continue;
+        }
+        line[len] = 0;
+        if (strcmp(line, "stats") == 0) {
+            moonraker.stats_json(Serial);
+        } else if (strcmp(line, "stats reset") == 0) {
+            moonraker.stats_reset();
+        } else if (strcmp(line, "farm") == 0) {
+            farm.stats_json(Serial);
+        } else if (strcmp(line, "series") == 0) {
+            series.stats_json(Serial);
+        } else if (strcmp(line, "files") == 0) {
+            files.request_list();
+        } else if (len > 0) {
+            uint32_t handle = line[0] == '/' ? moonraker.post_to_queue(line, print_done) :
+                                               moonraker.post_gcode_to_queue(line, print_done);
+            if (handle) {
+                Serial.printf("queued #%u %s\n", handle, line);
+            } else {
+                Serial.printf("queue full: %s\n", line);
+            }
+        }
+        len = 0;
+    }
+}
+
+int main(int argc, char ** argv) {
+    crowpanel_init();
+
+    const char * ip = argc > 1 ? argv[1] : getenv("MOONRAKER_IP");
+    const char * port = argc > 2 ? argv[2] : getenv("MOONRAKER_PORT");
+    strlcpy(crowpanel_config.moonraker_ip, ip ? ip : "127.0.0.1", sizeof(crowpanel_config.moonraker_ip));
+    if (port) strlcpy(crowpanel_config.moonraker_port, port, sizeof(crowpanel_config.moonraker_port));
+    Serial.printf("Moonraker at %s:%s\n", crowpanel_config.moonraker_ip, crowpanel_config.moonraker_port);
+    for (int i = 3; i < argc && i - 3 < FARM_PRINTERS_MAX; i++) {
+        strlcpy(crowpanel_config.farm_printers[i - 3], argv[i], sizeof(crowpanel_config.farm_printers[0]));
+    }
+
+    moonraker_setup();
+    series.begin();
+    farm.begin();
+    xTaskCreate(wifi_task, "wifi", 4096, NULL, 5, NULL);
+    xTaskCreate(moonraker_task, "moonraker", 8192, NULL, 5, NULL);
+    if (farm.count > 0) {
+        xTaskCreate(farm_task, "farm", 6144, NULL, 5, NULL);
+    }
+    xTaskCreate(files_task, "files", 6144, NULL, 5, NULL);
+
+    uint32_t version = 0;
+    uint32_t farm_versions[FARM_PRINTERS_MAX] = {};
+    unsigned long last_stats = millis();
+    for (;;) {
+        moonraker_data_t data;
+        uint32_t v;
+        if (moonraker.snapshot.read(&data, &v) && v != version) {
+            version = v;
+            print_data("", moonraker.unready, data, v);
+        }
+        for (uint8_t i = 0; i < farm.count; i++) {
+            farm_printer_t & printer = farm.printers[i];
+            if (printer.snapshot.read(&data, &v) && v != farm_versions[i]) {
+                farm_versions[i] = v;
+                print_data(printer.label, printer.link != FARM_LINK_READY, data, v);
+            }
+        }
+        if (millis() - last_stats >= STATS_INTERVAL) {
+            last_stats = millis();
+            print_stats();
+        }
+        read_commands();
+        print_files();
+        moonraker.run_completions();
+        delay(50);
+    }
+    return 0;
+}
+
+#endif
@@ -16,6 +16,10 @@ void crowpanel_init(void) {
     strcpy(crowpanel_config.moonraker_port, "7125");         // <-- Verify this is your Moonraker port
     strcpy(crowpanel_config.moonraker_tool, "tool0");        // Default extruder name
     strcpy(crowpanel_config.mode, "sta");                    // WiFi in station mode (client)
+
+    // Other printers of a print farm, shown on the grid screen
+    memset(crowpanel_config.farm_printers, 0, sizeof(crowpanel_config.farm_printers));
+    // strcpy(crowpanel_config.farm_printers[0], "voron24.local:7125");
     
     // Initialize Wi-Fi scan data
     crowpanel_wifi_scan.count = 0;
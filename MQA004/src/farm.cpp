@@ -0,0 +1,230 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "farm.h"
+#include "crowpanel.h"
+
+FARM farm;
+
+void farm_label(const char * host, char * label, size_t len) {
+    bool address = host[0] >= '0' && host[0] <= '9';
+    size_t n = address ? strlen(host) : strcspn(host, ".");
+    strlcpy(label, host, n + 1 < len ? n + 1 : len);
+}
+
+FARM::FARM()
+    : count(0), rejected(0), focus(0), requests(0), rate(0), load(0), last(0), resolve_next(0), window_start(0),
+      window_requests(0), window_busy(0) {
+    for (uint8_t c = 0; c < FARM_SOCKETS; c++) {
+        conn_owner[c] = FARM_PRINTERS_MAX;
+        conn_used[c] = 0;
+    }
+}
+
+void FARM::begin(void) {
+    alloc.use_arena(arena, sizeof(arena));
+    count = 0;
+    rejected = 0;
+    for (uint8_t i = 0; i < FARM_PRINTERS_MAX; i++) {
+        const char * entry = crowpanel_config.farm_printers[i];
+        if (entry[0] == 0) continue;
+
+        // Split off the port first, a truncated name would lose it. A name
+        // too long to resolve is skipped rather than cut to another one.
+        const char * colon = strchr(entry, ':');
+        size_t host_len = colon != NULL ? (size_t)(colon - entry) : strlen(entry);
+        long port = FARM_DEFAULT_PORT;
+        if (colon != NULL) {
+            char * end;
+            port = strtol(colon + 1, &end, 10);
+            if (end == colon + 1 || *end != 0) port = 0;
+        }
+        if (host_len == 0 || host_len >= RESOLVE_NAME_LEN || port <= 0 || port > 65535) {
+            rejected++;
+            continue;
+        }
+
+        farm_printer_t & p = printers[count++];
+        char host[RESOLVE_NAME_LEN];
+        memcpy(host, entry, host_len);
+        host[host_len] = 0;
+        p.port = port;
+        p.resolver.begin(host);
+        farm_label(host, p.label, sizeof(p.label));
+        memset(&p.data, 0, sizeof(p.data));
+        p.unready = true;
+        p.link = FARM_LINK_DOWN;
+        p.body_hash = BODY_HASH_NONE;
+        p.ok = p.failed = p.unchanged = p.unhashed = 0;
+    }
+    window_start = millis();
+}
+
+bool FARM::resolve(void) {
+    // Round robin, a printer whose name never resolves cannot starve the rest
+    for (uint8_t n = 0; n < count; n++) {
+        uint8_t i = (resolve_next + n) % count;
+        if (printers[i].resolver.loop()) {
+            resolve_next = (i + 1) % count;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The pool connection printer i had last if nobody took it since, else a
+// free or the least recently used one, closed for the new owner
+HTTP_CONN & FARM::connection(uint8_t i) {
+    uint8_t pick = 0;
+    for (uint8_t c = 0; c < FARM_SOCKETS; c++) {
+        if (conn_owner[c] == i) {
+            pick = c;
+            break;
+        }
+        if (conn_owner[pick] != FARM_PRINTERS_MAX &&
+            (conn_owner[c] == FARM_PRINTERS_MAX || (int32_t)(conn_used[c] - conn_used[pick]) < 0)) {
+            pick = c;
+        }
+    }
+    if (conn_owner[pick] != i) {
+        conns[pick].tcp.stop();
+        conn_owner[pick] = i;
+    }
+    conn_used[pick] = millis();
+    return conns[pick];
+}
+
+unsigned long FARM::step(void) {
+    unsigned long now = millis();
+    unsigned long wait = FARM_MAX_WAIT;
+    for (uint8_t n = 0; n < count; n++) {
+        uint8_t i = (last + 1 + n) % count;
+        unsigned long governor_wait = printers[i].governor.wait(now);
+        unsigned long backoff_wait = printers[i].backoff.wait(now);
+        unsigned long due = governor_wait > backoff_wait ? governor_wait : backoff_wait;
+        if (due == 0) {
+            poll(i);
+            last = i;
+            return 0;
+        }
+        if (due < wait) wait = due;
+    }
+    return wait;
+}
+
+// One status request, as MOONRAKER::get_status without the telemetry of
+// every error kind
+void FARM::poll(uint8_t i) {
+    farm_printer_t & p = printers[i];
+    unsigned long start = millis();
+    p.backoff.ready(start);
+
+    HTTP_CONN & http = connection(i);
+    char host[RESOLVE_NAME_LEN];
+    bool resolved = p.resolver.host(host, sizeof(host));
+    int code = HTTP_ERROR_CONNECT; // Nothing is sent until the name is resolved
+    if (resolved) {
+        http.begin(host, p.port);
+        bool reused = http.tcp.connected();
+        code = http.request("GET", moonraker.status_query, FARM_TIMEOUT);
+        if (reused && http_stale(code)) {
+            // Closed while idle, once more on a new socket
+            http.tcp.stop();
+            code = http.request("GET", moonraker.status_query, FARM_TIMEOUT);
+        }
+    }
+
+    moonraker_result_t result = REQUEST_FAILED;
+    if (code >= 200 && code < 300) {
+        JsonDocument json_parse(&alloc);
+        if (!moonraker_hashable(http, sizeof(body))) p.unhashed++;
+        result = moonraker_read_json(http, json_parse, &moonraker.status_filter, body, sizeof(body), &p.body_hash);
+        if (result == REQUEST_OK) {
+            JsonVariantConst status = json_parse["result"]["status"];
+            if (status.is<JsonObjectConst>()) {
+                moonraker.apply_status(status, p.data, p.unready);
+            } else {
+                result = REQUEST_REJECTED;
+            }
+        }
+    } else if (code <= 0) {
+        http.tcp.stop();
+        if (resolved && code != HTTP_ERROR_TIMEOUT) {
+            p.resolver.refresh(); // The printer may have a new address
+        }
+    }
+    http.end();
+
+    unsigned long now = millis();
+    if (result == REQUEST_OK || result == REQUEST_UNCHANGED) {
+        p.ok++;
+        if (result == REQUEST_UNCHANGED) p.unchanged++;
+        p.backoff.success();
+    } else {
+        p.failed++;
+        p.unready = true;
+        p.body_hash = BODY_HASH_NONE;
+        p.backoff.failure(now);
+    }
+    // Any HTTP reply at all means Moonraker is up
+    bool ok = result == REQUEST_OK || result == REQUEST_UNCHANGED;
+    p.link = ok && !p.unready ? FARM_LINK_READY : code > 0 ? FARM_LINK_UNREADY : FARM_LINK_DOWN;
+    p.governor.polled(p.data, p.unready, now);
+    p.snapshot.write(p.data);
+    p.latency.add(now - start);
+
+    requests++;
+    window_requests++;
+    window_busy += now - start;
+    if (now - window_start >= FARM_RATE_WINDOW) {
+        rate = window_requests;
+        load = (uint64_t)window_busy * 100 / (now - window_start);
+        window_requests = window_busy = 0;
+        window_start = now;
+    }
+}
+
+// Compact JSON of the farm, e.g. for the "farm" serial command: what each
+// watched printer costs in RAM and how busy the shared task is
+void FARM::stats_json(Print & out) {
+    static const char * const links[] = { "down", "unready", "ready" };
+    JsonDocument doc;
+
+    doc["n"] = count;
+    doc["rejected"] = rejected;
+    doc["printer_bytes"] = printer_bytes();
+    doc["pool_bytes"] = pool_bytes();
+    doc["bytes"] = count * printer_bytes() + pool_bytes();
+    doc["reserved"] = sizeof(FARM); // Static, room for FARM_PRINTERS_MAX
+    doc["req"] = requests;
+    doc["rate"] = rate;
+    doc["load"] = load;
+    doc["heap"] = alloc.heap_allocs; // JSON blocks that did not fit the arena
+
+    JsonArray list = doc["printers"].to<JsonArray>();
+    for (uint8_t i = 0; i < count; i++) {
+        const farm_printer_t & p = printers[i];
+        JsonObject printer = list.add<JsonObject>();
+        printer["name"] = p.label;
+        printer["link"] = links[p.link];
+        printer["ok"] = p.ok;
+        printer["fail"] = p.failed;
+        printer["same"] = p.unchanged;
+        printer["unhashed"] = p.unhashed;
+        printer["every"] = p.governor.interval;
+        printer["avg"] = p.latency.mean();
+        printer["max"] = p.latency.max_ms;
+    }
+
+    serializeJson(doc, out);
+    out.println();
+}
+
+void farm_task(void * parameter) {
+    for (;;) {
+        unsigned long wait = FARM_MAX_WAIT;
+        if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED) {
+            wait = farm.step();
+        }
+        delay(wait > 0 ? wait : 1);
+    }
+}
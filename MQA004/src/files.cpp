@@ -0,0 +1,295 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include "files.h"
+#include "gcode_batch.h"
+
+FILES files;
+
+static JsonDocument list_filter;
+static JsonDocument meta_filter;
+
+FILES_INDEX::FILES_INDEX() {
+    clear();
+}
+
+void FILES_INDEX::clear(void) {
+    count = 0;
+    seen = 0;
+    dropped = 0;
+    used = 0;
+    cutoff = 0;
+}
+
+bool files_query(char * buf, size_t len, const char * prefix, const char * path) {
+    size_t pos = strlcpy(buf, prefix, len);
+    if (pos >= len || gcode_append(buf, len, pos, path, false) == 0) {
+        buf[0] = 0;
+        return false;
+    }
+    return true;
+}
+
+bool FILES_INDEX::add(const char * path, uint32_t modified, uint32_t size) {
+    seen++;
+    size_t len = strlen(path) + 1;
+    char start[CMD_TEXT_LEN];
+    if (len > FILES_PATH_MAX || modified < cutoff || !files_query(start, sizeof(start), FILES_START_PATH, path)) {
+        dropped++;
+        return false;
+    }
+    if (count == FILES_MAX || used + len > sizeof(arena)) {
+        make_room();
+        if (modified < cutoff) {
+            dropped++;
+            return false;
+        }
+    }
+
+    files_entry_t & e = entries[count++];
+    e.modified = modified;
+    e.size = size;
+    e.estimated_time = 0;
+    e.filament = 0;
+    e.path = used;
+    memcpy(arena + used, path, len);
+    used += len;
+    return true;
+}
+
+void FILES_INDEX::sort(void) {
+    std::sort(entries, entries + count, [](const files_entry_t & a, const files_entry_t & b) {
+        return a.modified > b.modified;
+    });
+}
+
+// Keep the newest three quarters and skip anything older from now on, then
+// move the kept paths down over the dropped ones, in arena order so a path
+// never overwrites one still to be moved
+void FILES_INDEX::make_room(void) {
+    sort();
+    uint16_t keep = count - (count + 3) / 4;
+    dropped += count - keep;
+    count = keep;
+    if (count > 0) cutoff = entries[count - 1].modified;
+
+    std::sort(entries, entries + count, [](const files_entry_t & a, const files_entry_t & b) {
+        return a.path < b.path;
+    });
+    used = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        size_t len = strlen(arena + entries[i].path) + 1;
+        memmove(arena + used, arena + entries[i].path, len);
+        entries[i].path = used;
+        used += len;
+    }
+}
+
+// Next character that is not white space, left in the stream
+static int peek_token(Stream & in) {
+    int c;
+    while ((c = in.peek()) == ' ' || c == '\n' || c == '\r' || c == '\t') {
+        in.read();
+    }
+    return c;
+}
+
+// {"result": [{"path": ..., "modified": ..., "size": ..., ...}, ...]}
+// Moonraker has no paging for the list, so the array is taken apart here
+// and each element parsed on its own, the JSON heap never holding more
+// than one file.
+bool files_scan(Stream & in, FILES_INDEX & index, ArduinoJson::Allocator * alloc) {
+    if (list_filter.isNull()) {
+        list_filter["path"] = true;
+        list_filter["modified"] = true;
+        list_filter["size"] = true;
+    }
+
+    int c;
+    while ((c = in.read()) != '[') {
+        if (c < 0) return false;
+    }
+    if (peek_token(in) == ']') return true;
+
+    JsonDocument entry(alloc);
+    for (;;) {
+        if (peek_token(in) != '{') return false;
+        if (deserializeJson(entry, in, DeserializationOption::Filter(list_filter))) return false;
+        const char * path = entry["path"];
+        if (path != NULL) {
+            index.add(path, entry["modified"].as<uint32_t>(), entry["size"].as<uint32_t>());
+        }
+
+        c = peek_token(in);
+        in.read();
+        if (c == ']') return true;
+        if (c != ',') return false;
+    }
+}
+
+FILES::FILES()
+    : state(FILES_EMPTY), visible(0), task(NULL), loaded_at(0), lists(0), list_ms(0), list_bytes(0),
+      meta_fetched(0), meta_failed(0), meta_skipped(0) {
+    for (uint16_t i = 0; i < FILES_MAX; i++) {
+        meta[i].store(META_NONE, std::memory_order_relaxed);
+    }
+    alloc.use_arena(json_arena, sizeof(json_arena));
+}
+
+void FILES::request_list(void) {
+    if (state.load(std::memory_order_acquire) == FILES_LOADING) return;
+    state.store(FILES_LOADING, std::memory_order_release);
+    TaskHandle_t t = task;
+    if (t != NULL) xTaskNotifyGive(t);
+}
+
+void FILES::request_meta(uint16_t i) {
+    if (i >= index.count || meta[i].load(std::memory_order_acquire) != META_NONE) return;
+    meta[i].store(META_PENDING, std::memory_order_release);
+    if (!meta_queue.push(i)) {
+        meta[i].store(META_NONE, std::memory_order_release); // Asked again on the next scroll
+        return;
+    }
+    TaskHandle_t t = task;
+    if (t != NULL) xTaskNotifyGive(t);
+}
+
+// One GET on the browser's own connection, once more on a new socket if
+// the kept-alive one was closed while idle, see http_stale()
+int FILES::request(const char * path) {
+    char host[RESOLVE_NAME_LEN];
+    if (!resolver.host(host, sizeof(host))) {
+        return HTTP_ERROR_CONNECT; // Not resolved yet, the name would block on its lookup
+    }
+    http.begin(host, atoi(moonraker.moonraker_port));
+
+    bool reused = http.tcp.connected();
+    int code = http.request("GET", path, FILES_TIMEOUT);
+    if (reused && http_stale(code)) {
+        http.tcp.stop();
+        code = http.request("GET", path, FILES_TIMEOUT);
+    }
+    if (code <= 0) http.tcp.stop();
+    return code;
+}
+
+// The LVGL task does not read the index while state is FILES_LOADING, and
+// asks for no metadata, so everything is reset here
+bool FILES::list(void) {
+    unsigned long start = millis();
+    index.clear();
+    for (uint16_t i = 0; i < FILES_MAX; i++) {
+        meta[i].store(META_NONE, std::memory_order_relaxed);
+    }
+    while (!meta_queue.empty()) meta_queue.pop(); // Rows of the old index
+
+    bool ok = false;
+    int code = request(FILES_LIST_PATH);
+    if (code >= 200 && code < 300) {
+        ok = files_scan(http, index, &alloc);
+    }
+    list_bytes = http.received;
+    http.end();
+
+    index.sort();
+    lists++;
+    list_ms = millis() - start;
+    loaded_at = millis();
+    state.store(ok ? FILES_READY : FILES_FAILED, std::memory_order_release);
+    return ok;
+}
+
+bool FILES::fetch_meta(uint16_t i) {
+    unsigned long start = millis();
+    char path[sizeof(FILES_META_PATH) + CMD_TEXT_LEN];
+    files_query(path, sizeof(path), FILES_META_PATH, index.path(i)); // Fits, add() only keeps paths whose start request fits a command
+
+    bool ok = false;
+    int code = request(path);
+    if (code >= 200 && code < 300) {
+        JsonDocument doc(&alloc);
+        if (moonraker_read_json(http, doc, &meta_filter, NULL, 0, NULL) == REQUEST_OK) {
+            JsonVariantConst result = doc["result"];
+            files_entry_t & e = index.at(i);
+            e.estimated_time = result["estimated_time"].as<uint32_t>();
+            e.filament = result["filament_total"].as<uint32_t>();
+            ok = result.is<JsonObjectConst>();
+        }
+    }
+    http.end();
+
+    meta_time.add(millis() - start);
+    if (ok) {
+        meta_fetched++;
+    } else {
+        meta_failed++; // Also files Moonraker has not analysed
+    }
+    meta[i].store(ok ? META_READY : META_FAILED, std::memory_order_release);
+    return ok;
+}
+
+// A listing first, then one metadata request per call. Rows the browser
+// has scrolled away from meanwhile are skipped; they are asked for again
+// if they come back into view.
+void FILES::loop(void) {
+    bool connected = wifi_get_connect_status() == WIFI_STATUS_CONNECTED;
+    if (state.load(std::memory_order_acquire) == FILES_LOADING) {
+        if (connected) {
+            list();
+        } else {
+            state.store(FILES_FAILED, std::memory_order_release);
+        }
+        return;
+    }
+
+    uint16_t * next = meta_queue.front();
+    if (next == NULL) return;
+    uint16_t i = *next;
+    meta_queue.pop();
+
+    int32_t distance = (int32_t)i - visible.load(std::memory_order_relaxed);
+    if (!connected || distance < -FILES_META_NEAR || distance > FILES_META_NEAR) {
+        meta_skipped++;
+        meta[i].store(META_NONE, std::memory_order_release);
+        return;
+    }
+    fetch_meta(i);
+}
+
+// Compact JSON of the browser, e.g. for the "files" serial command
+void FILES::stats_json(Print & out) {
+    static const char * const states[] = { "empty", "loading", "ready", "failed" };
+    JsonDocument doc;
+
+    doc["state"] = states[state.load(std::memory_order_acquire)];
+    doc["bytes"] = sizeof(FILES); // Static, index and metadata states included
+    doc["arena"] = index.arena_used();
+    doc["lists"] = lists;
+    doc["list_ms"] = list_ms;
+    doc["list_bytes"] = list_bytes;
+    doc["seen"] = index.seen;
+    doc["kept"] = index.count;
+    doc["dropped"] = index.dropped;
+    doc["meta"] = meta_fetched;
+    doc["meta_fail"] = meta_failed;
+    doc["meta_skip"] = meta_skipped;
+    doc["meta_avg"] = meta_time.mean();
+    doc["meta_max"] = meta_time.max_ms;
+    doc["heap"] = alloc.heap_allocs; // JSON blocks that did not fit the arena
+    doc["peak"] = alloc.peak;
+
+    serializeJson(doc, out);
+    out.println();
+}
+
+void files_task(void * parameter) {
+    meta_filter["result"]["estimated_time"] = true;
+    meta_filter["result"]["filament_total"] = true;
+    files.task = xTaskGetCurrentTaskHandle();
+
+    for (;;) {
+        files.loop();
+        bool idle = files.state.load(std::memory_order_acquire) != FILES_LOADING && files.meta_queue.empty();
+        ulTaskNotifyTake(pdTRUE, idle ? portMAX_DELAY : 0);
+    }
+}
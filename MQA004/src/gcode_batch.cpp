@@ -0,0 +1,173 @@
+#include <Arduino.h>
+#include "gcode_batch.h"
+
+// Commands that may run once no matter how often they were queued
+static const char * const idempotent_commands[] = {
+    "G28",
+    "QUAD_GANTRY_LEVEL",
+    "Z_TILT_ADJUST",
+    "BED_MESH_CALIBRATE",
+    "M84",
+};
+
+// Length of the command word at the start of line
+static size_t gcode_word_len(const char * line) {
+    return strcspn(line, " \t");
+}
+
+static bool gcode_is(const char * line, const char * word) {
+    size_t len = gcode_word_len(line);
+    return len == strlen(word) && strncasecmp(line, word, len) == 0;
+}
+
+// Value of a parameter such as "T0" or "HEATER=bed", NULL if absent
+static const char * gcode_param(const char * line, const char * name, size_t * len) {
+    size_t name_len = strlen(name);
+    const char * p = line + gcode_word_len(line);
+    while (*p) {
+        p += strspn(p, " \t");
+        size_t word = strcspn(p, " \t");
+        if (word > name_len && strncasecmp(p, name, name_len) == 0) {
+            *len = word - name_len;
+            return p + name_len;
+        }
+        p += word;
+    }
+    return NULL;
+}
+
+// Commands with a dedicated Moonraker endpoint that must not wait behind
+// queued G-code
+static const struct {
+    const char * command;
+    uint8_t priority;
+    const char * path;
+} priority_commands[] = {
+    { "M112",         GCODE_EMERGENCY, "/printer/emergency_stop" },
+    { "CANCEL_PRINT", GCODE_CONTROL,   "/printer/print/cancel" },
+    { "PAUSE",        GCODE_CONTROL,   "/printer/print/pause" },
+    { "RESUME",       GCODE_CONTROL,   "/printer/print/resume" },
+};
+
+uint8_t gcode_priority(const char * line, const char ** path) {
+    line += strspn(line, " \t");
+    const char * rest = line + gcode_word_len(line);
+    rest += strspn(rest, " \t");
+    if (*rest != 0) {
+        return GCODE_BULK; // Parameters would be lost on the endpoint
+    }
+
+    for (size_t i = 0; i < sizeof(priority_commands) / sizeof(priority_commands[0]); i++) {
+        if (gcode_is(line, priority_commands[i].command)) {
+            *path = priority_commands[i].path;
+            return priority_commands[i].priority;
+        }
+    }
+    return GCODE_BULK;
+}
+
+uint8_t path_priority(const char * path) {
+    for (size_t i = 0; i < sizeof(priority_commands) / sizeof(priority_commands[0]); i++) {
+        if (strcmp(path, priority_commands[i].path) == 0) {
+            return priority_commands[i].priority;
+        }
+    }
+    return GCODE_BULK;
+}
+
+bool gcode_setpoint_key(const char * line, char * key, size_t len) {
+    const char * value;
+    size_t value_len;
+
+    if (gcode_is(line, "M104") || gcode_is(line, "M109")) {
+        value = gcode_param(line, "T", &value_len);
+        snprintf(key, len, "E%.*s", value ? (int)value_len : 0, value ? value : "");
+        return true;
+    }
+    if (gcode_is(line, "M140") || gcode_is(line, "M190")) {
+        strlcpy(key, "B", len);
+        return true;
+    }
+    if (gcode_is(line, "SET_HEATER_TEMPERATURE")) {
+        value = gcode_param(line, "HEATER=", &value_len);
+        if (value == NULL) return false;
+        snprintf(key, len, "H:%.*s", (int)value_len, value);
+        return true;
+    }
+    return false;
+}
+
+bool gcode_idempotent(const char * line) {
+    for (uint8_t i = 0; i < sizeof(idempotent_commands) / sizeof(idempotent_commands[0]); i++) {
+        if (gcode_is(line, idempotent_commands[i])) return true;
+    }
+    return false;
+}
+
+// Setpoints that also wait for the heater, what follows them relies on it
+static bool gcode_waits(const char * line) {
+    return gcode_is(line, "M109") || gcode_is(line, "M190");
+}
+
+uint8_t gcode_coalesce(const char * const * lines, uint8_t count, bool * keep) {
+    char key[GCODE_KEY_LEN];
+    char later_key[GCODE_KEY_LEN];
+    uint8_t kept = 0;
+    int16_t last = -1; // Last line kept so far
+
+    for (uint8_t i = 0; i < count; i++) {
+        keep[i] = true;
+
+        // Only the last setpoint queued for a heater matters, but a wait
+        // for the temperature is never dropped
+        if (!gcode_waits(lines[i]) && gcode_setpoint_key(lines[i], key, sizeof(key))) {
+            for (uint8_t j = i + 1; j < count; j++) {
+                if (gcode_setpoint_key(lines[j], later_key, sizeof(later_key)) && strcmp(key, later_key) == 0) {
+                    keep[i] = false;
+                    break;
+                }
+            }
+        }
+
+        // Collapse an idempotent command repeated back to back. Apart, the
+        // commands between them may undo it, e.g. G28, M84, G28.
+        if (keep[i] && gcode_idempotent(lines[i]) && last >= 0 && strcasecmp(lines[last], lines[i]) == 0) {
+            keep[i] = false;
+        }
+
+        if (keep[i]) {
+            kept++;
+            last = i;
+        }
+    }
+    return kept;
+}
+
+size_t gcode_append(char * buf, size_t len, size_t pos, const char * line, bool newline) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t start = pos;
+
+    if (newline) {
+        if (pos + 3 >= len) return 0;
+        memcpy(buf + pos, "%0A", 3);
+        pos += 3;
+    }
+
+    for (const char * c = line; *c; c++) {
+        bool plain = isalnum((unsigned char)*c) || strchr("-_.~", *c) != NULL;
+        if (pos + (plain ? 1 : 3) >= len) {
+            buf[start] = 0;
+            return 0;
+        }
+        if (plain) {
+            buf[pos++] = *c;
+        } else {
+            buf[pos++] = '%';
+            buf[pos++] = hex[(uint8_t)*c >> 4];
+            buf[pos++] = hex[(uint8_t)*c & 0x0F];
+        }
+    }
+
+    buf[pos] = 0;
+    return pos;
+}
@@ -0,0 +1,249 @@
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "http_conn.h"
+
+static bool url_unsafe(char c) {
+    return (uint8_t)c <= ' ' || (uint8_t)c >= 0x7F || strchr("\"#<>\\^`{|}", c) != NULL;
+}
+
+size_t url_encode(char * buf, size_t len, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t encoded = len;
+    for (size_t i = 0; i < len; i++) {
+        if (url_unsafe(buf[i])) encoded += 2;
+    }
+    if (encoded >= size) return 0;
+
+    // Back to front, so every character moves before it is overwritten
+    buf[encoded] = 0;
+    size_t j = encoded;
+    for (size_t i = len; i-- > 0;) {
+        char c = buf[i];
+        if (url_unsafe(c)) {
+            buf[--j] = hex[(uint8_t)c & 0x0F];
+            buf[--j] = hex[(uint8_t)c >> 4];
+            buf[--j] = '%';
+        } else {
+            buf[--j] = c;
+        }
+    }
+    return encoded;
+}
+
+HTTP_CONN::HTTP_CONN()
+    : size(-1), sent(0), received(0), tail_len(0), port(0), timeout(0), left(0), chunked(false), done(true),
+      reuse(false), chunks(0) {
+    host[0] = 0;
+    tail[0] = 0;
+    // read() waits on the socket itself, Stream's own retry loop only adds delay
+    setTimeout(0);
+}
+
+void HTTP_CONN::begin(const char * host, uint16_t port) {
+    if (port == this->port && strcmp(host, this->host) == 0) return;
+
+    // A kept-alive socket belongs to the old address
+    tcp.stop();
+    strlcpy(this->host, host, sizeof(this->host));
+    this->port = port;
+    int len = snprintf(tail, sizeof(tail),
+                       " HTTP/1.1\r\nHost: %s:%u\r\nConnection: keep-alive\r\nContent-Length: 0\r\n\r\n", host, port);
+    tail_len = len > 0 && len < (int)sizeof(tail) ? len : 0;
+}
+
+// Wait up to the timeout for data on the socket, false on timeout or
+// close. WiFiClient's reads never wait, and a sleeping task leaves the
+// CPU to the LVGL task.
+bool HTTP_CONN::wait(void) {
+    unsigned long start = millis();
+    while (tcp.available() <= 0) {
+        if (!tcp.connected() || millis() - start >= timeout) return false;
+        delay(1);
+    }
+    return true;
+}
+
+// One header line without its CRLF, cut to len - 1 characters
+bool HTTP_CONN::read_line(char * buf, size_t len) {
+    size_t n = 0;
+    for (;;) {
+        if (!wait()) return false;
+        int c = tcp.read();
+        if (c < 0) return false;
+        if (c == '\n') break;
+        if (c != '\r' && n + 1 < len) buf[n++] = c;
+    }
+    buf[n] = 0;
+    return true;
+}
+
+int HTTP_CONN::request(const char * type, const char * path, uint32_t timeout) {
+    size = -1;
+    received = 0;
+    done = true;
+    left = 0;
+
+    size_t type_len = strlen(type);
+    size_t path_len = strlen(path);
+    if (tail_len == 0 || type_len + 1 + path_len >= HTTP_PATH_LEN) return HTTP_ERROR_TOO_LONG;
+    memcpy(req, type, type_len);
+    req[type_len] = ' ';
+    memcpy(req + type_len + 1, path, path_len);
+    size_t encoded = url_encode(req + type_len + 1, path_len, HTTP_PATH_LEN - type_len - 1);
+    if (encoded == 0) return HTTP_ERROR_TOO_LONG;
+    size_t len = type_len + 1 + encoded;
+    memcpy(req + len, tail, tail_len);
+    len += tail_len;
+
+    if (!tcp.connected() && !tcp.connect(host, port, HTTP_CONNECT_TIMEOUT)) {
+        return HTTP_ERROR_CONNECT;
+    }
+    this->timeout = timeout;
+    if (tcp.write((const uint8_t *)req, len) != len) {
+        tcp.stop();
+        return HTTP_ERROR_SEND;
+    }
+    sent = len;
+
+    // Status line, e.g. "HTTP/1.1 200 OK"
+    char line[HTTP_LINE_LEN];
+    if (!wait()) {
+        return tcp.connected() ? HTTP_ERROR_TIMEOUT : HTTP_ERROR_LOST;
+    }
+    if (!read_line(line, sizeof(line))) {
+        tcp.stop();
+        return HTTP_ERROR_TIMEOUT; // Part of a reply came, the server has seen the request
+    }
+    const char * status = strchr(line, ' ');
+    int code = strncmp(line, "HTTP/1.", 7) == 0 && status != NULL ? strtol(status + 1, NULL, 10) : 0;
+    if (code <= 0) {
+        tcp.stop();
+        return HTTP_ERROR_NO_SERVER;
+    }
+
+    chunked = false;
+    reuse = true;
+    for (;;) {
+        if (!read_line(line, sizeof(line))) {
+            tcp.stop();
+            return HTTP_ERROR_TIMEOUT;
+        }
+        if (line[0] == 0) break;
+        char * value = strchr(line, ':');
+        if (value == NULL) continue;
+        *value++ = 0;
+        value += strspn(value, " ");
+        if (strcasecmp(line, "Content-Length") == 0) {
+            size = strtol(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasestr(value, "chunked")) {
+            chunked = true;
+        } else if (strcasecmp(line, "Connection") == 0 && strcasestr(value, "close")) {
+            reuse = false;
+        }
+    }
+
+    done = false;
+    chunks = 0;
+    if (chunked) {
+        size = -1;
+        left = 0;
+    } else if (code == 204 || code == 304) {
+        size = 0;
+        left = 0;
+    } else if (size >= 0) {
+        left = size;
+    } else {
+        // No length, the body ends when the server closes
+        left = -1;
+        reuse = false;
+    }
+    return code;
+}
+
+// Read the next chunk header, or the last chunk and the trailers
+void HTTP_CONN::next_chunk(void) {
+    char line[HTTP_LINE_LEN];
+    // The previous chunk ends with a CRLF of its own
+    if ((chunks > 0 && !read_line(line, sizeof(line))) || !read_line(line, sizeof(line))) {
+        done = true;
+        reuse = false;
+        return;
+    }
+    chunks++;
+    long len = strtol(line, NULL, 16);
+    if (len > 0) {
+        left = len;
+        return;
+    }
+    do {
+        if (!read_line(line, sizeof(line))) {
+            reuse = false;
+            break;
+        }
+    } while (line[0] != 0);
+    done = true;
+}
+
+// Body bytes readable before the next chunk header, 0 at the end
+int32_t HTTP_CONN::remaining(void) {
+    if (left == 0 && !done) {
+        if (chunked) {
+            next_chunk();
+        } else {
+            done = true;
+        }
+    }
+    return done ? 0 : left;
+}
+
+size_t HTTP_CONN::read_body(char * buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        int32_t avail = remaining();
+        if (avail == 0) break;
+        size_t want = len - n;
+        if (avail > 0 && want > (size_t)avail) want = avail;
+        int got = wait() ? tcp.read((uint8_t *)buf + n, want) : -1;
+        if (got <= 0) {
+            // Timeout, or the end of a body without a length
+            done = true;
+            reuse = false;
+            break;
+        }
+        n += got;
+        if (avail > 0) left -= got;
+    }
+    received += n;
+    return n;
+}
+
+void HTTP_CONN::end(void) {
+    // Leftovers, e.g. the newline after a JSON document, would be taken
+    // for the start of the next reply
+    char buf[32];
+    while (reuse && remaining() != 0 && tcp.available() > 0) {
+        int n = tcp.available();
+        read_body(buf, n < (int)sizeof(buf) ? n : sizeof(buf));
+    }
+    if (!done || !reuse) {
+        tcp.stop();
+    }
+    done = true;
+}
+
+int HTTP_CONN::available(void) {
+    if (done) return 0;
+    int n = tcp.available();
+    return left > 0 && n > left ? left : n;
+}
+
+int HTTP_CONN::read(void) {
+    char c;
+    return read_body(&c, 1) == 1 ? (uint8_t)c : -1;
+}
+
+// Waits for the next byte like read(), a parser looking ahead must not
+// take a slow segment for the end of the body
+int HTTP_CONN::peek(void) {
+    return remaining() != 0 && wait() ? tcp.peek() : -1;
+}
@@ -0,0 +1,217 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "journal.h"
+
+static uint8_t record_check(const journal_record_t & header, const char * text) {
+    const uint8_t * p = (const uint8_t *)&header;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < offsetof(journal_record_t, check); i++) sum += p[i];
+    for (uint8_t i = 0; i < header.len; i++) sum += (uint8_t)text[i];
+    return sum;
+}
+
+// Next whole record from f, false at the end or at a torn or foreign record
+static bool record_read(File & f, journal_record_t * header, char * text) {
+    if (f.read((uint8_t *)header, sizeof(*header)) != sizeof(*header)) return false;
+    if (header->magic != JOURNAL_MAGIC || header->len >= JOURNAL_TEXT_LEN) return false;
+    if (f.read((uint8_t *)text, header->len) != header->len) return false;
+    text[header->len] = 0;
+    return record_check(*header, text) == header->check;
+}
+
+JOURNAL::JOURNAL()
+    : appended(0), full(0), expired(0), replayed(0), append_us(0), append_us_max(0), replay_ms(0),
+      mounted(false), bytes(0), next_seq(1), last_seq(0), acked(0), acked_pos(0), read_end(0), read_last(0),
+      boot_seq(UINT32_MAX), expired_seq(0) {}
+
+bool JOURNAL::begin(void) {
+    mounted = LittleFS.begin(true, "/littlefs", 4, JOURNAL_PARTITION);
+    if (!mounted) return false;
+    compact();
+    boot_seq = next_seq;
+    return true;
+}
+
+bool JOURNAL::expired_at(const journal_record_t & header, uint32_t now_ms, time_t now_s) const {
+    if (header.seq >= boot_seq) {
+        return (int32_t)(now_ms - header.deadline_ms) > 0;
+    }
+    // Written before the last reset, only the wall clock tells its age
+    return header.deadline_s == 0 || (unsigned long)now_s < JOURNAL_CLOCK_VALID ||
+           (unsigned long)now_s > header.deadline_s;
+}
+
+// Rewrite the file with only the commands still to send. Commands of an
+// earlier boot without a wall clock deadline are dropped here, the others
+// are judged by read() once SNTP had a chance to set the clock.
+bool JOURNAL::compact(void) {
+    File in = LittleFS.open(JOURNAL_PATH, "r");
+    if (!in) {
+        bytes = acked_pos = read_end = 0;
+        last_seq = acked;
+        return true;
+    }
+
+    // Acks first, they may follow the commands they cover
+    journal_record_t header;
+    char text[JOURNAL_TEXT_LEN];
+    uint32_t done = acked;
+    while (record_read(in, &header, text)) {
+        if (header.seq >= next_seq) next_seq = header.seq + 1;
+        if (header.kind == JOURNAL_ACK && header.seq > done) done = header.seq;
+    }
+
+    in.seek(0);
+    File out = LittleFS.open(JOURNAL_TMP_PATH, "w");
+    bool ok = out;
+    uint32_t kept = 0;
+    uint32_t newest = done;
+    uint32_t now_ms = millis();
+    while (ok && record_read(in, &header, text)) {
+        if (header.kind != JOURNAL_CMD || header.seq <= done) continue;
+        bool old = header.seq < boot_seq;
+        if (old ? header.deadline_s == 0 : expired_at(header, now_ms, 0)) {
+            expired++;
+            continue;
+        }
+        ok = out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+             out.write((const uint8_t *)text, header.len) == header.len;
+        kept += sizeof(header) + header.len;
+        newest = header.seq;
+    }
+    in.close();
+    out.close();
+    if (!ok) {
+        LittleFS.remove(JOURNAL_TMP_PATH);
+        return false;
+    }
+
+    LittleFS.remove(JOURNAL_PATH);
+    if (kept > 0) {
+        LittleFS.rename(JOURNAL_TMP_PATH, JOURNAL_PATH);
+    } else {
+        LittleFS.remove(JOURNAL_TMP_PATH);
+    }
+    acked = done;
+    last_seq = newest;
+    bytes = kept;
+    acked_pos = read_end = 0;
+    return true;
+}
+
+bool JOURNAL::write(const journal_record_t & header, const char * text) {
+    uint8_t record[sizeof(journal_record_t) + JOURNAL_TEXT_LEN];
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), text, header.len);
+    size_t len = sizeof(header) + header.len;
+
+    // One write per record, so a reset tears at most the last one
+    File f = LittleFS.open(JOURNAL_PATH, "a");
+    if (!f) return false;
+    bool ok = f.write(record, len) == len;
+    f.close();
+    if (ok) bytes += len;
+    return ok;
+}
+
+bool JOURNAL::append(uint8_t type, const char * text, uint32_t queued_at) {
+    unsigned long start = micros();
+    size_t len = strlen(text);
+    journal_record_t header;
+    header.magic = JOURNAL_MAGIC;
+    header.kind = JOURNAL_CMD;
+    header.type = type;
+    header.seq = next_seq;
+    header.deadline_ms = queued_at + JOURNAL_EXPIRE * 1000UL;
+    time_t now = time(NULL);
+    uint32_t age = (millis() - queued_at) / 1000;
+    header.deadline_s = (unsigned long)now >= JOURNAL_CLOCK_VALID ? now + JOURNAL_EXPIRE - age : 0;
+    header.len = len;
+    header.check = 0;
+
+    bool ok = mounted && len < JOURNAL_TEXT_LEN;
+    if (ok && bytes + sizeof(header) + len > JOURNAL_MAX_BYTES) {
+        ok = compact() && bytes + sizeof(header) + len <= JOURNAL_MAX_BYTES;
+    }
+    if (ok) {
+        header.check = record_check(header, text);
+        ok = write(header, text);
+    }
+    if (!ok) {
+        full++;
+        return false;
+    }
+
+    next_seq++;
+    last_seq = header.seq;
+    appended++;
+    uint32_t us = micros() - start;
+    append_us += us;
+    if (us > append_us_max) append_us_max = us;
+    return true;
+}
+
+uint8_t JOURNAL::read(journal_entry_t * out, uint8_t max, uint32_t * last) {
+    *last = 0;
+    File f = LittleFS.open(JOURNAL_PATH, "r");
+    if (!f || !f.seek(acked_pos)) {
+        *last = read_last = last_seq; // Lost with the file
+        return 0;
+    }
+
+    journal_record_t header;
+    char text[JOURNAL_TEXT_LEN];
+    uint32_t now_ms = millis();
+    time_t now_s = time(NULL);
+    uint8_t count = 0;
+    read_end = acked_pos;
+    while (count < max && record_read(f, &header, text)) {
+        if (header.kind == JOURNAL_CMD && header.seq > acked) {
+            if (expired_at(header, now_ms, now_s)) {
+                if (header.seq > expired_seq) {
+                    expired++;
+                    expired_seq = header.seq;
+                }
+            } else {
+                out[count].seq = header.seq;
+                out[count].type = header.type;
+                memcpy(out[count].text, text, header.len + 1);
+                count++;
+            }
+            *last = header.seq;
+        }
+        read_end = f.position();
+    }
+
+    if (count == 0 && *last == 0) {
+        *last = last_seq; // The rest is torn or missing, give it up
+    }
+    read_last = *last;
+    return count;
+}
+
+void JOURNAL::ack(uint32_t seq) {
+    if (seq <= acked) return;
+    acked = seq;
+
+    if (!pending()) {
+        // Everything is done, start over with an empty file
+        LittleFS.remove(JOURNAL_PATH);
+        bytes = acked_pos = read_end = 0;
+        return;
+    }
+
+    journal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.kind = JOURNAL_ACK;
+    header.seq = seq;
+    header.check = record_check(header, "");
+    write(header, "");
+
+    // After a partial ack the next read() starts at the same place and
+    // skips what is done by seq
+    if (seq == read_last) {
+        acked_pos = read_end;
+    }
+}
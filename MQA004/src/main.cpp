@@ -5,6 +5,11 @@
 #include "CST816D.h"
 #include "moonraker.h"
 #include "crowpanel.h"
+#include "farm.h"
+#include "temp_history.h"
+#include "latency_hist.h"
+#include "series.h"
+#include "files.h"
 
 // I/O expander definitions
 #define PI4IO_I2C_ADDR 0x43
@@ -20,6 +25,21 @@
 // Screen buffer size
 #define buf_size 120
 
+#define COMPLETION_INTERVAL 50 // Period of the timer running command callbacks
+#define POPUP_TIMEOUT 5000     // Lifetime of a popup without close button
+#define GRID_TILE_WIDTH 80     // Print farm tiles, two per row of the grid
+#define GRID_TILE_HEIGHT 52
+#define CHART_WIDTH TEMP_CHART_POINTS // Plot area, the round display cuts the corners
+#define CHART_HEIGHT 120
+#define HISTORY_RESTORE_WAIT 30000  // Longest the history waits for the clock to reload it from flash
+#define HISTORY_RESTORE_CHUNK 64    // Flash samples reloaded per tick of the restore timer
+#define HISTORY_RESTORE_TICK 20     // ms between those ticks, the UI stays responsive meanwhile
+#define FILES_ROW_HEIGHT 40    // File browser rows, name over size or print time
+#define FILES_LIST_WIDTH 180
+#define FILES_LIST_HEIGHT 160
+#define FILES_ROWS (FILES_LIST_HEIGHT / FILES_ROW_HEIGHT + 2) // Row objects recycled while scrolling
+#define FILES_PAGE 100         // Files per page of the browser, a page stays within LVGL's 8191 px coordinates
+
 // Display driver
 #include <LovyanGFX.hpp>
 
@@ -87,6 +107,40 @@ static lv_color_t buf[2][screenWidth * buf_size];
 lv_obj_t *printer_status_label;
 lv_obj_t *nozzle_temp_label;
 lv_obj_t *bed_temp_label;
+lv_obj_t *control_btns[4];  // Disabled while the main screen shows a watched printer
+lv_obj_t *main_screen;
+lv_obj_t *grid_screen;      // Print farm overview, NULL without farm printers
+lv_obj_t *grid_tiles[FARM_MAX];
+lv_obj_t *grid_labels[FARM_MAX];
+lv_obj_t *chart_screen;     // Temperature history of moonraker's printer
+lv_obj_t *chart;
+lv_chart_series_t *chart_series[HEATER_COUNT];
+lv_obj_t *chart_label;
+lv_obj_t *files_screen;     // G-code files of moonraker's printer
+lv_obj_t *files_list;
+lv_obj_t *files_spacer;     // Gives the list the height of the page, rows are placed over it
+lv_obj_t *files_label;
+lv_obj_t *files_newer;      // Rows above and below the page turning it
+lv_obj_t *files_older;
+
+// Temperature history, sampled and charted on the LVGL task only
+TEMP_HISTORY<TEMP_HISTORY_LEN> temp_history;
+static lv_coord_t chart_x[HEATER_COUNT][TEMP_CHART_POINTS];
+static lv_coord_t chart_y[HEATER_COUNT][TEMP_CHART_POINTS];
+static uint32_t chart_added;     // temp_history.added when the chart was drawn
+LATENCY_HIST chart_draw;         // Chart redraw time, downsampling and rendering
+static uint32_t chart_lttb_us;   // Of it, downsampling both series the last time
+
+// File browser rows. Only FILES_ROWS row objects exist, entry i is shown by
+// row i % FILES_ROWS, so scrolling by a row rebinds a single one.
+static lv_obj_t *files_rows[FILES_ROWS];
+static lv_obj_t *files_names[FILES_ROWS];
+static lv_obj_t *files_details[FILES_ROWS];
+static int32_t files_bound[FILES_ROWS];    // Index entry shown by each row, -1 for none
+static uint8_t files_bound_meta[FILES_ROWS]; // Its files.meta[] state when it was drawn
+static uint8_t files_shown = FILES_EMPTY;  // files.state the list was last laid out for
+static uint16_t files_page;                // Page shown, 0 the newest files
+static char files_start[CMD_TEXT_LEN];     // Request of the print being confirmed
 
 // I/O expander functions
 void init_IO_extender()
@@ -164,13 +218,55 @@ static void my_touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data
 // Function prototypes
 void create_ui(void);
 void update_ui(void);
+void update_grid(void);
+void update_chart(void);
+void update_files(void);
 
 // Timer for UI updates
 lv_timer_t *ui_timer;
 
 void update_ui_cb(lv_timer_t *timer)
 {
-  update_ui();
+  if (grid_screen != NULL && lv_scr_act() == grid_screen)
+    update_grid();
+  else if (lv_scr_act() == chart_screen)
+    update_chart();
+  else if (lv_scr_act() == files_screen)
+    update_files();
+  else
+    update_ui();
+}
+
+// Snapshot and link of grid tile i, 0 being moonraker's printer. The link
+// of that one is only told apart from WiFi by Klippy's readiness.
+static bool printer_state(uint8_t i, moonraker_data_t *data, uint32_t *version, int *link)
+{
+  bool wifi = wifi_get_connect_status() == WIFI_STATUS_CONNECTED;
+  if (i == 0)
+  {
+    *link = !wifi ? FARM_LINK_DOWN : moonraker.unready ? FARM_LINK_UNREADY : FARM_LINK_READY;
+    return moonraker.snapshot.read(data, version);
+  }
+  farm_printer_t &printer = farm.printers[i - 1];
+  *link = wifi ? printer.link.load() : FARM_LINK_DOWN;
+  return printer.snapshot.read(data, version);
+}
+
+static const char *status_text(const moonraker_data_t &data)
+{
+  if (data.printing)
+    return "PRINTING";
+  if (data.homing)
+    return "HOMING";
+  if (data.probing)
+    return "PROBING";
+  if (data.qgling)
+    return "QGL";
+  if (data.heating_nozzle)
+    return "HEATING NOZZLE";
+  if (data.heating_bed)
+    return "HEATING BED";
+  return "IDLE";
 }
 
 void update_ui()
@@ -187,39 +283,52 @@ void update_ui()
     lastStatusCheck = millis();
   }
 
-  if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED && !moonraker.unready)
+  static moonraker_data_t data;
+  static uint32_t lastVersion = 0;
+  static int lastLink = -1;
+  static int lastFocus = 0;
+  uint8_t focus = farm.focus.load();
+  bool wifi = wifi_get_connect_status() == WIFI_STATUS_CONNECTED;
+  int link;
+  uint32_t version = lastVersion;
+
+  // Consistent copy of the printer state, without blocking the Moonraker task
+  if (!printer_state(focus, &data, &version, &link) && link == FARM_LINK_READY)
   {
-    // Update printer status text
-    const char *status_text = "IDLE";
+    return; // Moonraker task is mid-update, try again next tick
+  }
+  bool online = link == FARM_LINK_READY;
 
-    if (moonraker.data.printing)
-    {
-      status_text = "PRINTING";
-    }
-    else if (moonraker.data.homing)
-    {
-      status_text = "HOMING";
-    }
-    else if (moonraker.data.probing)
-    {
-      status_text = "PROBING";
-    }
-    else if (moonraker.data.qgling)
-    {
-      status_text = "QGL";
-    }
-    else if (moonraker.data.heating_nozzle)
-    {
-      status_text = "HEATING NOZZLE";
-    }
-    else if (moonraker.data.heating_bed)
+  // A watched printer is only shown, commands go to moonraker's printer
+  if (focus != lastFocus)
+  {
+    for (lv_obj_t *btn : control_btns)
     {
-      status_text = "HEATING BED";
+      if (focus == 0)
+        lv_obj_clear_state(btn, LV_STATE_DISABLED);
+      else
+        lv_obj_add_state(btn, LV_STATE_DISABLED);
     }
+    lastFocus = focus;
+    lastLink = -1;
+  }
 
-    // Update status label with format "STATE"
-    char status_buf[30];
-    snprintf(status_buf, sizeof(status_buf), "%s", status_text);
+  // Nothing to redraw if neither the state nor the connection changed
+  if (version == lastVersion && link == lastLink)
+  {
+    return;
+  }
+  lastVersion = version;
+  lastLink = link;
+
+  if (online)
+  {
+    // Update status label with format "STATE", or "name: STATE" for a watched printer
+    char status_buf[40];
+    if (focus == 0)
+      snprintf(status_buf, sizeof(status_buf), "%s", status_text(data));
+    else
+      snprintf(status_buf, sizeof(status_buf), "%s: %s", farm.printers[focus - 1].label, status_text(data));
     lv_label_set_text(printer_status_label, status_buf);
 
     // Update temperature displays
@@ -227,8 +336,8 @@ void update_ui()
     char bed_text[20];
 
     // Format temperatures as shown in the image: "150 °C" and "40 °C"
-    snprintf(nozzle_text, sizeof(nozzle_text), "%d °C", moonraker.data.nozzle_actual);
-    snprintf(bed_text, sizeof(bed_text), "%d °C", moonraker.data.bed_actual);
+    snprintf(nozzle_text, sizeof(nozzle_text), "%d °C", data.nozzle_actual);
+    snprintf(bed_text, sizeof(bed_text), "%d °C", data.bed_actual);
 
     // Update temperature labels directly
     lv_label_set_text(nozzle_temp_label, nozzle_text);
@@ -237,10 +346,14 @@ void update_ui()
   else
   {
     // Not connected
-    if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED)
+    if (!wifi)
     {
       lv_label_set_text(printer_status_label, "Connecting...");
     }
+    else if (focus != 0)
+    {
+      lv_label_set_text_fmt(printer_status_label, "%s: Disconnected", farm.printers[focus - 1].label);
+    }
     else
     {
       lv_label_set_text(printer_status_label, "Disconnected");
@@ -251,16 +364,330 @@ void update_ui()
   }
 }
 
+// Print farm tiles: gray offline, orange while Klippy is not ready, green
+// printing, blue otherwise
+void update_grid()
+{
+  static char moonraker_label[FARM_LABEL_LEN];
+  if (moonraker_label[0] == 0)
+  {
+    farm_label(moonraker.moonraker_ip, moonraker_label, sizeof(moonraker_label));
+  }
+
+  uint8_t focus = farm.focus.load();
+  for (uint8_t i = 0; i <= farm.count; i++)
+  {
+    moonraker_data_t data;
+    uint32_t version;
+    int link;
+    if (!printer_state(i, &data, &version, &link) && link == FARM_LINK_READY)
+    {
+      continue; // Mid-update, next tick
+    }
+
+    const char *label = i == 0 ? moonraker_label : farm.printers[i - 1].label;
+    lv_color_t color = lv_color_make(90, 90, 90);
+    if (link == FARM_LINK_UNREADY)
+    {
+      color = lv_color_make(200, 120, 0);
+      lv_label_set_text_fmt(grid_labels[i], "%s\nNOT READY", label);
+    }
+    else if (link == FARM_LINK_READY && data.printing)
+    {
+      color = lv_color_make(0, 140, 60);
+      lv_label_set_text_fmt(grid_labels[i], "%s\n%u%%  %d °C", label, data.progress, data.nozzle_actual);
+    }
+    else if (link == FARM_LINK_READY)
+    {
+      color = lv_color_make(0, 90, 170);
+      lv_label_set_text_fmt(grid_labels[i], "%s\n%s", label, status_text(data));
+    }
+    else
+    {
+      lv_label_set_text_fmt(grid_labels[i], "%s\nOFFLINE", label);
+    }
+    lv_obj_set_style_bg_color(grid_tiles[i], color, 0);
+    lv_obj_set_style_border_width(grid_tiles[i], i == focus ? 2 : 0, 0);
+  }
+}
+
+// Flash scan refilling the history, NULL once done
+static SERIES_QUERY *history_query = NULL;
+static time_t history_now;        // Wall clock when the scan started
+static uint32_t history_now_ms;   // millis() then
+
+// Fill the history with what the flash has of the time it covers, before
+// this boot included. Up to two hours of samples are read a chunk per
+// tick, a whole scan in one LVGL callback would freeze the UI.
+static void history_restore_cb(lv_timer_t *timer)
+{
+  series_sample_t sample;
+  for (uint16_t n = 0; n < HISTORY_RESTORE_CHUNK; n++)
+  {
+    if (!history_query->next(&sample))
+    {
+      delete history_query;
+      history_query = NULL;
+      lv_timer_del(timer);
+      return;
+    }
+    if (sample.value[SERIES_STATE] & SERIES_STATE_UNREADY)
+      continue;
+    // As a millis() time, negative ages wrap like millis() itself
+    temp_history.add(history_now_ms - (uint32_t)(history_now - sample.time) * 1000, sample.value[SERIES_NOZZLE],
+                     sample.value[SERIES_BED]);
+  }
+}
+
+// Temperatures of moonraker's printer every TEMP_HISTORY_INTERVAL while
+// it is online, gaps show as straight lines. Once the clock is set the
+// flash log reloads the history first, so it survives a reset.
+void history_cb(lv_timer_t *timer)
+{
+  static bool restored = false;
+  if (!restored)
+  {
+    time_t now = time(NULL);
+    if ((unsigned long)now < JOURNAL_CLOCK_VALID && millis() < HISTORY_RESTORE_WAIT)
+    {
+      return;
+    }
+    if ((unsigned long)now >= JOURNAL_CLOCK_VALID)
+    {
+      uint32_t span = (uint32_t)TEMP_HISTORY_LEN * TEMP_HISTORY_INTERVAL / 1000;
+      history_now = now;
+      history_now_ms = millis();
+      history_query = new SERIES_QUERY(series, now - span, now);
+      lv_timer_create(history_restore_cb, HISTORY_RESTORE_TICK, NULL);
+    }
+    restored = true;
+  }
+  if (history_query != NULL)
+  {
+    return; // New samples go after the reloaded ones
+  }
+
+  moonraker_data_t data;
+  uint32_t version;
+  if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED || moonraker.unready ||
+      !moonraker.snapshot.read(&data, &version))
+  {
+    return;
+  }
+  temp_history.add(millis(), data.nozzle_actual, data.bed_actual);
+}
+
+// Redraw the chart if samples were added since. Each heater is reduced to
+// at most one point per pixel column, so the cost does not grow with the
+// history.
+void update_chart()
+{
+  if (temp_history.added == chart_added)
+  {
+    return;
+  }
+  chart_added = temp_history.added;
+
+  unsigned long start = micros();
+  uint16_t index[TEMP_CHART_POINTS];
+  uint16_t points = 0;
+  uint32_t span = temp_history.span();
+  int16_t low = INT16_MAX;
+  int16_t high = INT16_MIN;
+  for (uint8_t h = 0; h < HEATER_COUNT; h++)
+  {
+    points = temp_history.downsample(h, index, TEMP_CHART_POINTS);
+    uint32_t first = points ? temp_history.at(index[0]).time : 0;
+    for (uint16_t i = 0; i < points; i++)
+    {
+      const temp_sample_t &sample = temp_history.at(index[i]);
+      chart_x[h][i] = span ? (uint64_t)(sample.time - first) * (CHART_WIDTH - 1) / span : 0;
+      chart_y[h][i] = sample.temp[h];
+      if (sample.temp[h] < low)
+        low = sample.temp[h];
+      if (sample.temp[h] > high)
+        high = sample.temp[h];
+    }
+  }
+  chart_lttb_us = micros() - start;
+
+  if (points == 0)
+  {
+    return;
+  }
+  lv_chart_set_point_count(chart, points);
+  lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, low - 5, high + 5);
+  lv_label_set_text_fmt(chart_label, "%lu min, %d-%d °C", (unsigned long)(span / 60000), low, high);
+  lv_chart_refresh(chart);
+  lv_refr_now(NULL);
+  chart_draw.add((micros() - start) / 1000);
+}
+
+// First entry of the page shown, and where its rows start below the
+// "Newer files" row
+static uint16_t files_page_first()
+{
+  return files_page * FILES_PAGE;
+}
+
+static lv_coord_t files_page_top()
+{
+  return files_page > 0 ? FILES_ROW_HEIGHT : 0;
+}
+
+// Bind the rows in view to their index entries, asking files_task for
+// the metadata of new ones. The index is only read while it is ready.
+static void files_bind_rows()
+{
+  bool ready = files.state.load(std::memory_order_acquire) == FILES_READY;
+  int32_t first = (lv_obj_get_scroll_y(files_list) - files_page_top()) / FILES_ROW_HEIGHT;
+  if (first < 0)
+    first = 0;
+  first += files_page_first();
+  int32_t end = files_page_first() + FILES_PAGE;
+  if (ready && end > files.index.count)
+    end = files.index.count;
+  files.visible.store(first, std::memory_order_relaxed);
+
+  for (int32_t i = first; i < first + FILES_ROWS; i++)
+  {
+    uint8_t r = i % FILES_ROWS;
+    if (!ready || i >= end)
+    {
+      lv_obj_add_flag(files_rows[r], LV_OBJ_FLAG_HIDDEN);
+      files_bound[r] = -1;
+      continue;
+    }
+
+    files.request_meta(i);
+    uint8_t meta = files.meta[i].load(std::memory_order_acquire);
+    if (files_bound[r] == i && files_bound_meta[r] == meta)
+      continue;
+
+    const files_entry_t &entry = files.index.at(i);
+    const char *path = files.index.path(i);
+    const char *name = strrchr(path, '/');
+    lv_label_set_text(files_names[r], name != NULL ? name + 1 : path);
+    if (meta == META_READY)
+      lv_label_set_text_fmt(files_details[r], "%lu KB  %lu min  %lu m", (unsigned long)(entry.size / 1024),
+                            (unsigned long)(entry.estimated_time / 60), (unsigned long)(entry.filament / 1000));
+    else
+      lv_label_set_text_fmt(files_details[r], "%lu KB", (unsigned long)(entry.size / 1024));
+    lv_obj_set_y(files_rows[r], files_page_top() + (i - files_page_first()) * FILES_ROW_HEIGHT);
+    lv_obj_clear_flag(files_rows[r], LV_OBJ_FLAG_HIDDEN);
+    files_bound[r] = i;
+    files_bound_meta[r] = meta;
+  }
+}
+
+// Size the list for files_page and its page turning rows, at_end to
+// continue from the bottom of the page
+static void files_layout(bool at_end)
+{
+  bool ready = files.state.load(std::memory_order_acquire) == FILES_READY;
+  uint16_t count = ready ? files.index.count : 0;
+  uint16_t rows = count > files_page_first() ? count - files_page_first() : 0;
+  if (rows > FILES_PAGE)
+    rows = FILES_PAGE;
+  bool older = files_page_first() + rows < count;
+  lv_coord_t bottom = files_page_top() + rows * FILES_ROW_HEIGHT;
+
+  lv_obj_set_height(files_spacer, bottom + (older ? FILES_ROW_HEIGHT : 0));
+  if (files_page > 0)
+    lv_obj_clear_flag(files_newer, LV_OBJ_FLAG_HIDDEN);
+  else
+    lv_obj_add_flag(files_newer, LV_OBJ_FLAG_HIDDEN);
+  lv_obj_set_y(files_older, bottom);
+  if (older)
+    lv_obj_clear_flag(files_older, LV_OBJ_FLAG_HIDDEN);
+  else
+    lv_obj_add_flag(files_older, LV_OBJ_FLAG_HIDDEN);
+  for (uint8_t r = 0; r < FILES_ROWS; r++)
+    files_bound[r] = -1;
+  lv_obj_update_layout(files_list);
+  lv_obj_scroll_to_y(files_list, at_end ? LV_COORD_MAX : 0, LV_ANIM_OFF);
+
+  if (!ready)
+    lv_label_set_text(files_label, files_shown == FILES_LOADING ? "Loading..." : "No file list");
+  else if (count > FILES_PAGE)
+    lv_label_set_text_fmt(files_label, "%u-%u of %u%s", files_page_first() + 1, files_page_first() + rows, count,
+                          files.index.dropped > 0 ? " newest" : "");
+  else
+    lv_label_set_text_fmt(files_label, "%u files", count);
+}
+
+// Lay the list out again when a listing starts or ends, then rebind
+void update_files()
+{
+  uint8_t state = files.state.load(std::memory_order_acquire);
+  if (state != files_shown)
+  {
+    files_shown = state;
+    files_page = 0;
+    files_layout(false);
+  }
+  files_bind_rows();
+}
+
+// Modal message box, e.g. for the reason a command was rejected. A box
+// without a close button goes away by itself.
+static void lv_popup_warning(const char *warning, bool clickable)
+{
+  lv_obj_t *box = lv_msgbox_create(NULL, "Warning", warning, NULL, clickable);
+  lv_obj_set_width(box, 200);
+  lv_obj_center(box);
+  if (!clickable)
+  {
+    lv_obj_del_delayed(box, POPUP_TIMEOUT);
+  }
+}
+
+// Outcome of a button command, user is the command's name. Runs on the
+// LVGL task, see MOONRAKER::run_completions().
+static void command_done_cb(const moonraker_done_t &done, void *user)
+{
+  const char *name = (const char *)user;
+  char text[40];
+
+  switch (done.result)
+  {
+  case REQUEST_OK:
+    snprintf(text, sizeof(text), "%s done", name);
+    break;
+  case REQUEST_REJECTED:
+    snprintf(text, sizeof(text), "%s rejected", name);
+    if (done.message[0])
+    {
+      lv_popup_warning(done.message, true);
+    }
+    break;
+  case REQUEST_DROPPED:
+    snprintf(text, sizeof(text), "%s not sent", name);
+    break;
+  case REQUEST_DEFERRED:
+    snprintf(text, sizeof(text), "%s saved offline", name); // No further callback
+    break;
+  default:
+    snprintf(text, sizeof(text), "%s: no reply", name); // May still be running
+    break;
+  }
+  lv_label_set_text(printer_status_label, text);
+}
+
+// Completed commands are handed over here so their callbacks run on the LVGL task
+void completion_cb(lv_timer_t *timer)
+{
+  moonraker.run_completions();
+}
+
 // Button event handlers
 static void home_btn_event_cb(lv_event_t *e)
 {
   if (lv_event_get_code(e) == LV_EVENT_CLICKED)
   {
-    if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED && !moonraker.unready)
-    {
-      moonraker.post_gcode_to_queue("G28"); // Home all axes
-      lv_label_set_text(printer_status_label, "Homing...");
-    }
+    // Offline presses are kept in the journal until the printer is back
+    moonraker.post_gcode_to_queue("G28", command_done_cb, (void *)"Homing"); // Home all axes
+    lv_label_set_text(printer_status_label, "Homing...");
   }
 }
 
@@ -268,11 +695,8 @@ static void qgl_btn_event_cb(lv_event_t *e)
 {
   if (lv_event_get_code(e) == LV_EVENT_CLICKED)
   {
-    if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED && !moonraker.unready)
-    {
-      moonraker.post_gcode_to_queue("QUAD_GANTRY_LEVEL"); // Run QGL
-      lv_label_set_text(printer_status_label, "QGL Running...");
-    }
+    moonraker.post_gcode_to_queue("QUAD_GANTRY_LEVEL", command_done_cb, (void *)"QGL"); // Run QGL
+    lv_label_set_text(printer_status_label, "QGL Running...");
   }
 }
 
@@ -280,12 +704,10 @@ static void pla_btn_event_cb(lv_event_t *e)
 {
   if (lv_event_get_code(e) == LV_EVENT_CLICKED)
   {
-    if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED && !moonraker.unready)
-    {
-      moonraker.post_gcode_to_queue("M104 S220 T0"); // Set nozzle to 220°C for PLA
-      moonraker.post_gcode_to_queue("M140 S40");     // Set bed to 40°C for PLA
-      lv_label_set_text(printer_status_label, "Heating for PLA...");
-    }
+    // Nozzle to 220°C and bed to 40°C for PLA, queued together so they go out in one script
+    static const char * const preheat[] = { "M104 S220 T0", "M140 S40" };
+    moonraker.post_gcode_to_queue(preheat, 2, command_done_cb, (void *)"PLA preheat");
+    lv_label_set_text(printer_status_label, "Heating for PLA...");
   }
 }
 
@@ -293,19 +715,272 @@ static void abs_btn_event_cb(lv_event_t *e)
 {
   if (lv_event_get_code(e) == LV_EVENT_CLICKED)
   {
-    if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED && !moonraker.unready)
-    {
-      moonraker.post_gcode_to_queue("M104 S250 T0"); // Set nozzle to 250°C for ABS
-      moonraker.post_gcode_to_queue("M140 S100");    // Set bed to 100°C for ABS
-      lv_label_set_text(printer_status_label, "Heating for ABS...");
-    }
+    // Nozzle to 250°C and bed to 100°C for ABS, queued together so they go out in one script
+    static const char * const preheat[] = { "M104 S250 T0", "M140 S100" };
+    moonraker.post_gcode_to_queue(preheat, 2, command_done_cb, (void *)"ABS preheat");
+    lv_label_set_text(printer_status_label, "Heating for ABS...");
+  }
+}
+
+// Grid tile clicked, user data is its index: show that printer on the main screen
+static void grid_tile_event_cb(lv_event_t *e)
+{
+  farm.focus.store((uint8_t)(uintptr_t)lv_event_get_user_data(e));
+  lv_scr_load_anim(main_screen, LV_SCR_LOAD_ANIM_MOVE_RIGHT, 200, 0, false);
+  update_ui();
+}
+
+// A print start is only sent while the printer is reachable, it is never
+// journaled to start minutes later
+static bool files_can_start(void)
+{
+  if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED || moonraker.unready)
+  {
+    lv_popup_warning("Printer not ready", false);
+    return false;
+  }
+  return true;
+}
+
+// Print confirmed: the box's first button. The link is checked again, it
+// may have dropped while the box was open.
+static void files_confirm_event_cb(lv_event_t *e)
+{
+  lv_obj_t *box = lv_event_get_current_target(e);
+  if (lv_msgbox_get_active_btn(box) == 0 && files_can_start())
+  {
+    moonraker.post_to_queue(files_start, command_done_cb, (void *)"Print", CMD_NO_JOURNAL);
+    lv_scr_load_anim(main_screen, LV_SCR_LOAD_ANIM_MOVE_LEFT, 200, 0, false);
+    update_ui();
+    lv_label_set_text(printer_status_label, "Starting print...");
+  }
+  lv_msgbox_close_async(box); // Still sending this event
+}
+
+// File row clicked, user data is the row: ask before starting its print.
+// The request is kept now, the index may be reloaded while the box is open.
+static void files_row_event_cb(lv_event_t *e)
+{
+  static const char *btns[] = {"Print", "Cancel", ""};
+  int32_t i = files_bound[(uintptr_t)lv_event_get_user_data(e)];
+  if (i < 0 || files.state.load(std::memory_order_acquire) != FILES_READY)
+    return;
+  if (!files_can_start())
+    return;
+
+  const char *path = files.index.path(i);
+  files_query(files_start, sizeof(files_start), FILES_START_PATH, path); // Fits, the index keeps no longer ones
+  const char *name = strrchr(path, '/');
+  lv_obj_t *box = lv_msgbox_create(NULL, "Print", name != NULL ? name + 1 : path, btns, false);
+  lv_obj_set_width(box, 200);
+  lv_obj_center(box);
+  lv_obj_add_event_cb(box, files_confirm_event_cb, LV_EVENT_VALUE_CHANGED, NULL);
+}
+
+// Swipe left on the main screen for the print farm grid, right for the
+// file browser and up for the temperature chart, the other way to go back
+static void screen_gesture_event_cb(lv_event_t *e)
+{
+  lv_obj_t *screen = lv_event_get_target(e);
+  lv_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
+  if (screen == main_screen && dir == LV_DIR_LEFT && grid_screen != NULL)
+  {
+    update_grid();
+    lv_scr_load_anim(grid_screen, LV_SCR_LOAD_ANIM_MOVE_LEFT, 200, 0, false);
+  }
+  else if (screen == main_screen && dir == LV_DIR_TOP)
+  {
+    chart_added = temp_history.added - 1; // Redrawn once shown
+    lv_scr_load_anim(chart_screen, LV_SCR_LOAD_ANIM_MOVE_TOP, 200, 0, false);
+  }
+  else if (screen == main_screen && dir == LV_DIR_RIGHT)
+  {
+    // Listed once, then again when older than FILES_REFRESH
+    uint8_t state = files.state.load(std::memory_order_acquire);
+    if (state == FILES_EMPTY || state == FILES_FAILED || (state == FILES_READY && millis() - files.loaded_at >= FILES_REFRESH))
+      files.request_list();
+    update_files();
+    lv_scr_load_anim(files_screen, LV_SCR_LOAD_ANIM_MOVE_RIGHT, 200, 0, false);
+  }
+  else if ((screen == grid_screen && dir == LV_DIR_RIGHT) || (screen == chart_screen && dir == LV_DIR_BOTTOM) ||
+           (screen == files_screen && dir == LV_DIR_LEFT))
+  {
+    lv_scr_load_anim(main_screen, dir == LV_DIR_RIGHT  ? LV_SCR_LOAD_ANIM_MOVE_RIGHT :
+                                  dir == LV_DIR_LEFT   ? LV_SCR_LOAD_ANIM_MOVE_LEFT :
+                                                         LV_SCR_LOAD_ANIM_MOVE_BOTTOM,
+                     200, 0, false);
+    update_ui();
+  }
+}
+
+// Nozzle red and bed blue, x in pixels from the oldest sample
+static void create_chart()
+{
+  chart_screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(chart_screen, lv_color_black(), 0);
+  lv_obj_add_event_cb(chart_screen, screen_gesture_event_cb, LV_EVENT_GESTURE, NULL);
+
+  chart = lv_chart_create(chart_screen);
+  lv_obj_set_size(chart, CHART_WIDTH, CHART_HEIGHT);
+  lv_obj_center(chart);
+  lv_obj_clear_flag(chart, LV_OBJ_FLAG_CLICKABLE); // Swipes reach the screen
+  lv_obj_set_style_bg_opa(chart, LV_OPA_TRANSP, 0);
+  lv_obj_set_style_border_width(chart, 0, 0);
+  lv_obj_set_style_pad_all(chart, 0, 0);
+  lv_obj_set_style_size(chart, 0, LV_PART_INDICATOR); // No point markers
+  lv_chart_set_type(chart, LV_CHART_TYPE_SCATTER);
+  lv_chart_set_div_line_count(chart, 4, 0);
+  lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_X, 0, CHART_WIDTH - 1);
+  lv_chart_set_point_count(chart, 0);
+
+  chart_series[HEATER_NOZZLE] = lv_chart_add_series(chart, lv_color_make(230, 60, 40), LV_CHART_AXIS_PRIMARY_Y);
+  chart_series[HEATER_BED] = lv_chart_add_series(chart, lv_color_make(40, 120, 230), LV_CHART_AXIS_PRIMARY_Y);
+  for (uint8_t h = 0; h < HEATER_COUNT; h++)
+  {
+    lv_chart_set_ext_x_array(chart, chart_series[h], chart_x[h]);
+    lv_chart_set_ext_y_array(chart, chart_series[h], chart_y[h]);
+  }
+
+  chart_label = lv_label_create(chart_screen);
+  lv_label_set_text(chart_label, "No samples yet");
+  lv_obj_set_style_text_color(chart_label, lv_color_white(), 0);
+  lv_obj_set_style_text_font(chart_label, &lv_font_montserrat_14, 0);
+  lv_obj_align(chart_label, LV_ALIGN_TOP_MID, 0, 30);
+}
+
+static void files_scroll_event_cb(lv_event_t *e)
+{
+  files_bind_rows();
+}
+
+// "Newer files" or "Older files" clicked, user data is the page step
+static void files_page_event_cb(lv_event_t *e)
+{
+  int step = (int)(intptr_t)lv_event_get_user_data(e);
+  if (files.state.load(std::memory_order_acquire) != FILES_READY || (step < 0 && files_page == 0))
+    return;
+  files_page += step;
+  files_layout(step < 0);
+  files_bind_rows();
+}
+
+static lv_obj_t *create_files_page_row(const char *text, int step)
+{
+  lv_obj_t *row = lv_obj_create(files_list);
+  lv_obj_remove_style_all(row);
+  lv_obj_set_size(row, FILES_LIST_WIDTH, FILES_ROW_HEIGHT - 4);
+  lv_obj_add_flag(row, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_HIDDEN);
+  lv_obj_add_event_cb(row, files_page_event_cb, LV_EVENT_CLICKED, (void *)(intptr_t)step);
+
+  lv_obj_t *label = lv_label_create(row);
+  lv_label_set_text(label, text);
+  lv_obj_set_style_text_color(label, lv_color_make(40, 120, 230), 0);
+  lv_obj_set_style_text_font(label, &lv_font_montserrat_14, 0);
+  lv_obj_center(label);
+  return row;
+}
+
+// Scrollable list as tall as a page of files, over which the few row
+// objects are moved to where the view is
+static void create_files()
+{
+  files_screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(files_screen, lv_color_black(), 0);
+  lv_obj_add_event_cb(files_screen, screen_gesture_event_cb, LV_EVENT_GESTURE, NULL);
+
+  files_label = lv_label_create(files_screen);
+  lv_obj_set_style_text_color(files_label, lv_color_white(), 0);
+  lv_obj_set_style_text_font(files_label, &lv_font_montserrat_14, 0);
+  lv_obj_align(files_label, LV_ALIGN_TOP_MID, 0, 20);
+
+  files_list = lv_obj_create(files_screen);
+  lv_obj_remove_style_all(files_list);
+  lv_obj_set_size(files_list, FILES_LIST_WIDTH, FILES_LIST_HEIGHT);
+  lv_obj_align(files_list, LV_ALIGN_TOP_MID, 0, 44);
+  lv_obj_set_scroll_dir(files_list, LV_DIR_VER);
+  lv_obj_add_event_cb(files_list, files_scroll_event_cb, LV_EVENT_SCROLL, NULL);
+
+  files_spacer = lv_obj_create(files_list);
+  lv_obj_remove_style_all(files_spacer);
+  lv_obj_set_size(files_spacer, 1, 0);
+  files_newer = create_files_page_row("Newer files", -1);
+  files_older = create_files_page_row("Older files", 1);
+
+  for (uint8_t r = 0; r < FILES_ROWS; r++)
+  {
+    lv_obj_t *row = lv_obj_create(files_list);
+    lv_obj_remove_style_all(row);
+    lv_obj_set_size(row, FILES_LIST_WIDTH, FILES_ROW_HEIGHT - 4);
+    lv_obj_set_style_radius(row, 8, 0);
+    lv_obj_set_style_bg_opa(row, LV_OPA_COVER, 0);
+    lv_obj_set_style_bg_color(row, lv_color_make(50, 50, 50), 0);
+    lv_obj_set_style_bg_color(row, lv_color_make(90, 90, 90), LV_STATE_PRESSED);
+    lv_obj_add_flag(row, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_event_cb(row, files_row_event_cb, LV_EVENT_CLICKED, (void *)(uintptr_t)r);
+
+    lv_obj_t *name = lv_label_create(row);
+    lv_obj_set_width(name, FILES_LIST_WIDTH - 12);
+    lv_label_set_long_mode(name, LV_LABEL_LONG_DOT);
+    lv_obj_set_style_text_color(name, lv_color_white(), 0);
+    lv_obj_set_style_text_font(name, &lv_font_montserrat_14, 0);
+    lv_obj_align(name, LV_ALIGN_TOP_LEFT, 6, 2);
+
+    lv_obj_t *details = lv_label_create(row);
+    lv_obj_set_style_text_color(details, lv_color_make(170, 170, 170), 0);
+    lv_obj_set_style_text_font(details, &lv_font_montserrat_12, 0);
+    lv_obj_align(details, LV_ALIGN_BOTTOM_LEFT, 6, -2);
+
+    files_rows[r] = row;
+    files_names[r] = name;
+    files_details[r] = details;
+    files_bound[r] = -1;
+  }
+}
+
+// One tile per printer, moonraker's own first, scrolling past six
+static void create_grid()
+{
+  grid_screen = lv_obj_create(NULL);
+  lv_obj_set_style_bg_color(grid_screen, lv_color_black(), 0);
+  lv_obj_add_event_cb(grid_screen, screen_gesture_event_cb, LV_EVENT_GESTURE, NULL);
+
+  // Square inside the round display
+  lv_obj_t *grid = lv_obj_create(grid_screen);
+  lv_obj_remove_style_all(grid);
+  lv_obj_set_size(grid, 2 * GRID_TILE_WIDTH + 8, 168);
+  lv_obj_center(grid);
+  lv_obj_set_flex_flow(grid, LV_FLEX_FLOW_ROW_WRAP);
+  lv_obj_set_style_pad_gap(grid, 8, 0);
+  lv_obj_set_scroll_dir(grid, LV_DIR_VER);
+
+  for (uint8_t i = 0; i <= farm.count; i++)
+  {
+    lv_obj_t *tile = lv_obj_create(grid);
+    lv_obj_remove_style_all(tile);
+    lv_obj_set_size(tile, GRID_TILE_WIDTH, GRID_TILE_HEIGHT);
+    lv_obj_set_style_radius(tile, 8, 0);
+    lv_obj_set_style_bg_opa(tile, LV_OPA_COVER, 0);
+    lv_obj_set_style_border_color(tile, lv_color_white(), 0);
+    lv_obj_add_flag(tile, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(tile, grid_tile_event_cb, LV_EVENT_CLICKED, (void *)(uintptr_t)i);
+
+    lv_obj_t *label = lv_label_create(tile);
+    lv_obj_set_width(label, GRID_TILE_WIDTH - 8);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_CLIP);
+    lv_obj_set_style_text_align(label, LV_TEXT_ALIGN_CENTER, 0);
+    lv_obj_set_style_text_color(label, lv_color_white(), 0);
+    lv_obj_set_style_text_font(label, &lv_font_montserrat_12, 0);
+    lv_obj_center(label);
+
+    grid_tiles[i] = tile;
+    grid_labels[i] = label;
   }
 }
 
 void create_ui()
 {
   // Set up a display with black background
-  lv_obj_t *main_screen = lv_scr_act();
+  main_screen = lv_scr_act();
   lv_obj_set_style_bg_color(main_screen, lv_color_black(), 0);
 
   // Create temperature display at the top
@@ -349,6 +1024,7 @@ void create_ui()
   lv_obj_set_style_radius(pla_btn, 20, 0);
   lv_obj_set_style_bg_color(pla_btn, lv_color_make(200, 200, 200), 0);                // Light gray
   lv_obj_set_style_bg_color(pla_btn, lv_color_make(150, 150, 150), LV_STATE_PRESSED); // Darker when pressed
+  lv_obj_set_style_bg_color(pla_btn, lv_color_make(80, 80, 80), LV_STATE_DISABLED);   // Watched printer shown
   lv_obj_add_event_cb(pla_btn, pla_btn_event_cb, LV_EVENT_CLICKED, NULL);
 
   lv_obj_t *pla_label = lv_label_create(pla_btn);
@@ -363,6 +1039,7 @@ void create_ui()
   lv_obj_set_style_radius(abs_btn, 20, 0);
   lv_obj_set_style_bg_color(abs_btn, lv_color_make(200, 200, 200), 0);                // Light gray
   lv_obj_set_style_bg_color(abs_btn, lv_color_make(150, 150, 150), LV_STATE_PRESSED); // Darker when pressed
+  lv_obj_set_style_bg_color(abs_btn, lv_color_make(80, 80, 80), LV_STATE_DISABLED);   // Watched printer shown
   lv_obj_add_event_cb(abs_btn, abs_btn_event_cb, LV_EVENT_CLICKED, NULL);
 
   lv_obj_t *abs_label = lv_label_create(abs_btn);
@@ -378,6 +1055,7 @@ void create_ui()
   lv_obj_set_style_radius(home_btn, 20, 0);
   lv_obj_set_style_bg_color(home_btn, lv_color_make(200, 200, 200), 0);                // Light gray
   lv_obj_set_style_bg_color(home_btn, lv_color_make(150, 150, 150), LV_STATE_PRESSED); // Darker when pressed
+  lv_obj_set_style_bg_color(home_btn, lv_color_make(80, 80, 80), LV_STATE_DISABLED);   // Watched printer shown
   lv_obj_add_event_cb(home_btn, home_btn_event_cb, LV_EVENT_CLICKED, NULL);
 
   lv_obj_t *home_label = lv_label_create(home_btn);
@@ -392,6 +1070,7 @@ void create_ui()
   lv_obj_set_style_radius(qgl_btn, 20, 0);
   lv_obj_set_style_bg_color(qgl_btn, lv_color_make(200, 200, 200), 0);                // Light gray
   lv_obj_set_style_bg_color(qgl_btn, lv_color_make(150, 150, 150), LV_STATE_PRESSED); // Darker when pressed
+  lv_obj_set_style_bg_color(qgl_btn, lv_color_make(80, 80, 80), LV_STATE_DISABLED);   // Watched printer shown
   lv_obj_add_event_cb(qgl_btn, qgl_btn_event_cb, LV_EVENT_CLICKED, NULL);
 
   lv_obj_t *qgl_label = lv_label_create(qgl_btn);
@@ -409,10 +1088,77 @@ void create_ui()
 
   // Store for updating
   printer_status_label = status_label;
+  control_btns[0] = pla_btn;
+  control_btns[1] = abs_btn;
+  control_btns[2] = home_btn;
+  control_btns[3] = qgl_btn;
+
+  create_chart();
+  create_files();
+  if (farm.count > 0)
+  {
+    create_grid();
+  }
+  lv_obj_add_event_cb(main_screen, screen_gesture_event_cb, LV_EVENT_GESTURE, NULL);
+}
+
+// Serial console: "stats" dumps the request telemetry as JSON,
+// "stats reset" clears it, "farm" dumps the print farm's, "history" the
+// temperature history's size and chart redraw time, "series" the flash
+// telemetry log's, "files" the file browser's
+static void serial_command()
+{
+  static char line[32];
+  static uint8_t len = 0;
+
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r')
+    {
+      if (len < sizeof(line) - 1)
+        line[len++] = c;
+      continue;
+    }
+    line[len] = 0;
+    len = 0;
+
+    if (strcmp(line, "stats") == 0)
+    {
+      moonraker.stats_json(Serial);
+    }
+    else if (strcmp(line, "stats reset") == 0)
+    {
+      moonraker.stats_reset();
+    }
+    else if (strcmp(line, "farm") == 0)
+    {
+      farm.stats_json(Serial);
+    }
+    else if (strcmp(line, "series") == 0)
+    {
+      series.stats_json(Serial);
+    }
+    else if (strcmp(line, "files") == 0)
+    {
+      files.stats_json(Serial);
+    }
+    else if (strcmp(line, "history") == 0)
+    {
+      Serial.printf("{\"samples\":%u,\"span\":%lu,\"bytes\":%u,\"bytes_per_hour\":%u,"
+                    "\"draws\":%lu,\"draw_avg\":%lu,\"draw_max\":%lu,\"lttb_us\":%lu}\n",
+                    temp_history.size(), (unsigned long)temp_history.span(), (unsigned)sizeof(temp_history),
+                    (unsigned)TEMP_HISTORY<TEMP_HISTORY_LEN>::bytes_per_hour(TEMP_HISTORY_INTERVAL),
+                    (unsigned long)chart_draw.count, (unsigned long)chart_draw.mean(),
+                    (unsigned long)chart_draw.max_ms, (unsigned long)chart_lttb_us);
+    }
+  }
 }
 
 void setup()
 {
+  Serial.begin(115200);
+
   // Initialize crowpanel settings
   crowpanel_init();
 
@@ -467,12 +1213,16 @@ void setup()
 
   // Initialize Moonraker
   moonraker_setup();
+  series.begin();
+  farm.begin();
 
   // Create the UI
   create_ui();
 
   // Create a timer for UI updates
   ui_timer = lv_timer_create(update_ui_cb, 1000, NULL);
+  lv_timer_create(completion_cb, COMPLETION_INTERVAL, NULL);
+  lv_timer_create(history_cb, TEMP_HISTORY_INTERVAL, NULL);
 
   // Create WiFi task
   xTaskCreatePinnedToCore(
@@ -495,11 +1245,38 @@ void setup()
       NULL,             // Task handle
       1                 // Core where the task should run
   );
+
+  // Create file browser task, lists files and fetches metadata on its own
+  // socket so a large listing never holds up polling
+  xTaskCreatePinnedToCore(
+      files_task,   // Function to implement the task
+      "Files Task", // Name of the task
+      6144,         // Stack size in words
+      NULL,         // Task input parameter
+      1,            // Priority of the task
+      NULL,         // Task handle
+      1             // Core where the task should run
+  );
+
+  // Create print farm task, polls every watched printer in turn
+  if (farm.count > 0)
+  {
+    xTaskCreatePinnedToCore(
+        farm_task,   // Function to implement the task
+        "Farm Task", // Name of the task
+        6144,        // Stack size in words
+        NULL,        // Task input parameter
+        1,           // Priority of the task
+        NULL,        // Task handle
+        1            // Core where the task should run
+    );
+  }
 }
 
 void loop()
 {
   // Call LVGL task handler
   lv_timer_handler();
+  serial_command();
   delay(5);
 }
\ No newline at end of file
@@ -1,232 +1,725 @@
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "moonraker.h"
 #include "crowpanel.h"
 
 // Connection parameters
-#define HTTP_TIMEOUT 10000  // 10 seconds timeout for normal requests
-#define HTTP_LONG_TIMEOUT 60000  // 60 seconds timeout for longer operations like G28
-#define MAX_RETRY_ATTEMPTS 3     // Maximum number of retry attempts for failed requests
-#define RETRY_DELAY 500          // Delay between retries in milliseconds
-
-void lv_popup_warning(const char * warning, bool clickable) {
-    // Silently handle warnings without serial output
-}
-
-String MOONRAKER::send_request(const char * type, String path) {
-    String ip = moonraker_ip;
-    String port = moonraker_port;
-    String url = "http://" + ip + ":" + port + path;
-    String response = "";
-    HTTPClient client;
-    int retry_count = 0;
-    bool requestSuccessful = false;
-    
-    // replace all " " space to "%20" for http
-    url.replace(" ", "%20");
-    
-    // Set longer timeout for POST requests (likely to be G-code that takes time)
-    int timeout = (strcmp(type, "POST") == 0) ? HTTP_LONG_TIMEOUT : HTTP_TIMEOUT;
-    
-    // Retry logic for more reliable connections
-    while (retry_count < MAX_RETRY_ATTEMPTS && !requestSuccessful) {
-        if (retry_count > 0) {
-            delay(RETRY_DELAY * retry_count); // Progressive delay
+#define HTTP_TIMEOUT 3000         // 3 seconds timeout for status requests on the LAN
+#define HTTP_LONG_TIMEOUT 60000   // 60 seconds timeout for longer operations like G28
+#define CONTROL_TIMEOUT 30000     // Pause and cancel answer once their macro has parked the head
+#define STATUS_QUERY_PATH "/printer/objects/query?" // Followed by the objects and fields of moonraker_schema[]
+#define WS_LOOP_INTERVAL 10      // Service period of the WebSocket connection
+
+#define FIELD(object, field, conv, member) \
+    { object, field, conv, offsetof(moonraker_data_t, member), sizeof(((moonraker_data_t *)0)->member) }
+
+constexpr moonraker_field_t moonraker_schema[] = {
+    { "webhooks",                          "state",          CONV_READY,       0, 0 },
+    FIELD("print_stats",                   "state",          CONV_PRINT_STATE, printing),
+    FIELD("virtual_sdcard",                "progress",       CONV_PERCENT,     progress),
+    FIELD("virtual_sdcard",                "file_path",      CONV_BASENAME,    file_path),
+    FIELD(NULL,                            "temperature",    CONV_INT16,       nozzle_actual),
+    FIELD(NULL,                            "target",         CONV_INT16,       nozzle_target),
+    FIELD("heater_bed",                    "temperature",    CONV_INT16,       bed_actual),
+    FIELD("heater_bed",                    "target",         CONV_INT16,       bed_target),
+    FIELD("gcode_macro _CROWPANEL_STATUS", "homing",         CONV_BOOL,        homing),
+    FIELD("gcode_macro _CROWPANEL_STATUS", "probing",        CONV_BOOL,        probing),
+    FIELD("gcode_macro _CROWPANEL_STATUS", "qgling",         CONV_BOOL,        qgling),
+    FIELD("gcode_macro _CROWPANEL_STATUS", "heating_nozzle", CONV_BOOL,        heating_nozzle),
+    FIELD("gcode_macro _CROWPANEL_STATUS", "heating_bed",    CONV_BOOL,        heating_bed),
+};
+const uint8_t moonraker_schema_num = sizeof(moonraker_schema) / sizeof(moonraker_schema[0]);
+
+static_assert(sizeof(moonraker_data_t) <= 255, "moonraker_field_t offsets are uint8_t");
+
+uint8_t moonraker_schema_next(uint8_t i) {
+    const char * object = moonraker_schema[i].object;
+    while (++i < moonraker_schema_num) {
+        const char * next = moonraker_schema[i].object;
+        if (next != object && (next == NULL || object == NULL || strcmp(next, object) != 0)) break;
+    }
+    return i;
+}
+
+// Only the message of a 400 reply is of interest
+static JsonDocument error_filter;
+
+// Parse the JSON body straight from the socket, chunked or not, so the
+// body is never copied into a String.
+//
+// With a hash, a body of up to len bytes is first read into buf while
+// being hashed, and parsed only if it differs from the body *hash came
+// from. Other bodies are parsed from the socket, see moonraker_hashable().
+// Returns REQUEST_OK, REQUEST_UNCHANGED, or REQUEST_RETRY on a bad body.
+moonraker_result_t moonraker_read_json(HTTP_CONN & http, JsonDocument & doc, const JsonDocument * filter,
+                                       char * buf, size_t len, uint32_t * hash) {
+    DeserializationError error;
+    int size = http.size;
+
+    bool hashed = hash != NULL && moonraker_hashable(http, len);
+    if (hash != NULL && !hashed) {
+        *hash = BODY_HASH_NONE; // Too big or chunked, always parsed
+    }
+
+    if (hashed) {
+        size_t n = http.read_body(buf, size);
+        if (n < (size_t)size) {
+            *hash = BODY_HASH_NONE;
+            return REQUEST_RETRY;
         }
-        
-        client.begin(url);
-        client.setTimeout(timeout);
-        
-        int code = client.sendRequest(type, "");
-        
-        // http request success
-        if (code > 0) {
-            response = client.getString();
-            
-            if (code >= 200 && code < 300) {
-                // Success (2xx response)
-                unconnected = false;
-                requestSuccessful = true;
-            } else if (code == 400) {
-                // Handle 400 Bad Request - often contains useful error info
-                requestSuccessful = true; // Consider this a "successful" request in terms of communication
-                unconnected = false;
-                
-                if (!response.isEmpty()) {
-                    JsonDocument json_parse;
-                    DeserializationError error = deserializeJson(json_parse, response);
-                    if (!error) {
-                        // Check if there's an error message
-                        if (json_parse.containsKey("error")) {
-                            JsonVariant errorObj = json_parse["error"];
-                            if (errorObj.containsKey("message")) {
-                                String msg = errorObj["message"].as<String>();
-                                
-                                msg.remove(0, 41); //  remove header {'error': 'WebRequestError', 'message':
-                                msg.remove(msg.length() - 2, 2); // remove tail }
-                                msg.replace("\\n", "\n");
-                                lv_popup_warning(msg.c_str(), true);
-                            }
-                        }
-                    }
-                }
-            } else {
-                // Other non-2xx responses
-                // For some errors, we should retry
-                if (code >= 500 || code == 408) { // Server errors or timeout
-                    retry_count++;
-                } else {
-                    // For client errors besides 400, don't retry
-                    requestSuccessful = true;
-                }
-            }
+        BODY_HASH body;
+        body.update(buf, n);
+        if (body.value() == *hash) {
+            return REQUEST_UNCHANGED;
+        }
+
+        if (filter != NULL) {
+            error = deserializeJson(doc, (const char *)buf, n, DeserializationOption::Filter(*filter));
         } else {
-            // HTTP request failed
-            // Connection-level errors should probably get retried
-            retry_count++;
-            
-            // Only set unconnected flag for GET requests to avoid false negatives during long operations
-            if (strcmp(type, "GET") == 0) {
-                unconnected = true;
-            }
+            error = deserializeJson(doc, (const char *)buf, n);
         }
-        
-        client.end(); // Free resources
+        *hash = error ? BODY_HASH_NONE : body.value();
+    } else if (filter != NULL) {
+        error = deserializeJson(doc, http, DeserializationOption::Filter(*filter));
+    } else {
+        error = deserializeJson(doc, http);
+    }
+    return error ? REQUEST_RETRY : REQUEST_OK;
+}
+
+// moonraker_read_json() on conn, hashing into poll_body. Records the peak
+// JSON heap.
+moonraker_result_t MOONRAKER::read_json(moonraker_conn_t & conn, JsonDocument & doc, const JsonDocument * filter,
+                                        uint32_t * hash) {
+    if (hash != NULL && !moonraker_hashable(conn.http, sizeof(poll_body))) conn.unhashed++;
+    conn.alloc.reset_peak();
+    moonraker_result_t result = moonraker_read_json(conn.http, doc, filter, poll_body, sizeof(poll_body), hash);
+    if (result == REQUEST_UNCHANGED) {
+        return result;
     }
 
-    return response;
+    conn.parse_peak = conn.alloc.peak;
+    if (conn.parse_peak > conn.parse_peak_max) {
+        conn.parse_peak_max = conn.parse_peak;
+    }
+    return result;
 }
 
-void MOONRAKER::http_post_loop(void) {
-    if (post_queue.count == 0) return;
-    
-    String request = post_queue.queue[post_queue.index_r];
-    send_request("POST", request);
-    
-    post_queue.count--;
-    post_queue.index_r = (post_queue.index_r + 1) % QUEUE_LEN;
+// Drain a body nobody reads, the socket has to be clean for reuse
+void MOONRAKER::skip_body(moonraker_conn_t & conn) {
+    char buf[64];
+    while (conn.http.read_body(buf, sizeof(buf)) == sizeof(buf)) {}
 }
 
-bool MOONRAKER::post_to_queue(String path) {
-    if (post_queue.count >= QUEUE_LEN) {
-        return false;
+// Moonraker wraps Klipper's reason as
+// "{'error': 'WebRequestError', 'message': '<reason>'}", keep the reason
+// with its escaped newlines restored
+static void error_message(char * out, size_t len, const char * message) {
+    static const size_t head = 41; // {'error': 'WebRequestError', 'message':
+    static const size_t tail = 2;  // '}
+    size_t end = strlen(message);
+    end = end > head + tail ? end - tail : head;
+    size_t n = 0;
+    for (size_t i = head; i < end && n + 1 < len; i++) {
+        if (message[i] == '\\' && i + 1 < end && message[i + 1] == 'n') {
+            out[n++] = '\n';
+            i++;
+        } else {
+            out[n++] = message[i];
+        }
     }
-    post_queue.queue[post_queue.index_w] = path;
-    post_queue.index_w = (post_queue.index_w + 1) % QUEUE_LEN;
-    post_queue.count++;
-    
-    return true;
+    out[n] = 0;
 }
 
-bool MOONRAKER::post_gcode_to_queue(String gcode) {
-    String path = "/printer/gcode/script?script=" + gcode;
-    return post_to_queue(path);
+// Whether a failed request can safely be sent again. A POST whose reply
+// was lost may already be running on the printer (e.g. a G28 that took
+// longer than the timeout), so it is only retried if it never left.
+static bool request_retryable(int code, bool post) {
+    if (code == 503 || code == 408) return true;
+    if (code >= 500) return !post;
+    return !post ||
+           code == HTTP_ERROR_CONNECT ||
+           code == HTTP_ERROR_SEND;
 }
 
-void MOONRAKER::get_printer_ready(void) {
-    String webhooks = send_request("GET", "/printer/objects/query?webhooks");
-    if (!webhooks.isEmpty()) {
-        JsonDocument json_parse;
-        DeserializationError error = deserializeJson(json_parse, webhooks);
-        
-        if (error) {
-            unready = true;
-            return;
+// One attempt, never sleeps. Failures are rescheduled by the endpoint's
+// BACKOFF, and further requests are skipped until it is ready again.
+// Nothing here touches the heap: the request is built in conn.http's
+// buffer and a polled reply is parsed in poll_arena.
+moonraker_result_t MOONRAKER::send_request(uint8_t endpoint, const char * type, const char * path,
+                                           JsonDocument * response, const JsonDocument * filter) {
+    // Cached address only, so the request never waits for a DNS or mDNS
+    // lookup. Until wifi_task has one nothing is sent. The connection's
+    // header template follows the address when it changes.
+    char host[sizeof(moonraker_ip)];
+    if (!resolver.host(host, sizeof(host))) {
+        stats[endpoint].dns_misses++;
+        return REQUEST_SKIPPED;
+    }
+
+    BACKOFF & retry = backoff[endpoint];
+    if (!retry.ready(millis())) {
+        return REQUEST_SKIPPED;
+    }
+
+    bool post = strcmp(type, "POST") == 0;
+    moonraker_conn_t & conn = endpoint == ENDPOINT_EMERGENCY ? conn_estop :
+                              endpoint == ENDPOINT_PRIORITY ? conn_prio : post ? conn_cmd : conn_poll;
+    moonraker_stats_t & stat = stats[endpoint];
+    moonraker_result_t result = REQUEST_OK;
+    unsigned long start = millis();
+    uint32_t rx_bytes = conn.rx_bytes;
+    int code;
+    conn.error[0] = 0;
+
+    stat.dns_hits++;
+    conn.http.begin(host, atoi(moonraker_port));
+
+    // Set longer timeout for POST requests (likely to be G-code that takes time).
+    // An emergency stop answers at once, and has its own connection and
+    // task, so a control request running its macro never holds it up.
+    int timeout = !post || endpoint == ENDPOINT_EMERGENCY ? HTTP_TIMEOUT :
+                  endpoint == ENDPOINT_PRIORITY ? CONTROL_TIMEOUT : HTTP_LONG_TIMEOUT;
+    
+    for (;;) {
+        // Reuse the open socket when the server kept it alive
+        bool reused = conn.http.tcp.connected();
+        conn.requests++;
+        if (reused) {
+            conn.reused++;
+        } else {
+            conn.reconnects++;
         }
-        
-        // Check the JSON structure using containsKey
-        if (json_parse.containsKey("result")) {
-            JsonVariant result = json_parse["result"];
-            if (result.containsKey("status")) {
-                JsonVariant status = result["status"];
-                if (status.containsKey("webhooks")) {
-                    JsonVariant webhooks = status["webhooks"];
-                    if (webhooks.containsKey("state")) {
-                        String state = webhooks["state"].as<String>();
-                        bool wasUnready = unready;
-                        unready = (state == "ready") ? false : true;
-                        
-                        if (wasUnready != unready) {
-                            if (!unready) {
-                                // Printer just became ready, refresh all data
-                                get_printer_info();
-                                get_crowpanel_status();
-                            }
-                        }
-                        return;
-                    }
+
+        code = conn.http.request(type, path, timeout); // Spaces and the like are percent-encoded
+        if (code > 0) {
+            stat.tx_bytes += conn.http.sent;
+        }
+        if (!reused || !http_stale(code)) break;
+
+        // The server closed the idle keep-alive socket, reconnect straight
+        // away. Never after a timeout, a long G28 would run twice.
+        stat.stale++;
+        conn.http.tcp.stop();
+    }
+    
+    // http request success
+    if (code > 0) {
+        unconnected = false;
+
+        if (code >= 200 && code < 300) {
+            // Success (2xx response)
+            if (response != NULL) {
+                // Only GET replies are hashed, poll_body belongs to moonraker_task
+                result = read_json(conn, *response, filter, post ? NULL : &body_hash[endpoint]);
+            } else {
+                skip_body(conn);
+            }
+        } else if (code == 400) {
+            // Handle 400 Bad Request - often contains useful error info
+            result = REQUEST_REJECTED;
+            
+            JsonDocument json_parse(&conn.alloc);
+            if (read_json(conn, json_parse, &error_filter) == REQUEST_OK) {
+                // Check if there's an error message
+                JsonVariantConst message = json_parse["error"]["message"];
+                if (message.is<const char *>()) {
+                    error_message(conn.error, sizeof(conn.error), message.as<const char *>()); // Shown by the command's callback
                 }
             }
+        } else {
+            skip_body(conn);
+            result = request_retryable(code, post) ? REQUEST_RETRY :
+                     code >= 500 ? REQUEST_FAILED : REQUEST_REJECTED;
+        }
+        if (code < 200 || code >= 300) stat.http_errors++;
+    } else if (code == HTTP_ERROR_TOO_LONG) {
+        // Never sent, and it would not fit next time either
+        result = REQUEST_REJECTED;
+    } else {
+        // HTTP request failed
+        conn.http.tcp.stop();
+        if (code == HTTP_ERROR_TIMEOUT) {
+            stat.timeouts++;
+        } else {
+            stat.conn_errors++;
+            resolver.refresh(); // The printer may have a new address
         }
+        result = request_retryable(code, post) ? REQUEST_RETRY : REQUEST_FAILED;
         
-        unready = true;
+        // Only set unconnected flag for GET requests to avoid false negatives during long operations
+        if (!post) {
+            unconnected = true;
+        }
+    }
+    
+    conn.http.end(); // Keeps the socket open for the next request
+    conn.rx_bytes += conn.http.received;
+
+    stat.latency.add(millis() - start);
+    stat.rx_bytes += conn.rx_bytes - rx_bytes;
+    switch (result) {
+        case REQUEST_OK: stat.ok++; break;
+        case REQUEST_UNCHANGED: stat.ok++; stat.unchanged++; break;
+        case REQUEST_REJECTED: stat.rejected++; break;
+        case REQUEST_RETRY: stat.retry++; break;
+        default: stat.failed++; break;
+    }
+
+    if (result != REQUEST_OK && result != REQUEST_UNCHANGED) {
+        // The caller may have changed state on this failure, parse the next reply
+        body_hash[endpoint] = BODY_HASH_NONE;
+    }
+    if (result == REQUEST_RETRY || result == REQUEST_FAILED) {
+        retry.failure(millis());
     } else {
-        unready = true;
+        retry.success();
     }
+    return result;
 }
 
-void MOONRAKER::get_printer_info(void) {
-    String printer_info = send_request("GET", "/api/printer");
-    if (!printer_info.isEmpty()) {
-        JsonDocument json_parse;
-        DeserializationError error = deserializeJson(json_parse, printer_info);
-        
-        if (error) {
-            return;
+// Called when the link to the printer is known to be back. Each backoff is
+// reset by the task owning it, the dispatch tasks are woken to do so.
+void MOONRAKER::backoff_reset(void) {
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+        backoff[i].request_reset();
+    }
+    TaskHandle_t task = post_task;
+    if (task != NULL) xTaskNotifyGive(task);
+    task = prio_task;
+    if (task != NULL) xTaskNotifyGive(task);
+    task = estop_task;
+    if (task != NULL) xTaskNotifyGive(task);
+}
+
+// Compact JSON of the request telemetry, e.g. for the "stats" serial command.
+// Counters are read while the tasks update them, a dump may be off by one.
+void MOONRAKER::stats_json(Print & out) {
+    static const char * const names[ENDPOINT_COUNT] = { "status", "gcode", "priority", "estop" };
+    static const char * const classes[GCODE_BULK + 1] = { "estop", "control", "bulk" };
+    JsonDocument doc;
+
+    doc["up"] = millis();
+    JsonArray bounds = doc["bounds"].to<JsonArray>();
+    for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) bounds.add(latency_bounds[i]);
+
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+        const moonraker_stats_t & stat = stats[i];
+        JsonObject ep = doc[names[i]].to<JsonObject>();
+        ep["n"] = stat.latency.count;
+        ep["ok"] = stat.ok;
+        ep["rej"] = stat.rejected;
+        ep["retry"] = stat.retry;
+        ep["fail"] = stat.failed;
+        ep["skip"] = backoff[i].skipped;
+        ep["trips"] = backoff[i].trips;
+        ep["tmo"] = stat.timeouts;
+        ep["conn"] = stat.conn_errors;
+        ep["http"] = stat.http_errors;
+        ep["stale"] = stat.stale;
+        ep["same"] = stat.unchanged;
+        ep["tx"] = stat.tx_bytes;
+        ep["rx"] = stat.rx_bytes;
+        ep["avg"] = stat.latency.mean();
+        ep["p50"] = stat.latency.percentile(50);
+        ep["p95"] = stat.latency.percentile(95);
+        ep["max"] = stat.latency.max_ms;
+        JsonArray hist = ep["hist"].to<JsonArray>();
+        for (uint8_t j = 0; j < LATENCY_BUCKETS; j++) hist.add(stat.latency.buckets[j]);
+    }
+
+    JsonObject wait = doc["dispatch"].to<JsonObject>();
+    for (uint8_t i = 0; i <= GCODE_BULK; i++) {
+        JsonObject lane = wait[classes[i]].to<JsonObject>();
+        lane["n"] = dispatch[i].count;
+        lane["avg"] = dispatch[i].mean();
+        lane["p95"] = dispatch[i].percentile(95);
+        lane["max"] = dispatch[i].max_ms;
+    }
+    wait["expired"] = prio_expired;
+    wait["lost"] = done_post.overflows + done_prio.overflows + done_estop.overflows; // Completions the LVGL task never saw
+
+    JsonObject log = doc["journal"].to<JsonObject>();
+    log["pending"] = journal.pending();
+    log["bytes"] = journal.size();
+    log["n"] = journal.appended;
+    log["full"] = journal.full;
+    log["expired"] = journal.expired;
+    log["append_us"] = journal.appended ? journal.append_us / journal.appended : 0;
+    log["append_max_us"] = journal.append_us_max;
+    log["replayed"] = journal.replayed;
+    log["per_s"] = journal.replay_ms ? journal.replayed * 1000 / journal.replay_ms : 0;
+
+    char host[sizeof(moonraker_ip)];
+    JsonObject dns = doc["dns"].to<JsonObject>();
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+        hits += stats[i].dns_hits;
+        misses += stats[i].dns_misses;
+    }
+    dns["addr"] = resolver.host(host, sizeof(host)) ? host : "";
+    dns["hit"] = hits;
+    dns["miss"] = misses;
+    dns["lookups"] = resolver.lookups;
+    dns["fail"] = resolver.failures;
+    dns["avg"] = resolver.time.mean();
+    dns["max"] = resolver.time.max_ms;
+    dns["age"] = resolver.resolved_at ? millis() - resolver.resolved_at : 0;
+
+    // Keep-alive reuse and JSON heap of each task's connection
+    static const char * const conn_names[] = { "poll", "cmd", "prio", "estop" };
+    const moonraker_conn_t * const conns[] = { &conn_poll, &conn_cmd, &conn_prio, &conn_estop };
+    JsonObject sockets = doc["conn"].to<JsonObject>();
+    for (uint8_t i = 0; i < sizeof(conns) / sizeof(conns[0]); i++) {
+        JsonObject conn = sockets[conn_names[i]].to<JsonObject>();
+        conn["n"] = conns[i]->requests;
+        conn["reused"] = conns[i]->reused;
+        conn["reconn"] = conns[i]->reconnects;
+        conn["json_peak"] = conns[i]->parse_peak_max;
+        conn["allocs"] = conns[i]->alloc.allocs;
+        conn["heap"] = conns[i]->alloc.heap_allocs; // Blocks not served by an arena, all of them without one
+        conn["unhashed"] = conns[i]->unhashed;
+    }
+
+    doc["ws"]["sub"] = ws_subscribed;
+    doc["ws"]["updates"] = ws_updates;
+    doc["poll"]["interval"] = governor.interval;
+    doc["poll"]["rate"] = governor.rate;
+    doc["poll"]["json_peak"] = conn_poll.parse_peak_max;
+    doc["poll"]["heap"] = conn_poll.alloc.heap_allocs; // JSON blocks that did not fit poll_arena
+
+    serializeJson(doc, out);
+    out.println();
+}
+
+void MOONRAKER::stats_reset(void) {
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+        stats[i] = moonraker_stats_t();
+    }
+    for (uint8_t i = 0; i <= GCODE_BULK; i++) {
+        dispatch[i].reset();
+    }
+    prio_expired = 0;
+}
+
+void MOONRAKER::http_post_loop(void) {
+    if (bulk_flush.load(std::memory_order_acquire)) {
+        // The printer is shut down, nothing queued before the emergency
+        // stop may run once it is restarted. Cleared first, a second stop
+        // meanwhile is served by this same flush.
+        bulk_flush.store(false, std::memory_order_relaxed);
+        moonraker_cmd_t * cmd;
+        while ((cmd = post_queue.front()) != NULL) {
+            complete(done_post, *cmd, REQUEST_DROPPED, "");
+            post_queue.pop();
+            gcode_dropped++;
         }
-        
-        // Check if the JSON structure is what we expect
-        if (!json_parse.containsKey("state") || !json_parse.containsKey("temperature")) {
-            return;
+        journal.discard();
+        return;
+    }
+
+    // Commands are kept on flash while the printer cannot take them, and
+    // the journal goes out before anything queued after it. A short outage,
+    // e.g. one failed poll, only holds them in the queue.
+    if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED || unready) {
+        unsigned long now = millis();
+        if (offline_since == 0) offline_since = now | 1;
+        if (now - offline_since >= POST_OFFLINE_JOURNAL) journal_queue();
+        return;
+    }
+    offline_since = 0;
+    if (journal.pending()) {
+        if (!journal.replay_ready()) return; // Waiting for the clock, see JOURNAL::replay_ready()
+        journal_replay();
+        return;
+    }
+
+    moonraker_cmd_t * cmd = post_queue.front();
+    if (cmd == NULL) return;
+    
+    if (cmd->type == CMD_PATH) {
+        uint32_t waited = millis() - cmd->queued_at;
+        moonraker_result_t result = send_request(ENDPOINT_GCODE, "POST", cmd->text);
+        // Keep the command for a later attempt if it never got out
+        if (result != REQUEST_RETRY && result != REQUEST_SKIPPED) {
+            dispatch[GCODE_BULK].add(waited);
+            complete(done_post, *cmd, result, conn_cmd.error);
+            post_queue.pop();
         }
-        
-        // Parse flags
-        data.pause = false;
-        data.printing = false;
-        
-        // Check flags
-        if (json_parse["state"].containsKey("flags")) {
-            JsonVariant flags = json_parse["state"]["flags"];
-            bool pausing = flags.containsKey("pausing") ? flags["pausing"].as<bool>() : false;
-            bool paused = flags.containsKey("paused") ? flags["paused"].as<bool>() : false;
-            bool printing = flags.containsKey("printing") ? flags["printing"].as<bool>() : false;
-            bool cancelling = flags.containsKey("cancelling") ? flags["cancelling"].as<bool>() : false;
-            
-            data.pause = pausing || paused;
-            data.printing = printing || cancelling || data.pause;
+        return;
+    }
+
+    // All G-code queued back to back goes out as one newline-joined script
+    const char * lines[QUEUE_LEN];
+    bool keep[QUEUE_LEN];
+    uint8_t count = 0;
+    while (count < QUEUE_LEN && (cmd = post_queue.peek(count)) != NULL && cmd->type == CMD_GCODE) {
+        lines[count++] = cmd->text;
+    }
+    uint8_t sent;
+    uint8_t used = build_script(lines, count, keep, &sent);
+
+    moonraker_result_t result = REQUEST_OK;
+    if (sent > 0) {
+        uint32_t now = millis();
+        result = send_request(ENDPOINT_GCODE, "POST", batch_path);
+        if (result == REQUEST_RETRY || result == REQUEST_SKIPPED) {
+            return; // Left queued, coalesced again on the next attempt
         }
-        
-        // Parse temperatures
-        if (json_parse["temperature"].containsKey("bed")) {
-            JsonVariant bed = json_parse["temperature"]["bed"];
-            if (bed.containsKey("actual") && bed.containsKey("target")) {
-                data.bed_actual = bed["actual"].as<double>() + 0.5f;
-                data.bed_target = bed["target"].as<double>() + 0.5f;
-            }
+        gcode_requests++;
+        gcode_commands += sent;
+        for (uint8_t i = 0; i < used; i++) {
+            if (keep[i]) dispatch[GCODE_BULK].add(now - post_queue.peek(i)->queued_at);
         }
-        
-        // Check if the tool exists and get temperatures
-        bool toolFound = false;
-        if (json_parse["temperature"].containsKey(moonraker_tool)) {
-            JsonVariant tool = json_parse["temperature"][moonraker_tool];
-            if (tool.containsKey("actual") && tool.containsKey("target")) {
-                toolFound = true;
-                data.nozzle_actual = tool["actual"].as<double>() + 0.5f;
-                data.nozzle_target = tool["target"].as<double>() + 0.5f;
-            }
+    }
+    gcode_dropped += used - sent;
+
+    // Slots are only released once the script no longer refers to them.
+    // Every line of the script shares its outcome.
+    for (uint8_t i = 0; i < used; i++) {
+        complete(done_post, *post_queue.front(), keep[i] ? result : REQUEST_DROPPED, conn_cmd.error);
+        post_queue.pop();
+    }
+}
+
+// Coalesce count G-code lines into one script request in batch_path. Returns
+// how many lines it covers, *sent of them are in it and flagged in keep.
+uint8_t MOONRAKER::build_script(const char * const * lines, uint8_t count, bool * keep, uint8_t * sent) {
+    gcode_coalesce(lines, count, keep);
+
+    size_t len = strlcpy(batch_path, GCODE_SCRIPT_PATH, sizeof(batch_path));
+    uint8_t used = 0;
+    *sent = 0;
+    for (; used < count; used++) {
+        if (!keep[used]) continue;
+        size_t next = gcode_append(batch_path, sizeof(batch_path), len, lines[used], *sent > 0);
+        if (next == 0) break; // Script is full, the rest goes in the next request
+        len = next;
+        (*sent)++;
+    }
+    return used;
+}
+
+// Printer offline: move queued commands to flash, so they survive a reset
+// and the RAM queue has room for more
+void MOONRAKER::journal_queue(void) {
+    moonraker_cmd_t * cmd;
+    while ((cmd = post_queue.front()) != NULL) {
+        bool stored = (cmd->flags & CMD_NO_JOURNAL) == 0 && journal.append(cmd->type, cmd->text, cmd->queued_at);
+        complete(done_post, *cmd, stored ? REQUEST_DEFERRED : REQUEST_DROPPED, "");
+        if (!stored) gcode_dropped++;
+        post_queue.pop();
+    }
+}
+
+// Printer ready again: send the journal in order, one request per call.
+// Lines are coalesced like queued ones, and each request is acked on flash
+// so a reset during the replay does not send it twice.
+void MOONRAKER::journal_replay(void) {
+    unsigned long start = millis();
+    uint32_t last;
+    uint8_t count = journal.read(replay, JOURNAL_BATCH, &last);
+    if (count == 0) {
+        journal.ack(last); // Only expired commands left
+        return;
+    }
+
+    moonraker_result_t result;
+    uint8_t used = 1;
+    if (replay[0].type == CMD_PATH) {
+        result = send_request(ENDPOINT_GCODE, "POST", replay[0].text);
+    } else {
+        const char * lines[JOURNAL_BATCH];
+        bool keep[JOURNAL_BATCH];
+        uint8_t lines_num = 0;
+        while (lines_num < count && replay[lines_num].type == CMD_GCODE) {
+            lines[lines_num] = replay[lines_num].text;
+            lines_num++;
         }
-        
-        // If specified tool wasn't found, try tool0 as fallback
-        if (!toolFound) {
-            if (json_parse["temperature"].containsKey("tool0")) {
-                JsonVariant tool0 = json_parse["temperature"]["tool0"];
-                if (tool0.containsKey("actual") && tool0.containsKey("target")) {
-                    data.nozzle_actual = tool0["actual"].as<double>() + 0.5f;
-                    data.nozzle_target = tool0["target"].as<double>() + 0.5f;
-                }
-            }
+        uint8_t sent;
+        used = build_script(lines, lines_num, keep, &sent);
+        result = sent > 0 ? send_request(ENDPOINT_GCODE, "POST", batch_path) : REQUEST_OK;
+        gcode_dropped += used - sent;
+    }
+    if (result == REQUEST_RETRY || result == REQUEST_SKIPPED) {
+        return; // Read again on the next attempt
+    }
+
+    journal.ack(used == count ? last : replay[used - 1].seq);
+    journal.replayed += used;
+    journal.replay_ms += millis() - start;
+}
+
+// One command of class prio, GCODE_EMERGENCY or GCODE_CONTROL, per call.
+// Each class has its own task, endpoint and connection, so an emergency
+// stop goes out while a pause or cancel is still running its macro.
+void MOONRAKER::http_priority_loop(uint8_t prio) {
+    bool emergency = prio == GCODE_EMERGENCY;
+    moonraker_cmd_t * cmd = prio_queue[prio].front();
+    if (cmd == NULL) return;
+    SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> & done = emergency ? done_estop : done_prio;
+
+    uint32_t waited = millis() - cmd->queued_at;
+    if (waited > PRIORITY_EXPIRE) {
+        // Sending a pause or stop pressed long ago would surprise the user
+        prio_expired++;
+        complete(done, *cmd, REQUEST_DROPPED, "");
+        prio_queue[prio].pop();
+        return;
+    }
+
+    moonraker_result_t result = send_request(emergency ? ENDPOINT_EMERGENCY : ENDPOINT_PRIORITY, "POST", cmd->text);
+    if (result == REQUEST_RETRY || result == REQUEST_SKIPPED) {
+        return; // Still first in its class on the next attempt
+    }
+    dispatch[prio].add(waited);
+    complete(done, *cmd, result, emergency ? conn_estop.error : conn_prio.error);
+    if (emergency && result == REQUEST_OK) {
+        bulk_flush = true;
+        TaskHandle_t task = post_task;
+        if (task != NULL) xTaskNotifyGive(task);
+    }
+    prio_queue[prio].pop();
+}
+
+// Fill the ring slot ahead places past the newest one in place, never
+// blocks or allocates. The consumer sees it once the ring is committed.
+template <uint16_t N>
+static bool fill(SPSC_RING<moonraker_cmd_t, N> & ring, uint16_t ahead, uint8_t type, const char * text,
+                 uint32_t handle, moonraker_done_cb_t cb, void * user, uint8_t flags) {
+    moonraker_cmd_t * cmd = ring.reserve(ahead);
+    if (cmd == NULL) {
+        return false;
+    }
+    if (strlcpy(cmd->text, text, sizeof(cmd->text)) >= sizeof(cmd->text)) {
+        // Never send a truncated request
+        return false;
+    }
+    cmd->type = type;
+    cmd->flags = flags;
+    cmd->queued_at = millis();
+    cmd->handle = handle;
+    cmd->cb = cb;
+    cmd->user = user;
+    return true;
+}
+
+template <uint16_t N>
+static bool enqueue(SPSC_RING<moonraker_cmd_t, N> & ring, uint8_t type, const char * text,
+                    uint32_t handle, moonraker_done_cb_t cb, void * user, uint8_t flags) {
+    if (!fill(ring, 0, type, text, handle, cb, user, flags)) {
+        return false;
+    }
+    ring.commit();
+    return true;
+}
+
+// Called from the LVGL task only. Commands with a priority endpoint bypass
+// post_queue, see gcode_priority(). Returns the command's handle, 0 if it
+// was not queued. cb, if given, runs on the LVGL task with the outcome.
+uint32_t MOONRAKER::queue_command(uint8_t type, const char * text, moonraker_done_cb_t cb, void * user,
+                                  uint8_t flags) {
+    const char * path = text;
+    uint8_t prio = type == CMD_GCODE ? gcode_priority(text, &path) : path_priority(text);
+    uint32_t handle = last_handle + 1;
+    if (handle == 0) handle = 1; // 0 means not queued
+    bool queued = prio == GCODE_BULK ? enqueue(post_queue, type, text, handle, cb, user, flags) :
+                                       enqueue(prio_queue[prio], CMD_PATH, path, handle, cb, user, flags);
+    if (queued) {
+        last_handle = handle;
+        // Wake the dispatcher now instead of on its next poll
+        TaskHandle_t task = prio == GCODE_BULK ? post_task : prio == GCODE_EMERGENCY ? estop_task : prio_task;
+        if (task != NULL) xTaskNotifyGive(task);
+        governor.kick = true; // Show the effect of the command quickly
+    }
+    return queued ? handle : 0;
+}
+
+// How long a dispatch task may sleep when nothing wakes it: for ever when
+// its queues are empty, otherwise until the backoff lets the held command
+// go. A command queued meanwhile ends the sleep early.
+TickType_t MOONRAKER::post_wait(uint8_t endpoint, bool idle) {
+    if (idle) {
+        return portMAX_DELAY;
+    }
+    // Bulk commands also wait for Klippy, they go to the journal meanwhile,
+    // and for the clock before an earlier boot's journal is replayed
+    if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED || resolver.address() == 0 ||
+        (endpoint == ENDPOINT_GCODE && (unready || (journal.pending() && !journal.replay_ready())))) {
+        return pdMS_TO_TICKS(POST_OFFLINE_WAIT);
+    }
+    return pdMS_TO_TICKS(backoff[endpoint].wait(millis()));
+}
+
+uint32_t MOONRAKER::post_to_queue(const char * path, moonraker_done_cb_t cb, void * user, uint8_t flags) {
+    return queue_command(CMD_PATH, path, cb, user, flags);
+}
+
+uint32_t MOONRAKER::post_gcode_to_queue(const char * gcode, moonraker_done_cb_t cb, void * user) {
+    return queue_command(CMD_GCODE, gcode, cb, user);
+}
+
+// Called from the LVGL task only. The lines are published to post_queue
+// at once and the dispatcher is woken once, so it cannot preempt the
+// LVGL task between them and send the first line on its own: they go out
+// in one script. They share the returned handle, cb runs once, with the
+// outcome of the last line. Nothing is queued if a line does not fit or
+// needs a priority endpoint.
+uint32_t MOONRAKER::post_gcode_to_queue(const char * const * lines, uint8_t count, moonraker_done_cb_t cb,
+                                        void * user) {
+    uint32_t handle = last_handle + 1;
+    if (handle == 0) handle = 1; // 0 means not queued
+    for (uint8_t i = 0; i < count; i++) {
+        const char * path;
+        if (gcode_priority(lines[i], &path) != GCODE_BULK ||
+            !fill(post_queue, i, CMD_GCODE, lines[i], handle, i + 1 == count ? cb : NULL, user, 0)) {
+            return 0;
         }
     }
+    if (count == 0) return 0;
+
+    post_queue.commit(count);
+    last_handle = handle;
+    TaskHandle_t task = post_task;
+    if (task != NULL) xTaskNotifyGive(task);
+    governor.kick = true;
+    return handle;
+}
+
+// Dispatch task side: pass the outcome of cmd to the LVGL task
+void MOONRAKER::complete(SPSC_RING<moonraker_completion_t, DONE_QUEUE_LEN> & ring, const moonraker_cmd_t & cmd,
+                         uint8_t result, const char * message) {
+    if (cmd.cb == NULL) return;
+
+    moonraker_completion_t * completion = ring.reserve();
+    if (completion == NULL) {
+        return; // The LVGL task is not draining, the ring counts the loss
+    }
+    completion->done.handle = cmd.handle;
+    completion->done.result = result;
+    completion->done.latency = millis() - cmd.queued_at;
+    strlcpy(completion->done.message, message, sizeof(completion->done.message));
+    completion->cb = cmd.cb;
+    completion->user = cmd.user;
+    ring.commit();
+}
+
+// LVGL task side: run the callbacks of completed commands, so they may
+// touch LVGL objects
+void MOONRAKER::run_completions(void) {
+    moonraker_completion_t * completion;
+    while ((completion = done_estop.front()) != NULL) {
+        completion->cb(completion->done, completion->user);
+        done_estop.pop();
+    }
+    while ((completion = done_prio.front()) != NULL) {
+        completion->cb(completion->done, completion->user);
+        done_prio.pop();
+    }
+    while ((completion = done_post.front()) != NULL) {
+        completion->cb(completion->done, completion->user);
+        done_post.pop();
+    }
 }
 
 // only return gcode file name except path
@@ -234,7 +727,7 @@ void MOONRAKER::get_printer_info(void) {
 // only return "123.gcode"
 const char * path_only_gcode(const char * path)
 {
-  char * name = strrchr(path, '/');
+  const char * name = strrchr(path, '/');
 
   if (name != NULL)
     return (name + 1);
@@ -242,146 +735,240 @@ const char * path_only_gcode(const char * path)
     return path;
 }
 
-void MOONRAKER::get_progress(void) {
-    String display_status = send_request("GET", "/printer/objects/query?virtual_sdcard");
-    if (!display_status.isEmpty()) {
-        JsonDocument json_parse;
-        DeserializationError error = deserializeJson(json_parse, display_status);
-        
-        if (error) {
-            return;
-        }
-        
-        // Check the JSON structure
-        if (!json_parse.containsKey("result")) {
-            return;
-        }
-        
-        JsonVariant result = json_parse["result"];
-        if (!result.containsKey("status")) {
-            return;
-        }
-        
-        JsonVariant status = result["status"];
-        if (!status.containsKey("virtual_sdcard")) {
-            return;
-        }
-        
-        JsonVariant virtual_sdcard = status["virtual_sdcard"];
-        
-        // Get progress percentage
-        if (virtual_sdcard.containsKey("progress")) {
-            double progress = virtual_sdcard["progress"].as<double>();
-            data.progress = (uint8_t)(progress * 100 + 0.5f);
-        }
-        
-        // Get file path
-        if (virtual_sdcard.containsKey("file_path")) {
-            const char* file_path = virtual_sdcard["file_path"].as<const char*>();
-            strlcpy(data.file_path, path_only_gcode(file_path), sizeof(data.file_path) - 1);
-            data.file_path[sizeof(data.file_path) - 1] = 0;
-        }
+const char * MOONRAKER::schema_object(uint8_t i) const {
+    return moonraker_schema[i].object ? moonraker_schema[i].object : moonraker_extruder;
+}
+
+// Filter applied to query results and WebSocket messages alike, keeping
+// only the fields of moonraker_schema[]
+void MOONRAKER::build_status_filter(void) {
+    status_filter.clear();
+    status_filter["id"] = true;
+    status_filter["method"] = true;
+    status_filter["error"] = true;
+    JsonObject params = status_filter["params"].add<JsonObject>();
+    JsonObject result = status_filter["result"]["status"].to<JsonObject>();
+    for (uint8_t i = 0; i < moonraker_schema_num; i++) {
+        params[schema_object(i)][moonraker_schema[i].field] = true;
+        result[schema_object(i)][moonraker_schema[i].field] = true;
     }
 }
 
-void MOONRAKER::get_crowpanel_status(void) {
-    String crowpanel_status = send_request("GET", "/printer/objects/query?gcode_macro%20_CROWPANEL_STATUS");
-    if (!crowpanel_status.isEmpty()) {
-        JsonDocument json_parse;
-        DeserializationError error = deserializeJson(json_parse, crowpanel_status);
-        
-        if (error) {
-            return;
-        }
-        
-        // Check if the CROWPANEL_STATUS macro exists
-        if (!json_parse.containsKey("result")) {
-            return;
+// Recursive, the device toolchain builds C++11
+static constexpr size_t const_strlen(const char * s) {
+    return *s ? 1 + const_strlen(s + 1) : 0;
+}
+
+static constexpr bool const_streq(const char * a, const char * b) {
+    return a == NULL || b == NULL ? a == b : *a == *b && (*a == 0 || const_streq(a + 1, b + 1));
+}
+
+// Characters field i adds to the query: "&object=" first if it starts an
+// object, the first one without '&', else ',', then the field. The
+// extruder's name is as long as moonraker_extruder holds.
+static constexpr size_t status_query_field(size_t i) {
+    return (i == 0 || !const_streq(moonraker_schema[i - 1].object, moonraker_schema[i].object) ?
+                (i > 0) + 1 + (moonraker_schema[i].object ? const_strlen(moonraker_schema[i].object) :
+                                                            sizeof(MOONRAKER::moonraker_extruder) - 1) :
+                1) +
+           const_strlen(moonraker_schema[i].field);
+}
+
+// Longest query build_status_query() can make from moonraker_schema[]
+static constexpr size_t status_query_max(size_t i = 0) {
+    return i < sizeof(moonraker_schema) / sizeof(moonraker_schema[0]) ? status_query_field(i) + status_query_max(i + 1) :
+                                                                        const_strlen(STATUS_QUERY_PATH);
+}
+
+static_assert(status_query_max() < sizeof(MOONRAKER::status_query), "status_query must hold every moonraker_schema[] field");
+
+// Build the single objects query polled each cycle, asking only for the
+// fields in moonraker_schema[], e.g. "...?webhooks=state&extruder=temperature,target"
+// Never cut, the static_assert above checks the longest one fits
+void MOONRAKER::build_status_query(void) {
+    size_t len = strlcpy(status_query, STATUS_QUERY_PATH, sizeof(status_query));
+    for (uint8_t i = 0; i < moonraker_schema_num; i = moonraker_schema_next(i)) {
+        len += snprintf(status_query + len, sizeof(status_query) - len, "%s%s=", i ? "&" : "", schema_object(i));
+        for (uint8_t j = i; j < moonraker_schema_next(i); j++) {
+            len += snprintf(status_query + len, sizeof(status_query) - len, "%s%s", j > i ? "," : "", moonraker_schema[j].field);
         }
-        
-        JsonVariant result = json_parse["result"];
-        if (!result.containsKey("status")) {
-            return;
+    }
+}
+
+// One round trip refreshes every field of data
+moonraker_result_t MOONRAKER::get_status(void) {
+    JsonDocument json_parse(&conn_poll.alloc);
+    moonraker_result_t result = send_request(ENDPOINT_STATUS, "GET", status_query, &json_parse, &status_filter);
+    if (result == REQUEST_SKIPPED) {
+        return result; // Backing off, keep the last known state
+    }
+    if (result == REQUEST_UNCHANGED) {
+        return REQUEST_OK; // Same reply as last time, data is already up to date
+    }
+    if (result != REQUEST_OK) {
+        unready = true;
+        return result;
+    }
+
+    // Moonraker answers with an error object while Klippy is not connected
+    JsonVariantConst status = json_parse["result"]["status"];
+    if (!status.is<JsonObjectConst>()) {
+        unready = true;
+        body_hash[ENDPOINT_STATUS] = BODY_HASH_NONE;
+        return REQUEST_REJECTED;
+    }
+
+    apply_status(status);
+    return REQUEST_OK;
+}
+
+// Apply a Klipper status object, either a full query result or a
+// notify_status_update delta. Only fields present in status are updated.
+// One pass over the reply, each key is compared against its object's
+// schema entries only.
+void MOONRAKER::apply_status(JsonVariantConst status) {
+    bool now_unready = unready;
+    apply_status(status, data, now_unready);
+    unready = now_unready;
+}
+
+// As above into another printer's data, e.g. one of the farm's
+void MOONRAKER::apply_status(JsonVariantConst status, moonraker_data_t & out, bool & out_unready) const {
+    for (JsonPairConst object : status.as<JsonObjectConst>()) {
+        uint8_t first = 0;
+        while (first < moonraker_schema_num && strcmp(object.key().c_str(), schema_object(first)) != 0) {
+            first = moonraker_schema_next(first);
         }
-        
-        JsonVariant status = result["status"];
-        if (!status.containsKey("gcode_macro _CROWPANEL_STATUS")) {
-            // This is normal if the macro isn't defined in Klipper config
-            return;
+        if (first >= moonraker_schema_num) continue;
+
+        uint8_t last = moonraker_schema_next(first);
+        for (JsonPairConst field : object.value().as<JsonObjectConst>()) {
+            for (uint8_t i = first; i < last; i++) {
+                if (strcmp(field.key().c_str(), moonraker_schema[i].field) == 0) {
+                    apply_field(moonraker_schema[i], field.value(), out, out_unready);
+                    break;
+                }
+            }
         }
-        
-        JsonVariant crowpanel = status["gcode_macro _CROWPANEL_STATUS"];
-        
-        // Parse the status values - check each field individually
-        data.homing = crowpanel.containsKey("homing") ? crowpanel["homing"].as<bool>() : false;
-        data.probing = crowpanel.containsKey("probing") ? crowpanel["probing"].as<bool>() : false;
-        data.qgling = crowpanel.containsKey("qgling") ? crowpanel["qgling"].as<bool>() : false;
-        data.heating_nozzle = crowpanel.containsKey("heating_nozzle") ? crowpanel["heating_nozzle"].as<bool>() : false;
-        data.heating_bed = crowpanel.containsKey("heating_bed") ? crowpanel["heating_bed"].as<bool>() : false;
+    }
+}
+
+// Store one status value as its schema entry says, values of the wrong
+// type (e.g. a null file_path) leave the member as it was
+void MOONRAKER::apply_field(const moonraker_field_t & field, JsonVariantConst value,
+                            moonraker_data_t & out, bool & out_unready) const {
+    uint8_t * member = (uint8_t *)&out + field.offset;
+
+    switch (field.conv) {
+        case CONV_INT16:
+            if (value.is<double>()) *(int16_t *)member = value.as<double>() + 0.5f;
+            break;
+        case CONV_PERCENT:
+            if (value.is<double>()) *member = (uint8_t)(value.as<double>() * 100 + 0.5f);
+            break;
+        case CONV_BOOL:
+            if (value.is<bool>()) *(bool *)member = value.as<bool>();
+            break;
+        case CONV_BASENAME:
+            if (value.is<const char *>()) strlcpy((char *)member, path_only_gcode(value.as<const char *>()), field.size);
+            break;
+        case CONV_PRINT_STATE:
+            if (value.is<const char *>()) {
+                const char * state = value.as<const char *>();
+                out.pause = strcmp(state, "paused") == 0;
+                out.printing = out.pause || strcmp(state, "printing") == 0;
+            }
+            break;
+        case CONV_READY:
+            if (value.is<const char *>()) out_unready = strcmp(value.as<const char *>(), "ready") != 0;
+            break;
     }
 }
 
 void MOONRAKER::http_get_loop(void) {
-    static unsigned long lastFullRefresh = 0;
-    unsigned long currentMillis = millis();
-    
-    // Set a lock to prevent data being read while we're updating it
-    data_unlock = false;
-    
-    // Always check if the printer is ready first
-    get_printer_ready();
-    
-    if (!unready) {
-        // Full refresh every 5 seconds or when printer just became ready
-        bool doFullRefresh = (currentMillis - lastFullRefresh) > 5000;
-        
-        if (doFullRefresh) {
-            lastFullRefresh = currentMillis;
-            
-            // get_crowpanel_status() must be before get_printer_info()
-            // to ensure correct status flags
-            get_crowpanel_status();
-            get_printer_info();
-        }
-        
-        // Always check progress if printing
-        if (data.printing) {
-            get_progress();
-        }
+    if (get_status() != REQUEST_SKIPPED) {
+        governor.polled(data, unready, millis());
     }
-    
-    // Release the lock
-    data_unlock = true;
+}
+
+// Make the latest data visible to the UI, bumps the version only on change
+void MOONRAKER::publish(void) {
+    snapshot.write(data);
 }
 
 MOONRAKER moonraker;
 
 void moonraker_post_task(void * parameter) {
+    for(;;) {
+        moonraker.http_post_loop();
+        bool idle = moonraker.post_queue.empty() && !moonraker.bulk_flush && !moonraker.journal.pending();
+        ulTaskNotifyTake(pdTRUE, moonraker.post_wait(ENDPOINT_GCODE, idle));
+    }
+}
+
+// Emergency stop or print control, the gcode_class_t in parameter, on
+// their own connection so they never wait for a long G-code POST
+void moonraker_priority_task(void * parameter) {
+    uint8_t prio = (uint8_t)(uintptr_t)parameter;
+    uint8_t endpoint = prio == GCODE_EMERGENCY ? ENDPOINT_EMERGENCY : ENDPOINT_PRIORITY;
     for(;;) {
         if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED) {
-            moonraker.http_post_loop();
+            moonraker.http_priority_loop(prio);
         }
-        delay(500);
+        ulTaskNotifyTake(pdTRUE, moonraker.post_wait(endpoint, moonraker.prio_queue[prio].empty()));
     }
 }
 
 void moonraker_task(void * parameter) {
+    TaskHandle_t task;
+
     // Create the POST processing task
     xTaskCreate(moonraker_post_task, "moonraker post",
         4096,  // Stack size (bytes)
         NULL,  // Parameter to pass
         8,     // Task priority
-        NULL   // Task handle
+        &task  // Task handle
     );
+    moonraker.post_task = task;
+    xTaskCreate(moonraker_priority_task, "moonraker prio",
+        4096,  // Stack size (bytes)
+        (void *)GCODE_CONTROL, // Print control
+        10,    // Above the POST task
+        &task  // Task handle
+    );
+    moonraker.prio_task = task;
+    xTaskCreate(moonraker_priority_task, "moonraker estop",
+        4096,  // Stack size (bytes)
+        (void *)GCODE_EMERGENCY, // Emergency stop
+        11,    // Above everything else, an emergency stop goes first
+        &task  // Task handle
+    );
+    moonraker.estop_task = task;
 
     // Allow time for WiFi to connect
     delay(2000);
-    
+
+    moonraker.ws_begin();
+    bool wifiConnected = false;
+
     for(;;) {
-        if (wifi_get_connect_status() == WIFI_STATUS_CONNECTED) {
-            moonraker.http_get_loop();
+        bool connected = wifi_get_connect_status() == WIFI_STATUS_CONNECTED;
+        if (connected && !wifiConnected) {
+            // Fresh link, poll right away instead of finishing the backoff
+            moonraker.backoff_reset();
+        }
+        wifiConnected = connected;
+
+        if (connected) {
+            moonraker.ws_loop();
+
+            // Fall back to HTTP polling until the subscription delivers status
+            if (!moonraker.ws_subscribed && moonraker.governor.due(millis())) {
+                moonraker.http_get_loop();
+            }
+            moonraker.publish();
         }
-        delay(200);
+        delay(WS_LOOP_INTERVAL);
     }
 }
 
@@ -390,16 +977,51 @@ void moonraker_setup() {
     strcpy(moonraker.moonraker_ip, crowpanel_config.moonraker_ip);
     strcpy(moonraker.moonraker_port, crowpanel_config.moonraker_port);
     strcpy(moonraker.moonraker_tool, crowpanel_config.moonraker_tool);
+
+    // OctoPrint-style "toolN" maps to Klipper's "extruder", "extruder1", ...
+    int tool = atoi(moonraker.moonraker_tool + strcspn(moonraker.moonraker_tool, "0123456789"));
+    if (tool > 0) {
+        snprintf(moonraker.moonraker_extruder, sizeof(moonraker.moonraker_extruder), "extruder%d", tool);
+    } else {
+        strcpy(moonraker.moonraker_extruder, "extruder");
+    }
+    resolver.begin(moonraker.moonraker_ip);
+    moonraker.journal.begin();
+    moonraker.build_status_query();
+    moonraker.build_status_filter();
+    error_filter["error"]["message"] = true;
+    moonraker.conn_poll.alloc.use_arena(moonraker.poll_arena, sizeof(moonraker.poll_arena));
     
     // Initialize various flags
     moonraker.unready = true;
     moonraker.unconnected = true;
-    moonraker.data_unlock = true;
-    
-    // Initialize the queue
-    moonraker.post_queue.count = 0;
-    moonraker.post_queue.index_r = 0;
-    moonraker.post_queue.index_w = 0;
+    moonraker.ws_connected = false;
+    moonraker.ws_subscribed = false;
+    moonraker.ws_rpc_id = 0;
+    moonraker.ws_subscribe_id = 0;
+    moonraker.ws_updates = 0;
+    moonraker.ws_last_subscribe = 0;
+    moonraker.ws_last_update = 0;
+    moonraker.conn_poll.requests = moonraker.conn_poll.reused = moonraker.conn_poll.reconnects = 0;
+    moonraker.conn_cmd.requests = moonraker.conn_cmd.reused = moonraker.conn_cmd.reconnects = 0;
+    moonraker.conn_poll.rx_bytes = moonraker.conn_poll.parse_peak = moonraker.conn_poll.parse_peak_max = 0;
+    moonraker.conn_cmd.rx_bytes = moonraker.conn_cmd.parse_peak = moonraker.conn_cmd.parse_peak_max = 0;
+    moonraker.conn_prio.requests = moonraker.conn_prio.reused = moonraker.conn_prio.reconnects = 0;
+    moonraker.conn_prio.rx_bytes = moonraker.conn_prio.parse_peak = moonraker.conn_prio.parse_peak_max = 0;
+    moonraker.conn_estop.requests = moonraker.conn_estop.reused = moonraker.conn_estop.reconnects = 0;
+    moonraker.conn_estop.rx_bytes = moonraker.conn_estop.parse_peak = moonraker.conn_estop.parse_peak_max = 0;
+    moonraker.conn_poll.unhashed = moonraker.conn_cmd.unhashed = moonraker.conn_prio.unhashed = moonraker.conn_estop.unhashed = 0;
+    moonraker.gcode_requests = moonraker.gcode_commands = moonraker.gcode_dropped = 0;
+    moonraker.bulk_flush = false;
+    moonraker.post_task = NULL;
+    moonraker.prio_task = NULL;
+    moonraker.estop_task = NULL;
+    moonraker.prio_expired = 0;
+    moonraker.last_handle = 0;
+    moonraker.conn_poll.error[0] = moonraker.conn_cmd.error[0] = moonraker.conn_prio.error[0] = moonraker.conn_estop.error[0] = 0;
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+        moonraker.body_hash[i] = BODY_HASH_NONE;
+    }
     
     // Initialize data
     memset(&moonraker.data, 0, sizeof(moonraker.data));
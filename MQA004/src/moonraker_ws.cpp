@@ -0,0 +1,121 @@
+#include <WebSocketsClient.h>
+#include <ArduinoJson.h>
+#include "moonraker.h"
+
+// Moonraker JSON-RPC over WebSocket. A single printer.objects.subscribe
+// call makes Moonraker push notify_status_update deltas, so no polling is
+// needed while the subscription is alive.
+
+#define WS_HEARTBEAT_INTERVAL 15000 // Ping period to detect a dead link
+#define WS_HEARTBEAT_TIMEOUT 3000   // Time to wait for the pong
+#define WS_HEARTBEAT_MISSES 2       // Missed pongs before disconnecting
+
+void MOONRAKER::ws_begin(void) {
+    ws_addr = 0; // ws.begin() once the host is resolved, see ws_loop()
+    ws.onEvent([this](WStype_t type, uint8_t * payload, size_t length) {
+        ws_event(type, payload, length);
+    });
+    ws.setReconnectInterval(WS_RECONNECT_INTERVAL);
+    ws.enableHeartbeat(WS_HEARTBEAT_INTERVAL, WS_HEARTBEAT_TIMEOUT, WS_HEARTBEAT_MISSES);
+}
+
+void MOONRAKER::ws_loop(void) {
+    // Connect to the first resolved address, or reconnect to a new one
+    // instead of the old. Never to the name, its lookup would block.
+    char host[sizeof(moonraker_ip)];
+    if (!ws_connected && resolver.address() != ws_addr && resolver.host(host, sizeof(host))) {
+        ws_addr = resolver.address();
+        ws.begin(host, atoi(moonraker_port), WS_PATH, "");
+    }
+    if (ws_addr == 0) return;
+    ws.loop();
+
+    // Subscribing fails while Klippy is starting up, keep trying
+    if (ws_connected && !ws_subscribed && millis() - ws_last_subscribe >= WS_RESUBSCRIBE_INTERVAL) {
+        ws_subscribe();
+    }
+}
+
+void MOONRAKER::ws_subscribe(void) {
+    JsonDocument request;
+    request["jsonrpc"] = "2.0";
+    request["method"] = "printer.objects.subscribe";
+
+    JsonObject objects = request["params"]["objects"].to<JsonObject>();
+    for (uint8_t i = 0; i < moonraker_schema_num; i = moonraker_schema_next(i)) {
+        JsonArray fields = objects[schema_object(i)].to<JsonArray>();
+        for (uint8_t j = i; j < moonraker_schema_next(i); j++) {
+            fields.add(moonraker_schema[j].field);
+        }
+    }
+
+    ws_subscribe_id = ++ws_rpc_id;
+    request["id"] = ws_subscribe_id;
+
+    String message;
+    serializeJson(request, message);
+    ws.sendTXT(message);
+    ws_last_subscribe = millis();
+}
+
+void MOONRAKER::ws_event(WStype_t type, uint8_t * payload, size_t length) {
+    switch (type) {
+        case WStype_CONNECTED:
+            ws_connected = true;
+            unconnected = false;
+            // Moonraker is reachable again, no need to wait out the backoff
+            backoff_reset();
+            ws_subscribe();
+            break;
+        case WStype_DISCONNECTED:
+            ws_connected = false;
+            ws_subscribed = false;
+            break;
+        case WStype_TEXT:
+            ws_text(payload, length);
+            break;
+        default:
+            break;
+    }
+}
+
+void MOONRAKER::ws_text(uint8_t * payload, size_t length) {
+    // Runs in moonraker_task, so it shares the polling connection's allocator
+    JsonDocument json_parse(&conn_poll.alloc);
+    DeserializationError error = deserializeJson(json_parse, payload, length,
+                                                 DeserializationOption::Filter(status_filter));
+    if (error) {
+        return;
+    }
+
+    const char * method = json_parse["method"];
+    if (method == NULL) {
+        // Reply to a request, only the subscription is of interest
+        if (json_parse["id"].as<uint32_t>() != ws_subscribe_id) {
+            return;
+        }
+        JsonVariantConst status = json_parse["result"]["status"];
+        if (status.is<JsonObjectConst>()) {
+            apply_status(status);
+            body_hash[ENDPOINT_STATUS] = BODY_HASH_NONE;
+            ws_subscribed = true;
+            ws_last_update = millis();
+        }
+        return;
+    }
+
+    if (strcmp(method, "notify_status_update") == 0) {
+        apply_status(json_parse["params"][0]);
+        // data moved past the last polled reply, a fallback poll must parse again
+        body_hash[ENDPOINT_STATUS] = BODY_HASH_NONE;
+        ws_updates++;
+        ws_last_update = millis();
+    } else if (strcmp(method, "notify_klippy_ready") == 0) {
+        // Subscriptions do not survive a Klippy restart
+        ws_subscribe();
+    } else if (strcmp(method, "notify_klippy_shutdown") == 0 ||
+               strcmp(method, "notify_klippy_disconnected") == 0) {
+        unready = true;
+        ws_subscribed = false;
+    }
+}
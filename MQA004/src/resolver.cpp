@@ -0,0 +1,81 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include "resolver.h"
+#include "crowpanel.h"
+
+RESOLVER resolver;
+bool RESOLVER::mdns_started = false;
+
+RESOLVER::RESOLVER()
+    : lookups(0), failures(0), resolved_at(0), literal(false),
+      addr(0), stale(false), next_lookup(0), last_lookup(0) {
+    name[0] = 0;
+}
+
+void RESOLVER::begin(const char * host) {
+    strlcpy(name, host, sizeof(name));
+    IPAddress ip;
+    literal = ip.fromString(name);
+    addr.store(literal ? (uint32_t)ip : 0, std::memory_order_release);
+    next_lookup = millis();
+}
+
+bool RESOLVER::host(char * buf, size_t len) const {
+    uint32_t a = address();
+    if (a == 0) {
+        buf[0] = 0;
+        return false;
+    }
+    IPAddress ip(a);
+    snprintf(buf, len, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return true;
+}
+
+// "<hostname>.local" goes to mDNS, anything else to the DHCP-provided DNS
+bool RESOLVER::lookup(uint32_t * result) {
+    IPAddress ip;
+    size_t len = strlen(name);
+
+    if (len > 6 && strcasecmp(name + len - 6, ".local") == 0) {
+        if (!mdns_started) {
+            mdns_started = MDNS.begin(crowpanel_config.hostname);
+            if (!mdns_started) return false;
+        }
+        char host[RESOLVE_NAME_LEN];
+        strlcpy(host, name, len - 6 + 1);
+        ip = MDNS.queryHost(host, RESOLVE_TIMEOUT);
+    } else if (WiFi.hostByName(name, ip) != 1) {
+        return false;
+    }
+
+    *result = (uint32_t)ip;
+    return *result != 0;
+}
+
+bool RESOLVER::loop(void) {
+    if (literal || name[0] == 0) return false;
+
+    unsigned long now = millis();
+    bool expired = (long)(now - next_lookup) >= 0;
+    bool forced = stale.load(std::memory_order_acquire) && now - last_lookup >= RESOLVE_RETRY;
+    if (!expired && !forced) return false;
+    stale.store(false, std::memory_order_release);
+
+    uint32_t result;
+    bool ok = lookup(&result);
+    last_lookup = millis();
+    lookups++;
+    time.add(last_lookup - now);
+
+    if (ok) {
+        addr.store(result, std::memory_order_release);
+        resolved_at = last_lookup;
+        next_lookup = last_lookup + RESOLVE_TTL;
+    } else {
+        // Keep serving the old address, it is still the best guess
+        failures++;
+        next_lookup = last_lookup + RESOLVE_RETRY;
+    }
+    return true;
+}
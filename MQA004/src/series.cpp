@@ -0,0 +1,337 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include "series.h"
+#include "journal.h"
+#include "moonraker.h"
+
+SERIES series;
+
+static size_t put_varint(uint8_t * out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+// Bytes used, 0 if buf ends first
+static size_t get_varint(const uint8_t * buf, size_t len, uint32_t * v) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        result |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+        if ((buf[i] & 0x80) == 0) {
+            *v = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Small magnitudes of either sign to small varints
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void segment_path(char * path, size_t len, uint32_t seq) {
+    snprintf(path, len, SERIES_PATH, (unsigned)(seq % SERIES_SLOTS));
+}
+
+void series_codec_reset(series_codec_t * codec, uint32_t start) {
+    codec->time = start;
+    codec->delta = 0;
+    memset(codec->value, 0, sizeof(codec->value));
+}
+
+size_t series_encode(series_codec_t * codec, const series_sample_t & sample, uint8_t * out) {
+    int32_t delta = sample.time - codec->time;
+    size_t n = put_varint(out, zigzag(delta - codec->delta));
+    codec->time = sample.time;
+    codec->delta = delta;
+
+    size_t mask = n++;
+    out[mask] = 0;
+    for (uint8_t c = 0; c < SERIES_CHANNELS; c++) {
+        int32_t change = sample.value[c] - codec->value[c];
+        if (change == 0) continue;
+        out[mask] |= 1 << c;
+        n += put_varint(out + n, zigzag(change));
+        codec->value[c] = sample.value[c];
+    }
+    return n;
+}
+
+size_t series_decode(series_codec_t * codec, const uint8_t * buf, size_t len, series_sample_t * sample) {
+    uint32_t v;
+    size_t n = get_varint(buf, len, &v);
+    if (n == 0 || n >= len) return 0;
+    uint8_t mask = buf[n++];
+    if (mask >> SERIES_CHANNELS) return 0; // Not a sample
+
+    series_codec_t next = *codec;
+    next.delta += unzigzag(v);
+    next.time += next.delta;
+    for (uint8_t c = 0; c < SERIES_CHANNELS; c++) {
+        if ((mask & (1 << c)) == 0) continue;
+        size_t used = get_varint(buf + n, len - n, &v);
+        if (used == 0) return 0;
+        n += used;
+        next.value[c] += unzigzag(v);
+    }
+
+    *codec = next;
+    sample->time = next.time;
+    memcpy(sample->value, next.value, sizeof(sample->value));
+    return n;
+}
+
+SERIES::SERIES()
+    : samples(0), flushes(0), flash_bytes(0), failed(0), flush_us(0), flush_us_max(0), mounted(false),
+      oldest_seq(1), newest_seq(0), seq(1), segment_bytes(0), segment_start(0), started(false), used(0),
+      first_buffered(0), last_sample(0), last_state(-1) {
+    series_codec_reset(&codec, 0);
+}
+
+bool SERIES::begin(void) {
+    mounted = LittleFS.begin(true, "/littlefs", 4, JOURNAL_PARTITION);
+    if (!mounted) return false;
+
+    // Slots of earlier boots, a slot truncated by a reset has no header
+    uint32_t low = UINT32_MAX;
+    uint32_t high = 0;
+    for (uint32_t slot = 0; slot < SERIES_SLOTS; slot++) {
+        char path[16];
+        segment_path(path, sizeof(path), slot);
+        File f = LittleFS.open(path, "r");
+        series_header_t header;
+        if (!f || f.read((uint8_t *)&header, sizeof(header)) != sizeof(header)) continue;
+        if (header.magic != SERIES_MAGIC || header.version != SERIES_VERSION ||
+            header.channels != SERIES_CHANNELS || header.seq % SERIES_SLOTS != slot) {
+            continue;
+        }
+        if (header.seq < low) low = header.seq;
+        if (header.seq > high) high = header.seq;
+    }
+
+    seq = high + 1;
+    oldest_seq.store(high ? low : seq, std::memory_order_release);
+    newest_seq.store(high, std::memory_order_release);
+    return true;
+}
+
+void SERIES::loop(void) {
+    if (!mounted) return;
+    time_t now = time(NULL);
+    if ((unsigned long)now < JOURNAL_CLOCK_VALID) return; // Samples are placed by the wall clock
+
+    series_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.time = now;
+    if (wifi_get_connect_status() != WIFI_STATUS_CONNECTED || moonraker.unready) {
+        sample.value[SERIES_STATE] = SERIES_STATE_UNREADY;
+    } else {
+        moonraker_data_t data;
+        uint32_t version;
+        if (!moonraker.snapshot.read(&data, &version)) return; // Mid-update, next loop
+        sample.value[SERIES_NOZZLE] = data.nozzle_actual;
+        sample.value[SERIES_NOZZLE_TARGET] = data.nozzle_target;
+        sample.value[SERIES_BED] = data.bed_actual;
+        sample.value[SERIES_BED_TARGET] = data.bed_target;
+        sample.value[SERIES_PROGRESS] = data.progress;
+        sample.value[SERIES_STATE] = (data.printing ? SERIES_STATE_PRINTING : 0) |
+                                     (data.pause ? SERIES_STATE_PAUSE : 0) |
+                                     (data.homing ? SERIES_STATE_HOMING : 0) |
+                                     (data.probing ? SERIES_STATE_PROBING : 0) |
+                                     (data.qgling ? SERIES_STATE_QGL : 0) |
+                                     (data.heating_nozzle ? SERIES_STATE_HEATING_NOZZLE : 0) |
+                                     (data.heating_bed ? SERIES_STATE_HEATING_BED : 0);
+    }
+
+    // State transitions are recorded when they are seen, the rest at SERIES_INTERVAL
+    unsigned long ms = millis();
+    if (sample.value[SERIES_STATE] != last_state || ms - last_sample >= SERIES_INTERVAL) {
+        append(sample);
+        last_sample = ms;
+        last_state = sample.value[SERIES_STATE];
+    }
+    if (used > 0 && ms - first_buffered >= SERIES_FLUSH_INTERVAL) {
+        flush();
+    }
+}
+
+bool SERIES::append(const series_sample_t & sample) {
+    if (!mounted) return false;
+
+    // Segment full, samples after this one go to the next slot
+    if (started && segment_bytes + sizeof(series_header_t) + used + SERIES_SAMPLE_MAX > SERIES_SEGMENT_BYTES) {
+        if (flush()) {
+            seq++;
+            segment_bytes = 0;
+            started = false;
+        } // A failed flush has given the segment up already
+    }
+    if (used + SERIES_SAMPLE_MAX > sizeof(buffer)) {
+        flush(); // On failure the segment is given up, this sample starts the next
+    }
+    if (!started) {
+        series_codec_reset(&codec, sample.time);
+        segment_start = sample.time;
+        started = true;
+    }
+    if (used == 0) first_buffered = millis();
+    used += series_encode(&codec, sample, buffer + used);
+    samples++;
+    return true;
+}
+
+// One write per buffer, the segment header with the first one
+bool SERIES::flush(void) {
+    if (used == 0) return true;
+    unsigned long start = micros();
+    char path[16];
+    segment_path(path, sizeof(path), seq);
+
+    File f = LittleFS.open(path, segment_bytes == 0 ? "w" : "a");
+    bool ok = (bool)f;
+    size_t written = 0;
+    if (ok && segment_bytes == 0) {
+        series_header_t header;
+        header.magic = SERIES_MAGIC;
+        header.version = SERIES_VERSION;
+        header.channels = SERIES_CHANNELS;
+        header.seq = seq;
+        header.start = segment_start;
+        ok = f.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+        written += sizeof(header);
+    }
+    ok = ok && f.write(buffer, used) == used;
+    written += used;
+    f.close();
+    used = 0;
+
+    uint32_t us = micros() - start;
+    flush_us += us;
+    if (us > flush_us_max) flush_us_max = us;
+    if (!ok) {
+        // What follows is encoded against the lost samples, start over
+        failed++;
+        if (segment_bytes > 0) seq++;
+        segment_bytes = 0;
+        started = false;
+        return false;
+    }
+
+    flushes++;
+    flash_bytes += written;
+    segment_bytes += written;
+    newest_seq.store(seq, std::memory_order_release);
+    if (seq >= SERIES_SLOTS && oldest_seq.load(std::memory_order_relaxed) <= seq - SERIES_SLOTS) {
+        oldest_seq.store(seq - SERIES_SLOTS + 1, std::memory_order_release); // Its slot was just reused
+    }
+    return true;
+}
+
+// Compact JSON of the store, e.g. for the "series" serial command
+void SERIES::stats_json(Print & out) {
+    JsonDocument doc;
+    doc["samples"] = samples;
+    doc["flash_bytes"] = flash_bytes;
+    doc["bytes_per_sample"] = samples ? (float)flash_bytes / samples : 0;
+    doc["buffered"] = used;
+    doc["flushes"] = flushes;
+    doc["failed"] = failed;
+    doc["flush_us"] = flushes ? flush_us / flushes : 0;
+    doc["flush_max_us"] = flush_us_max;
+    doc["oldest"] = oldest();
+    doc["newest"] = newest();
+    doc["fs_used"] = mounted ? LittleFS.usedBytes() : 0;
+    doc["fs_total"] = mounted ? LittleFS.totalBytes() : 0;
+    serializeJson(doc, out);
+    out.println();
+}
+
+SERIES_QUERY::SERIES_QUERY(const SERIES & series, uint32_t from, uint32_t to)
+    : bytes(0), segments(0), series(series), from(from), to(to), seq(series.oldest()), last(series.newest()),
+      pos(0), len(0) {
+    series_codec_reset(&codec, 0);
+
+    // Segments are in time order, so the newest one starting before from
+    // is the first that can hold it, else the oldest one
+    uint32_t oldest = seq;
+    for (uint32_t s = last; s >= oldest && s > 0; s--) {
+        series_header_t header;
+        if (!open(s, &header)) continue;
+        if (header.start <= from || s == oldest) {
+            seq = s + 1;
+            return;
+        }
+        file.close();
+    }
+}
+
+bool SERIES_QUERY::open(uint32_t s, series_header_t * header) {
+    char path[16];
+    segment_path(path, sizeof(path), s);
+    file = LittleFS.open(path, "r");
+    if (!file) return false;
+    // The slot may have been reused for a newer segment meanwhile
+    if (file.read((uint8_t *)header, sizeof(*header)) != sizeof(*header) || header->magic != SERIES_MAGIC ||
+        header->version != SERIES_VERSION || header->channels != SERIES_CHANNELS || header->seq != s) {
+        file.close();
+        return false;
+    }
+    series_codec_reset(&codec, header->start);
+    pos = len = 0;
+    segments++;
+    bytes += sizeof(*header);
+    return true;
+}
+
+bool SERIES_QUERY::open_next(void) {
+    while (seq <= last) {
+        series_header_t header;
+        if (!open(seq++, &header)) continue;
+        if (header.start > to) {
+            file.close();
+            seq = last + 1;
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool SERIES_QUERY::next(series_sample_t * sample) {
+    for (;;) {
+        if (!file && !open_next()) return false;
+
+        // Keep at least a whole sample in buf
+        if (len - pos < SERIES_SAMPLE_MAX) {
+            memmove(buf, buf + pos, len - pos);
+            len -= pos;
+            pos = 0;
+            size_t n = file.read(buf + len, sizeof(buf) - len);
+            len += n;
+            bytes += n;
+        }
+
+        size_t n = series_decode(&codec, buf + pos, len - pos, sample);
+        if (n == 0) {
+            file.close(); // End of the segment, or a torn last sample
+            continue;
+        }
+        pos += n;
+        if (sample->time > to) {
+            file.close();
+            seq = last + 1;
+            return false;
+        }
+        if (sample->time >= from) return true;
+    }
+}
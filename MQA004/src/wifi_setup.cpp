@@ -2,6 +2,11 @@
 #include <WiFi.h>
 #include <ArduinoJson.h>
 #include "crowpanel.h"
+#include "resolver.h"
+#include "farm.h"
+#include "series.h"
+
+#define NTP_SERVER "pool.ntp.org"
 
 // Global variables
 static bool connect_busy = false;
@@ -41,6 +46,11 @@ void wifi_task(void* parameter) {
       // Check WiFi status
       switch (WiFi.status()) {
         case WL_CONNECTED:
+          if (wifi_status != WIFI_STATUS_CONNECTED) {
+            // Wall clock for the expiry of journaled commands across resets
+            // and the telemetry timestamps
+            configTime(0, 0, NTP_SERVER);
+          }
           wifi_status = WIFI_STATUS_CONNECTED;
           break;
         case WL_DISCONNECTED:
@@ -72,6 +82,16 @@ void wifi_task(void* parameter) {
           break;
       }
     }
+
+    // DNS and mDNS may block here, never on the Moonraker tasks. One lookup
+    // per pass, so the telemetry below waits for RESOLVE_TIMEOUT at most
+    // however many farm printers are due.
+    if (wifi_status == WIFI_STATUS_CONNECTED && !resolver.loop()) {
+      farm.resolve();
+    }
+
+    // Telemetry to flash, the writes may take a few ms
+    series.loop();
     
     delay(100);
   }
@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "backoff.h"
+
+#define NOW 100000UL // Any fixed time, the schedule only depends on differences
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Delay after each failure: base doubled per failure, half of it jittered
+static void test_doubles_with_jitter(void) {
+    BACKOFF backoff(100, 1000, false);
+    const uint32_t delays[] = { 100, 200, 400, 800, 1000, 1000 };
+    for (uint8_t i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(backoff.ready(NOW + 1000000));
+        backoff.failure(NOW);
+        TEST_ASSERT_GREATER_OR_EQUAL(delays[i] / 2, backoff.wait(NOW));
+        TEST_ASSERT_LESS_OR_EQUAL(delays[i], backoff.wait(NOW));
+    }
+}
+
+// A priority endpoint has no breaker, its streak grows past the width
+// of the delay and then saturates
+static void test_long_streak_stays_at_max(void) {
+    BACKOFF backoff(100, 1000, false);
+    for (uint16_t i = 0; i < 300; i++) {
+        backoff.failure(NOW);
+        TEST_ASSERT_LESS_OR_EQUAL(1000, backoff.wait(NOW));
+        if (i >= 4) TEST_ASSERT_GREATER_OR_EQUAL(500, backoff.wait(NOW));
+    }
+    TEST_ASSERT_EQUAL_UINT32(300, backoff.failures);
+    TEST_ASSERT_EQUAL_UINT32(0, backoff.trips);
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_CLOSED, backoff.state);
+    TEST_ASSERT_FALSE(backoff.ready(NOW));
+    TEST_ASSERT_TRUE(backoff.ready(NOW + 1000));
+}
+
+static void test_breaker_opens_and_probes(void) {
+    BACKOFF backoff(200, 5000);
+    for (uint8_t i = 0; i < BREAKER_THRESHOLD; i++) backoff.failure(NOW);
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_OPEN, backoff.state);
+    TEST_ASSERT_EQUAL_UINT32(1, backoff.trips);
+    TEST_ASSERT_EQUAL(BREAKER_COOLDOWN, backoff.wait(NOW));
+
+    // One probe after the cooldown, its failure opens the breaker again
+    TEST_ASSERT_TRUE(backoff.ready(NOW + BREAKER_COOLDOWN));
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_HALF_OPEN, backoff.state);
+    backoff.failure(NOW + BREAKER_COOLDOWN);
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_OPEN, backoff.state);
+    TEST_ASSERT_EQUAL_UINT32(2, backoff.trips);
+
+    TEST_ASSERT_TRUE(backoff.ready(NOW + 2 * BREAKER_COOLDOWN));
+    backoff.success();
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_CLOSED, backoff.state);
+    TEST_ASSERT_EQUAL(0, backoff.wait(NOW + 2 * BREAKER_COOLDOWN));
+}
+
+static void test_reset_from_another_task(void) {
+    BACKOFF backoff(200, 5000);
+    for (uint8_t i = 0; i < 40; i++) backoff.failure(millis());
+    backoff.request_reset();
+    TEST_ASSERT_EQUAL(0, backoff.wait(millis()));
+    TEST_ASSERT_EQUAL_UINT8(BREAKER_CLOSED, backoff.state);
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_doubles_with_jitter);
+    RUN_TEST(test_long_streak_stays_at_max);
+    RUN_TEST(test_breaker_opens_and_probes);
+    RUN_TEST(test_reset_from_another_task);
+    return UNITY_END();
+}
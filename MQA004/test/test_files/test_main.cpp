@@ -0,0 +1,187 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "files.h"
+
+// Reply body as HTTP_CONN hands it to files_scan()
+class BODY_STREAM : public Stream {
+public:
+    using Print::write;
+
+    BODY_STREAM(const std::string & body) : body(body), pos(0) {
+        setTimeout(0);
+    }
+
+    int available(void) override {
+        return body.size() - pos;
+    }
+    int read(void) override {
+        return pos < body.size() ? (uint8_t)body[pos++] : -1;
+    }
+    int peek(void) override {
+        return pos < body.size() ? (uint8_t)body[pos] : -1;
+    }
+    size_t write(uint8_t c) override {
+        (void)c;
+        return 0;
+    }
+
+private:
+    std::string body;
+    size_t pos;
+};
+
+static FILES_INDEX file_index;
+static COUNTING_ALLOCATOR alloc;
+
+// Path of the test file modified at modified, padded to len characters
+static void file_path(char * path, size_t len, uint32_t modified) {
+    int n = snprintf(path, len + 1, "parts/%lu_", (unsigned long)modified);
+    while ((size_t)n < len) path[n++] = 'x';
+    path[len] = 0;
+}
+
+// Every kept file is newer than every dropped one, and kept whole
+static void assert_newest_kept(uint32_t newest_dropped) {
+    char path[FILES_PATH_MAX];
+    for (uint16_t i = 0; i < file_index.count; i++) {
+        TEST_ASSERT_GREATER_THAN(newest_dropped, file_index.at(i).modified);
+        file_path(path, strlen(file_index.path(i)), file_index.at(i).modified);
+        TEST_ASSERT_EQUAL_STRING(path, file_index.path(i));
+        if (i > 0) TEST_ASSERT_TRUE(file_index.at(i - 1).modified > file_index.at(i).modified);
+    }
+}
+
+void setUp(void) {
+    file_index.clear();
+}
+
+void tearDown(void) {}
+
+static void test_query_encodes(void) {
+    char buf[CMD_TEXT_LEN];
+    TEST_ASSERT_TRUE(files_query(buf, sizeof(buf), FILES_START_PATH, "a+b/c&d 100%.gcode"));
+    TEST_ASSERT_EQUAL_STRING(FILES_START_PATH "a%2Bb%2Fc%26d%20100%25.gcode", buf);
+
+    char small[40];
+    TEST_ASSERT_FALSE(files_query(small, sizeof(small), FILES_START_PATH, "benchy.gcode"));
+    TEST_ASSERT_EQUAL_STRING("", small);
+}
+
+static void test_add_and_sort(void) {
+    TEST_ASSERT_TRUE(file_index.add("old.gcode", 100, 1000));
+    TEST_ASSERT_TRUE(file_index.add("sub/new.gcode", 300, 3000));
+    TEST_ASSERT_TRUE(file_index.add("mid.gcode", 200, 2000));
+    file_index.sort();
+
+    TEST_ASSERT_EQUAL_UINT16(3, file_index.count);
+    TEST_ASSERT_EQUAL_STRING("sub/new.gcode", file_index.path(0));
+    TEST_ASSERT_EQUAL_UINT32(3000, file_index.at(0).size);
+    TEST_ASSERT_EQUAL_STRING("mid.gcode", file_index.path(1));
+    TEST_ASSERT_EQUAL_STRING("old.gcode", file_index.path(2));
+}
+
+static void test_add_skips_what_cannot_be_started(void) {
+    char path[CMD_TEXT_LEN];
+    memset(path, 'a', FILES_PATH_MAX);
+    path[FILES_PATH_MAX] = 0;
+    TEST_ASSERT_FALSE(file_index.add(path, 100, 1)); // Too long
+
+    // Short, but three times as long encoded
+    memset(path, ' ', 40);
+    path[40] = 0;
+    TEST_ASSERT_FALSE(file_index.add(path, 100, 1));
+
+    TEST_ASSERT_EQUAL_UINT16(0, file_index.count);
+    TEST_ASSERT_EQUAL_UINT32(2, file_index.seen);
+    TEST_ASSERT_EQUAL_UINT32(2, file_index.dropped);
+}
+
+// More files than entries, offered in a scrambled order
+static void test_entry_budget_keeps_newest(void) {
+    const uint32_t total = FILES_MAX * 3;
+    char path[FILES_PATH_MAX];
+    for (uint32_t i = 0; i < total; i++) {
+        uint32_t modified = 1000 + i * 7919 % total;
+        file_path(path, 20, modified);
+        file_index.add(path, modified, i);
+    }
+    file_index.sort();
+
+    TEST_ASSERT_LESS_OR_EQUAL(FILES_MAX, file_index.count);
+    TEST_ASSERT_GREATER_THAN(FILES_MAX / 2, file_index.count);
+    TEST_ASSERT_EQUAL_UINT32(total, file_index.seen);
+    TEST_ASSERT_EQUAL_UINT32(total - file_index.count, file_index.dropped);
+    TEST_ASSERT_EQUAL_UINT32(1000 + total - 1, file_index.at(0).modified);
+    assert_newest_kept(1000 + total - file_index.count - 1); // All files from the oldest kept one up
+}
+
+// Long paths fill the arena before the entries run out
+static void test_arena_budget_keeps_newest(void) {
+    const uint32_t total = 2 * FILES_ARENA_LEN / FILES_PATH_MAX;
+    char path[FILES_PATH_MAX];
+    for (uint32_t i = 0; i < total; i++) {
+        uint32_t modified = 1000 + i * 7919 % total;
+        file_path(path, FILES_PATH_MAX - 1 - i % 8, modified);
+        file_index.add(path, modified, i);
+    }
+    file_index.sort();
+
+    TEST_ASSERT_LESS_OR_EQUAL(FILES_ARENA_LEN, file_index.arena_used());
+    TEST_ASSERT_LESS_OR_EQUAL(FILES_MAX, file_index.count);
+    TEST_ASSERT_GREATER_THAN(0, file_index.count);
+    TEST_ASSERT_EQUAL_UINT32(1000 + total - 1, file_index.at(0).modified);
+    assert_newest_kept(1000 + total - file_index.count - 1);
+}
+
+static void test_scan(void) {
+    BODY_STREAM body(
+        "{\"result\": [\n"
+        "  {\"path\": \"a.gcode\", \"modified\": 1700000100.5, \"size\": 123, \"permissions\": \"rw\"},\n"
+        "  {\"modified\": 1700000300, \"size\": 1},\n"
+        "  {\"path\": \"dir/b c.gcode\", \"modified\": 1700000200.25, \"size\": 456, \"permissions\": \"rw\"}\n"
+        "]}");
+    TEST_ASSERT_TRUE(files_scan(body, file_index, &alloc));
+    file_index.sort();
+
+    TEST_ASSERT_EQUAL_UINT16(2, file_index.count);
+    TEST_ASSERT_EQUAL_STRING("dir/b c.gcode", file_index.path(0));
+    TEST_ASSERT_EQUAL_UINT32(1700000200, file_index.at(0).modified);
+    TEST_ASSERT_EQUAL_UINT32(456, file_index.at(0).size);
+    TEST_ASSERT_EQUAL_STRING("a.gcode", file_index.path(1));
+}
+
+static void test_scan_empty(void) {
+    BODY_STREAM body("{\"result\":[ ]}");
+    TEST_ASSERT_TRUE(files_scan(body, file_index, &alloc));
+    TEST_ASSERT_EQUAL_UINT16(0, file_index.count);
+}
+
+static void test_scan_cut_or_malformed(void) {
+    BODY_STREAM cut("{\"result\":[{\"path\":\"a.gcode\",\"modified\":1,\"size\":2},{\"path\":\"b.g");
+    TEST_ASSERT_FALSE(files_scan(cut, file_index, &alloc));
+    TEST_ASSERT_EQUAL_UINT16(1, file_index.count); // Kept up to the cut
+
+    file_index.clear();
+    BODY_STREAM unterminated("{\"result\":[{\"path\":\"a.gcode\",\"modified\":1,\"size\":2}");
+    TEST_ASSERT_FALSE(files_scan(unterminated, file_index, &alloc));
+
+    BODY_STREAM not_objects("{\"result\":[1,2]}");
+    TEST_ASSERT_FALSE(files_scan(not_objects, file_index, &alloc));
+
+    BODY_STREAM error("{\"error\":{\"code\":404,\"message\":\"Not Found\"}}");
+    TEST_ASSERT_FALSE(files_scan(error, file_index, &alloc));
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_query_encodes);
+    RUN_TEST(test_add_and_sort);
+    RUN_TEST(test_add_skips_what_cannot_be_started);
+    RUN_TEST(test_entry_budget_keeps_newest);
+    RUN_TEST(test_arena_budget_keeps_newest);
+    RUN_TEST(test_scan);
+    RUN_TEST(test_scan_empty);
+    RUN_TEST(test_scan_cut_or_malformed);
+    return UNITY_END();
+}
@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "gcode_batch.h"
+
+// Lines kept by gcode_coalesce(), joined with '/'
+static uint8_t coalesce(const char * const * lines, uint8_t count, char * out, size_t len) {
+    bool keep[16];
+    uint8_t kept = gcode_coalesce(lines, count, keep);
+    size_t pos = 0;
+    out[0] = 0;
+    for (uint8_t i = 0; i < count && pos < len; i++) {
+        if (keep[i]) pos += snprintf(out + pos, len - pos, "%s%s", pos ? "/" : "", lines[i]);
+    }
+    return kept;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_repeats_collapse_back_to_back(void) {
+    const char * lines[] = { "G28", "G28", "M84", "m84" };
+    char out[64];
+    TEST_ASSERT_EQUAL_UINT8(2, coalesce(lines, 4, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_STRING("G28/M84", out);
+}
+
+static void test_repeats_apart_are_kept(void) {
+    const char * lines[] = { "G28", "M84", "G28", "M84" };
+    char out[64];
+    TEST_ASSERT_EQUAL_UINT8(4, coalesce(lines, 4, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_STRING("G28/M84/G28/M84", out);
+}
+
+static void test_moves_are_never_collapsed(void) {
+    const char * lines[] = { "G91", "G1 Z5", "G1 Z5", "G90" };
+    char out[64];
+    TEST_ASSERT_EQUAL_UINT8(4, coalesce(lines, 4, out, sizeof(out)));
+}
+
+static void test_setpoint_superseded(void) {
+    const char * lines[] = { "M104 S200", "M140 S60", "M104 S220", "M104 S230 T1" };
+    char out[64];
+    TEST_ASSERT_EQUAL_UINT8(3, coalesce(lines, 4, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_STRING("M140 S60/M104 S220/M104 S230 T1", out);
+}
+
+static void test_wait_is_never_superseded(void) {
+    const char * lines[] = { "M109 S240", "M190 S100", "G28", "M104 S0", "M140 S0" };
+    char out[96];
+    TEST_ASSERT_EQUAL_UINT8(5, coalesce(lines, 5, out, sizeof(out)));
+}
+
+static void test_setpoint_key(void) {
+    char key[GCODE_KEY_LEN];
+    TEST_ASSERT_TRUE(gcode_setpoint_key("M104 S220 T0", key, sizeof(key)));
+    TEST_ASSERT_EQUAL_STRING("E0", key);
+    TEST_ASSERT_TRUE(gcode_setpoint_key("M190 S60", key, sizeof(key)));
+    TEST_ASSERT_EQUAL_STRING("B", key);
+    TEST_ASSERT_TRUE(gcode_setpoint_key("SET_HEATER_TEMPERATURE HEATER=chamber TARGET=40", key, sizeof(key)));
+    TEST_ASSERT_EQUAL_STRING("H:chamber", key);
+    TEST_ASSERT_FALSE(gcode_setpoint_key("SET_HEATER_TEMPERATURE TARGET=40", key, sizeof(key)));
+    TEST_ASSERT_FALSE(gcode_setpoint_key("G1 X10", key, sizeof(key)));
+}
+
+static void test_priority(void) {
+    const char * path = NULL;
+    TEST_ASSERT_EQUAL_UINT8(GCODE_EMERGENCY, gcode_priority(" m112 ", &path));
+    TEST_ASSERT_EQUAL_STRING("/printer/emergency_stop", path);
+    TEST_ASSERT_EQUAL_UINT8(GCODE_CONTROL, gcode_priority("PAUSE", &path));
+    TEST_ASSERT_EQUAL_STRING("/printer/print/pause", path);
+    TEST_ASSERT_EQUAL_UINT8(GCODE_BULK, gcode_priority("PAUSE X=1", &path)); // Parameters need the script
+    TEST_ASSERT_EQUAL_UINT8(GCODE_BULK, gcode_priority("G28", &path));
+    TEST_ASSERT_EQUAL_UINT8(GCODE_CONTROL, path_priority("/printer/print/cancel"));
+    TEST_ASSERT_EQUAL_UINT8(GCODE_BULK, path_priority("/printer/print/start"));
+}
+
+static void test_append_encodes(void) {
+    char buf[64];
+    size_t pos = strlcpy(buf, "x=", sizeof(buf));
+    pos = gcode_append(buf, sizeof(buf), pos, "G1 X+1", false);
+    pos = gcode_append(buf, sizeof(buf), pos, "M117 a&b%", true);
+    TEST_ASSERT_EQUAL_STRING("x=G1%20X%2B1%0AM117%20a%26b%25", buf);
+    TEST_ASSERT_EQUAL(strlen(buf), pos);
+}
+
+static void test_append_does_not_fit(void) {
+    char buf[12];
+    size_t pos = strlcpy(buf, "x=G28", sizeof(buf));
+    TEST_ASSERT_EQUAL(0, gcode_append(buf, sizeof(buf), pos, "M84 X", true));
+    TEST_ASSERT_EQUAL_STRING("x=G28", buf); // Unchanged
+}
+
+int main(int argc, char ** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_repeats_collapse_back_to_back);
+    RUN_TEST(test_repeats_apart_are_kept);
+    RUN_TEST(test_moves_are_never_collapsed);
+    RUN_TEST(test_setpoint_superseded);
+    RUN_TEST(test_wait_is_never_superseded);
+    RUN_TEST(test_setpoint_key);
+    RUN_TEST(test_priority);
+    RUN_TEST(test_append_encodes);
+    RUN_TEST(test_append_does_not_fit);
+    return UNITY_END();
+}
@@ -0,0 +1,168 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include "journal.h"
+
+// The journal's files go to LITTLEFS_DIR, or "test_littlefs", emptied
+// before each test. A new JOURNAL on the same files is a reboot.
+
+static journal_entry_t entries[4];
+
+// A command record as an earlier boot would have left it
+static void write_record(uint32_t seq, uint32_t deadline_s, const char * text) {
+    journal_record_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.kind = JOURNAL_CMD;
+    header.seq = seq;
+    header.deadline_ms = 0;
+    header.deadline_s = deadline_s;
+    header.len = strlen(text);
+
+    const uint8_t * p = (const uint8_t *)&header;
+    for (size_t i = 0; i < offsetof(journal_record_t, check); i++) header.check += p[i];
+    for (uint8_t i = 0; i < header.len; i++) header.check += (uint8_t)text[i];
+
+    File f = LittleFS.open(JOURNAL_PATH, "a");
+    f.write((const uint8_t *)&header, sizeof(header));
+    f.write((const uint8_t *)text, header.len);
+}
+
+void setUp(void) {
+    LittleFS.begin(true);
+    LittleFS.remove(JOURNAL_PATH);
+    LittleFS.remove(JOURNAL_TMP_PATH);
+}
+
+void tearDown(void) {}
+
+static void test_append_read_ack(void) {
+    JOURNAL journal;
+    TEST_ASSERT_TRUE(journal.begin());
+    TEST_ASSERT_FALSE(journal.pending());
+    TEST_ASSERT_TRUE(journal.append(1, "G28", millis()));
+    TEST_ASSERT_TRUE(journal.append(1, "M84", millis()));
+    TEST_ASSERT_TRUE(journal.pending());
+
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(2, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("G28", entries[0].text);
+    TEST_ASSERT_EQUAL_STRING("M84", entries[1].text);
+    TEST_ASSERT_EQUAL_UINT32(entries[1].seq, last);
+
+    journal.ack(last);
+    TEST_ASSERT_FALSE(journal.pending());
+    TEST_ASSERT_FALSE(LittleFS.exists(JOURNAL_PATH)); // Deleted once everything is done
+}
+
+static void test_partial_ack(void) {
+    JOURNAL journal;
+    journal.begin();
+    journal.append(0, "/printer/print/resume", millis());
+    journal.append(1, "G28", millis());
+
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 1, &last));
+    journal.ack(last);
+    TEST_ASSERT_TRUE(journal.pending());
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("G28", entries[0].text);
+}
+
+static void test_checksum_stops_at_a_torn_record(void) {
+    JOURNAL journal;
+    journal.begin();
+    journal.append(1, "G28", millis());
+    journal.append(1, "M84", millis());
+
+    // Flip a byte of the second command's text
+    File f = LittleFS.open(JOURNAL_PATH, "r+");
+    f.seek(2 * sizeof(journal_record_t) + 3 + 1);
+    f.write('X');
+    f.close();
+
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("G28", entries[0].text);
+}
+
+static void test_expired_this_boot(void) {
+    JOURNAL journal;
+    journal.begin();
+    journal.append(1, "G28", millis() - JOURNAL_EXPIRE * 1000UL - 1000);
+    journal.append(1, "M84", millis());
+
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("M84", entries[0].text);
+    TEST_ASSERT_EQUAL_UINT32(1, journal.expired);
+}
+
+static void test_earlier_boot_judged_by_clock(void) {
+    uint32_t now = time(NULL);
+    write_record(1, 0, "NO_CLOCK");     // Written before SNTP, dropped at boot
+    write_record(2, now - 10, "LATE");  // Past its deadline
+    write_record(3, now + 300, "KEEP");
+
+    JOURNAL journal;
+    journal.begin();
+    TEST_ASSERT_EQUAL_UINT32(1, journal.expired);
+    TEST_ASSERT_TRUE(journal.replay_ready()); // The host clock is set
+
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("KEEP", entries[0].text);
+    TEST_ASSERT_EQUAL_UINT32(3, last);
+    TEST_ASSERT_EQUAL_UINT32(2, journal.expired);
+
+    // New commands follow the old ones
+    journal.ack(last);
+    TEST_ASSERT_TRUE(journal.append(1, "G28", millis()));
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_UINT32(4, entries[0].seq);
+}
+
+static void test_acks_survive_a_reboot(void) {
+    {
+        JOURNAL journal;
+        journal.begin();
+        journal.append(1, "G28", millis());
+        journal.append(1, "M84", millis());
+        uint32_t last;
+        journal.read(entries, 1, &last);
+        journal.ack(last);
+    }
+
+    JOURNAL journal;
+    journal.begin();
+    uint32_t last;
+    TEST_ASSERT_EQUAL_UINT8(1, journal.read(entries, 4, &last));
+    TEST_ASSERT_EQUAL_STRING("M84", entries[0].text);
+}
+
+static void test_full(void) {
+    JOURNAL journal;
+    journal.begin();
+    char text[JOURNAL_TEXT_LEN + 1];
+    memset(text, 'A', sizeof(text) - 1);
+    text[sizeof(text) - 1] = 0;
+    TEST_ASSERT_FALSE(journal.append(1, text, millis())); // Longer than a command can be
+
+    text[100] = 0;
+    while (journal.append(1, text, millis())) {}
+    TEST_ASSERT_LESS_OR_EQUAL(JOURNAL_MAX_BYTES, journal.size());
+    TEST_ASSERT_EQUAL_UINT32(2, journal.full);
+}
+
+int main(int argc, char ** argv) {
+    setenv("LITTLEFS_DIR", "test_littlefs", 0);
+    UNITY_BEGIN();
+    RUN_TEST(test_append_read_ack);
+    RUN_TEST(test_partial_ack);
+    RUN_TEST(test_checksum_stops_at_a_torn_record);
+    RUN_TEST(test_expired_this_boot);
+    RUN_TEST(test_earlier_boot_judged_by_clock);
+    RUN_TEST(test_acks_survive_a_reboot);
+    RUN_TEST(test_full);
+    return UNITY_END();
+}
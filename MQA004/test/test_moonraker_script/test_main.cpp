@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "crowpanel.h"
+#include "moonraker.h"
+
+// Multi-line commands against a keep-alive server on the loopback
+// interface, dispatched by moonraker_post_task on its own thread while the
+// test's thread queues as the LVGL task would. The host scheduler lets the
+// dispatcher run as soon as it is woken, like its higher priority does on
+// the device.
+
+extern wifi_status_t wifi_status;
+void moonraker_post_task(void * parameter);
+
+static std::atomic<uint32_t> scripts(0); // Script requests the server got
+static std::string last_script;          // Query of the newest one, written before scripts
+static std::atomic<uint32_t> done(0);
+static moonraker_done_t last_done;
+
+// Answer every request on one connection until the client closes
+static void serve(int fd) {
+    static const char reply[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 15\r\n\r\n{\"result\":\"ok\"}";
+    std::string request;
+    char buf[2048];
+    for (;;) {
+        size_t end;
+        while ((end = request.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                close(fd);
+                return;
+            }
+            request.append(buf, n);
+        }
+        if (request.compare(0, 5 + strlen(GCODE_SCRIPT_PATH), "POST " GCODE_SCRIPT_PATH) == 0) {
+            last_script = request.substr(5 + strlen(GCODE_SCRIPT_PATH),
+                                         request.find(' ', 5) - 5 - strlen(GCODE_SCRIPT_PATH));
+            scripts++;
+        }
+        request.erase(0, end + 4);
+        send(fd, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+    }
+}
+
+static uint16_t server_start(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(fd, 4);
+    getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+
+    std::thread([fd]() {
+        for (;;) {
+            int client = accept(fd, NULL, NULL);
+            if (client >= 0) std::thread(serve, client).detach();
+        }
+    }).detach();
+    return ntohs(addr.sin_port);
+}
+
+static void count_done(const moonraker_done_t & result, void * user) {
+    (void)user;
+    last_done = result;
+    done++;
+}
+
+// Run completions as the LVGL timer does until count of them came in
+static bool wait_done(uint32_t count) {
+    for (uint32_t waited = 0; waited < 2000; waited += 10) {
+        moonraker.run_completions();
+        if (done >= count) return true;
+        delay(10);
+    }
+    return false;
+}
+
+void setUp(void) {
+    scripts = 0;
+    done = 0;
+}
+
+void tearDown(void) {}
+
+static void test_preheat_is_one_script(void) {
+    static const char * const preheat[] = { "M104 S220 T0", "M140 S40" };
+    uint32_t handle = moonraker.post_gcode_to_queue(preheat, 2, count_done, NULL);
+    TEST_ASSERT_NOT_EQUAL(0, handle);
+
+    TEST_ASSERT_TRUE(wait_done(1));
+    delay(50); // A second request, if any, would have come in by now
+    TEST_ASSERT_EQUAL_UINT32(1, scripts.load());
+    TEST_ASSERT_EQUAL_STRING("M104%20S220%20T0%0AM140%20S40", last_script.c_str());
+    TEST_ASSERT_EQUAL_UINT32(handle, last_done.handle);
+    TEST_ASSERT_EQUAL_UINT8(REQUEST_OK, last_done.result);
+    TEST_ASSERT_EQUAL_UINT32(1, done.load()); // Once for both lines
+}
+
+static void test_priority_line_queues_nothing(void) {
+    static const char * const lines[] = { "G28", "M112" };
+    TEST_ASSERT_EQUAL_UINT32(0, moonraker.post_gcode_to_queue(lines, 2, count_done, NULL));
+    TEST_ASSERT_TRUE(moonraker.post_queue.empty());
+    delay(50);
+    TEST_ASSERT_EQUAL_UINT32(0, scripts.load());
+}
+
+int main(int argc, char ** argv) {
+    setenv("LITTLEFS_DIR", "test_littlefs", 0);
+    uint16_t port = server_start();
+    crowpanel_init();
+    strcpy(crowpanel_config.moonraker_ip, "127.0.0.1");
+    snprintf(crowpanel_config.moonraker_port, sizeof(crowpanel_config.moonraker_port), "%u", port);
+    moonraker_setup();
+    wifi_status = WIFI_STATUS_CONNECTED;
+    moonraker.unready = false; // No poll in these tests, the printer is taken as ready
+
+    TaskHandle_t task;
+    xTaskCreate(moonraker_post_task, "moonraker post", 4096, NULL, 8, &task);
+    moonraker.post_task = task;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_preheat_is_one_script);
+    RUN_TEST(test_priority_line_queues_nothing);
+    return UNITY_END();
+}
@@ -0,0 +1,169 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include "series.h"
+
+// The store's files go to LITTLEFS_DIR, or "test_littlefs", emptied
+// before each test
+
+static series_sample_t sample_at(uint32_t time, int16_t nozzle, int16_t bed, int16_t state) {
+    series_sample_t s;
+    memset(&s, 0, sizeof(s));
+    s.time = time;
+    s.value[SERIES_NOZZLE] = nozzle;
+    s.value[SERIES_NOZZLE_TARGET] = nozzle > 100 ? 240 : 0;
+    s.value[SERIES_BED] = bed;
+    s.value[SERIES_STATE] = state;
+    return s;
+}
+
+static void assert_sample(const series_sample_t & expected, const series_sample_t & actual) {
+    TEST_ASSERT_EQUAL_UINT32(expected.time, actual.time);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected.value, actual.value, SERIES_CHANNELS);
+}
+
+void setUp(void) {
+    LittleFS.begin(true);
+    for (uint32_t slot = 0; slot < SERIES_SLOTS; slot++) {
+        char path[16];
+        snprintf(path, sizeof(path), SERIES_PATH, (unsigned)slot);
+        LittleFS.remove(path);
+    }
+}
+
+void tearDown(void) {}
+
+static void test_steady_sample_is_two_bytes(void) {
+    series_codec_t codec;
+    uint8_t buf[SERIES_SAMPLE_MAX];
+    series_codec_reset(&codec, 1000);
+    series_encode(&codec, sample_at(1010, 240, 110, 1), buf);
+    // Same interval, nothing changed: a zero delta of delta and an empty mask
+    TEST_ASSERT_EQUAL(2, series_encode(&codec, sample_at(1020, 240, 110, 1), buf));
+    TEST_ASSERT_EQUAL_UINT8(0, buf[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, buf[1]);
+}
+
+static void test_round_trip(void) {
+    // Irregular intervals, negative values, large jumps of either sign
+    const series_sample_t samples[] = {
+        sample_at(1700000000, 25, 24, 0),
+        sample_at(1700000010, 26, 24, 0),
+        sample_at(1700000013, 180, 60, 0x21),
+        sample_at(1700000023, -40, 60, 0x21),
+        sample_at(1700100000, 32767, -32768, 0x80),
+        sample_at(1700100000, -32768, 32767, 0x80),
+        sample_at(1700100010, 0, 0, 0),
+    };
+    const size_t count = sizeof(samples) / sizeof(samples[0]);
+    uint8_t buf[count * SERIES_SAMPLE_MAX];
+    series_codec_t codec;
+    size_t len = 0;
+
+    series_codec_reset(&codec, samples[0].time);
+    for (size_t i = 0; i < count; i++) {
+        size_t n = series_encode(&codec, samples[i], buf + len);
+        TEST_ASSERT_LESS_OR_EQUAL(SERIES_SAMPLE_MAX, n);
+        len += n;
+    }
+
+    series_codec_reset(&codec, samples[0].time);
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        series_sample_t s;
+        size_t n = series_decode(&codec, buf + pos, len - pos, &s);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        assert_sample(samples[i], s);
+        pos += n;
+    }
+    TEST_ASSERT_EQUAL(len, pos);
+}
+
+static void test_cut_sample_is_not_decoded(void) {
+    series_codec_t codec;
+    uint8_t buf[SERIES_SAMPLE_MAX];
+    series_codec_reset(&codec, 0);
+    size_t len = series_encode(&codec, sample_at(100000, 1000, 500, 0), buf);
+
+    for (size_t cut = 0; cut < len; cut++) {
+        series_codec_t before;
+        series_codec_reset(&before, 0);
+        series_codec_t after = before;
+        series_sample_t s;
+        TEST_ASSERT_EQUAL(0, series_decode(&after, buf, cut, &s));
+        TEST_ASSERT_EQUAL_MEMORY(&before, &after, sizeof(before)); // Left as it was
+    }
+}
+
+static void test_foreign_mask_is_not_decoded(void) {
+    series_codec_t codec;
+    series_codec_reset(&codec, 0);
+    const uint8_t buf[] = { 0x00, 1 << SERIES_CHANNELS, 0x00 };
+    series_sample_t s;
+    TEST_ASSERT_EQUAL(0, series_decode(&codec, buf, sizeof(buf), &s));
+}
+
+static void test_store_query_range(void) {
+    SERIES store;
+    TEST_ASSERT_TRUE(store.begin());
+    for (uint32_t i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(store.append(sample_at(1700000000 + i * 10, 200 + i % 7, 100, 1)));
+    }
+    TEST_ASSERT_TRUE(store.flush());
+    TEST_ASSERT_EQUAL(0, store.buffered());
+
+    SERIES_QUERY query(store, 1700000000 + 5000, 1700000000 + 5990);
+    series_sample_t s;
+    uint32_t n = 0;
+    while (query.next(&s)) {
+        assert_sample(sample_at(1700000000 + (500 + n) * 10, 200 + (500 + n) % 7, 100, 1), s);
+        n++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, n);
+}
+
+static void test_store_spans_segments_and_reboots(void) {
+    uint32_t t = 1700000000;
+    {
+        SERIES store;
+        store.begin();
+        // Noisy enough to fill more than one segment
+        for (uint32_t i = 0; i < 8000; i++, t += 10) {
+            store.append(sample_at(t, (int16_t)(i * 7919 % 300), (int16_t)(i * 104729 % 120), i % 2));
+        }
+        store.flush();
+        TEST_ASSERT_GREATER_THAN(store.oldest(), store.newest());
+    }
+
+    // A new boot starts a new segment after the old ones
+    SERIES store;
+    store.begin();
+    uint32_t newest = store.newest();
+    store.append(sample_at(t, 25, 25, 0));
+    store.flush();
+    TEST_ASSERT_EQUAL_UINT32(newest + 1, store.newest());
+
+    SERIES_QUERY query(store, 0, UINT32_MAX);
+    series_sample_t s;
+    uint32_t n = 0;
+    uint32_t last = 0;
+    while (query.next(&s)) {
+        TEST_ASSERT_TRUE(s.time >= last);
+        last = s.time;
+        n++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(8001, n);
+    TEST_ASSERT_EQUAL_UINT32(t, last);
+}
+
+int main(int argc, char ** argv) {
+    setenv("LITTLEFS_DIR", "test_littlefs", 0);
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_sample_is_two_bytes);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_cut_sample_is_not_decoded);
+    RUN_TEST(test_foreign_mask_is_not_decoded);
+    RUN_TEST(test_store_query_range);
+    RUN_TEST(test_store_spans_segments_and_reboots);
+    return UNITY_END();
+}
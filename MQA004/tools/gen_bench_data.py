@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Generate the synthetic Moonraker replies in bench/data.
+
+The replies are made up, not recorded from a printer: a Voron 2.4 style
+configuration with a 7x7 bed mesh in the middle of a print, and a file
+list of 600 G-code files in subfolders. Temperatures, mesh points and
+file names come from a seeded random generator, so every run writes the
+same bytes and benchmark results stay comparable. Standard library only.
+
+  gen_bench_data.py [output directory]   (default: bench/data)
+"""
+
+import json
+import os
+import random
+import sys
+
+SEED = 7
+FILES = 600  # Entries of files_list.json
+
+
+def temp(t):
+    return round(t + random.uniform(-0.3, 0.3), 2)
+
+
+def status():
+    mesh = [[round(random.uniform(-0.12, 0.12), 6) for _ in range(7)] for _ in range(7)]
+    matrix = [[round(random.uniform(-0.12, 0.12), 6) for _ in range(35)] for _ in range(35)]
+    return {
+        "webhooks": {"state": "ready", "state_message": "Printer is ready"},
+        "print_stats": {"filename": "Voron_Design_Cube_v7_0.2mm_ABS.gcode", "total_duration": 4127.35,
+                        "print_duration": 3805.12, "filament_used": 2931.77, "state": "printing", "message": "",
+                        "info": {"total_layer": 150, "current_layer": 64}},
+        "virtual_sdcard": {"file_path": "/home/pi/printer_data/gcodes/Voron_Design_Cube_v7_0.2mm_ABS.gcode",
+                           "progress": 0.4215, "is_active": True, "file_position": 1862271, "file_size": 4418210},
+        "display_status": {"progress": 0.42, "message": None},
+        "idle_timeout": {"state": "Printing", "printing_time": 3805.2},
+        "pause_resume": {"is_paused": False},
+        "toolhead": {"homed_axes": "xyz", "axis_minimum": [0.0, 0.0, -5.0, 0.0],
+                     "axis_maximum": [350.0, 350.0, 330.0, 0.0], "print_time": 3912.21, "stalls": 0,
+                     "estimated_print_time": 3911.82, "extruder": "extruder",
+                     "position": [171.2, 182.9, 12.8, 2901.3], "max_velocity": 500.0, "max_accel": 10000.0,
+                     "minimum_cruise_ratio": 0.5, "square_corner_velocity": 5.0},
+        "gcode_move": {"speed_factor": 1.0, "speed": 7200.0, "extrude_factor": 1.0, "absolute_coordinates": True,
+                       "absolute_extrude": False, "homing_origin": [0.0, 0.0, -0.02, 0.0],
+                       "position": [171.2, 182.9, 12.8, 2901.3], "gcode_position": [171.2, 182.9, 12.8, 2901.3]},
+        "motion_report": {"live_position": [171.183, 182.871, 12.8, 2901.27], "live_velocity": 118.32,
+                          "live_extruder_velocity": 3.91,
+                          "steppers": ["extruder", "stepper_x", "stepper_x1", "stepper_y", "stepper_y1",
+                                       "stepper_z", "stepper_z1", "stepper_z2", "stepper_z3"],
+                          "trapq": ["extruder", "toolhead"]},
+        "extruder": {"temperature": temp(240), "target": 240.0, "power": 0.512, "can_extrude": True,
+                     "pressure_advance": 0.04, "smooth_time": 0.04, "motion_queue": None},
+        "heater_bed": {"temperature": temp(110), "target": 110.0, "power": 0.38},
+        "fan": {"speed": 0.4, "rpm": None},
+        "heater_fan hotend_fan": {"speed": 1.0, "rpm": None},
+        "controller_fan controller_fan": {"speed": 0.6, "rpm": None},
+        "temperature_sensor chamber": {"temperature": temp(48.1), "measured_min_temp": 20.9,
+                                       "measured_max_temp": 49.3},
+        "temperature_sensor raspberry_pi": {"temperature": temp(52.6), "measured_min_temp": 41.2,
+                                            "measured_max_temp": 58.8},
+        "temperature_sensor octopus": {"temperature": temp(44.0), "measured_min_temp": 30.5,
+                                       "measured_max_temp": 46.1},
+        "temperature_fan exhaust": {"speed": 0.25, "rpm": None, "temperature": temp(47.5), "target": 45.0},
+        "filament_switch_sensor runout": {"filament_detected": True, "enabled": True},
+        "quad_gantry_level": {"applied": True},
+        "bed_mesh": {"profile_name": "default", "mesh_min": [40.0, 40.0], "mesh_max": [310.0, 310.0],
+                     "probed_matrix": mesh, "mesh_matrix": matrix,
+                     "profiles": {"default": {"points": mesh, "mesh_params": {
+                         "min_x": 40.0, "max_x": 310.0, "min_y": 40.0, "max_y": 310.0, "x_count": 7, "y_count": 7,
+                         "mesh_x_pps": 4, "mesh_y_pps": 4, "algo": "bicubic", "tension": 0.2}}}},
+        "exclude_object": {"objects": [{"name": "CUBE_%d" % i, "center": [100 + i * 30, 175.0],
+                                        "polygon": [[90 + i * 30, 165], [110 + i * 30, 165],
+                                                    [110 + i * 30, 185], [90 + i * 30, 185]]} for i in range(6)],
+                           "excluded_objects": [], "current_object": "CUBE_2"},
+        "system_stats": {"sysload": 0.71, "cputime": 2051.38, "memavail": 1563412},
+        "gcode_macro _CROWPANEL_STATUS": {"homing": False, "probing": False, "qgling": False,
+                                          "heating_nozzle": False, "heating_bed": False},
+    }
+
+
+# The fields the panel polls, see moonraker_schema[]
+PANEL_FIELDS = {
+    "webhooks": ["state"],
+    "print_stats": ["state"],
+    "virtual_sdcard": ["progress", "file_path"],
+    "extruder": ["temperature", "target"],
+    "heater_bed": ["temperature", "target"],
+    "gcode_macro _CROWPANEL_STATUS": ["homing", "probing", "qgling", "heating_nozzle", "heating_bed"],
+}
+
+DELTA = {
+    "extruder": {"temperature": 240.18, "power": 0.498},
+    "heater_bed": {"temperature": 109.91},
+    "motion_report": {"live_position": [172.0, 181.2, 12.8, 2901.5], "live_velocity": 120.1},
+    "toolhead": {"estimated_print_time": 3912.07, "position": [172.0, 181.2, 12.8, 2901.5]},
+    "virtual_sdcard": {"progress": 0.4216, "file_position": 1862651},
+    "system_stats": {"sysload": 0.69, "cputime": 2051.61},
+}
+
+
+def file_list():
+    files = []
+    dirs = ["", "voron/", "voron/mods/", "calibration/", "gifts/2024/", "customer_parts/batch_%02d/"]
+    for _ in range(FILES):
+        d = random.choice(dirs)
+        if "%" in d:
+            d = d % random.randint(1, 12)
+        name = "%s%s_%s_0.%dmm_%s_%dh%02dm.gcode" % (
+            d,
+            random.choice(["Cube", "Benchy", "Bracket", "Clip", "Panel", "Hinge", "Spool_Holder", "Fan_Duct"]),
+            random.choice(["v2", "v7", "final", "test"]),
+            random.choice([1, 2, 3]),
+            random.choice(["PLA", "PETG", "ABS", "ASA"]),
+            random.randint(0, 9),
+            random.randint(0, 59))
+        files.append({"path": name, "modified": round(1700000000.0 + random.uniform(0, 3e7), 6),
+                      "size": random.randint(20000, 30000000), "permissions": "rw"})
+    return files
+
+
+def dump(doc, directory, name):
+    with open(os.path.join(directory, name), "w") as f:
+        json.dump(doc, f, separators=(",", ":"))
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else "bench/data"
+    random.seed(SEED)
+
+    full = status()
+    dump({"result": {"eventtime": 3621.417354917, "status": full}}, directory, "objects_query_full.json")
+    panel = {o: {f: full[o][f] for f in fields} for o, fields in PANEL_FIELDS.items()}
+    dump({"result": {"eventtime": 3621.417354917, "status": panel}}, directory, "objects_query_panel.json")
+    dump({"jsonrpc": "2.0", "method": "notify_status_update", "params": [DELTA, 3621.667]},
+         directory, "notify_status_update.json")
+    dump({"result": file_list()}, directory, "files_list.json")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,593 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Moonraker endpoints the panel uses.
+
+Replays a printer session (keyframes of Klipper status, see sessions/)
+over HTTP and the WebSocket JSON-RPC API, optionally injecting latency,
+dropped connections, stalls and 5xx replies, and records the requests and
+bytes every client generates. Standard library only.
+
+  serve:   mock_moonraker.py serve sessions/print_3h.json --port 7125 --speed 10
+  record:  mock_moonraker.py record http://printer.local:7125 my_session.json
+
+Endpoints:
+  GET  /printer/objects/query?obj=field,...   status at the session time
+  POST /printer/gcode/script?script=...       logged, answers "ok"
+  POST /printer/emergency_stop, /printer/print/{pause,resume,cancel,start}
+  GET  /websocket                             printer.objects.subscribe and
+                                              notify_status_update deltas
+  GET  /mock/stats                            client statistics as JSON
+
+A keyframe is {"t": seconds, "status": {object: {field: value}}} and may
+also set "klippy" ("ready", "shutdown", "disconnected") and "faults"
+(any of the fault options below, by their long name with underscores).
+Numbers are interpolated between the keyframes that set them, except
+setpoints ("target") which step like everything else.
+"""
+
+import argparse
+import base64
+import hashlib
+import json
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.parse
+import urllib.request
+from collections import Counter, defaultdict
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+NOTIFY_PERIOD = 0.25  # Moonraker batches subscription updates at this rate
+FAULT_KEYS = ("latency_ms", "jitter_ms", "drop", "stall", "stall_s", "error_rate", "error_code")
+
+
+# --------------------------------------------------------------------------
+# Session replay
+
+class Session:
+    def __init__(self, path, speed=1.0, loop=False, noise=0.0):
+        with open(path) as f:
+            doc = json.load(f)
+        self.name = doc.get("name", path)
+        self.frames = sorted(doc["keyframes"], key=lambda k: k["t"])
+        self.length = self.frames[-1]["t"]
+        self.speed = speed
+        self.loop = loop
+        self.noise = noise
+        self.start = time.monotonic()
+
+        # Per field list of (t, value) from the keyframes that set it
+        self.tracks = defaultdict(list)
+        for frame in self.frames:
+            for obj, fields in frame.get("status", {}).items():
+                for field, value in fields.items():
+                    self.tracks[(obj, field)].append((frame["t"], value))
+
+    def now(self):
+        t = (time.monotonic() - self.start) * self.speed
+        if self.loop and self.length > 0:
+            return t % self.length
+        return min(t, self.length)
+
+    def eventtime(self):
+        return round(time.monotonic() - self.start + 1000.0, 6)
+
+    def _stepped(self, key, t):
+        value = None
+        for frame in self.frames:
+            if frame["t"] > t:
+                break
+            if key in frame:
+                value = frame[key]
+        return value
+
+    def klippy(self, t=None):
+        return self._stepped("klippy", self.now() if t is None else t) or "ready"
+
+    def faults(self, t=None):
+        return self._stepped("faults", self.now() if t is None else t) or {}
+
+    def value(self, obj, field, t):
+        track = self.tracks[(obj, field)]
+        before = None
+        for kt, kv in track:
+            if kt > t:
+                if (before is not None and field != "target" and isinstance(kv, (int, float)) and not isinstance(kv, bool)
+                        and isinstance(before[1], (int, float)) and not isinstance(before[1], bool)):
+                    f = (t - before[0]) / (kt - before[0])
+                    return before[1] + (kv - before[1]) * f
+                break
+            before = (kt, kv)
+        return before[1] if before else None
+
+    def status(self, query=None):
+        """Status of the requested {object: [fields]} (all fields if empty)"""
+        t = self.now()
+        objects = query if query is not None else {o: [] for o, _ in self.tracks}
+        out = {}
+        for obj, fields in objects.items():
+            names = fields or [f for o, f in self.tracks if o == obj]
+            values = {}
+            for field in names:
+                if (obj, field) not in self.tracks:
+                    continue
+                value = self.value(obj, field, t)
+                if field == "temperature" and self.noise > 0 and isinstance(value, (int, float)):
+                    value = value + random.gauss(0, self.noise)
+                if isinstance(value, float):
+                    value = round(value, 2 if field == "temperature" else 4)
+                values[field] = value
+            if values or any(o == obj for o, _ in self.tracks):
+                out[obj] = values
+        return out
+
+
+# --------------------------------------------------------------------------
+# Statistics
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.start = time.monotonic()
+        self.clients = defaultdict(lambda: {
+            "connections": 0, "requests": Counter(), "bytes_in": 0, "bytes_out": 0,
+            "ws_frames_in": 0, "ws_frames_out": 0, "faults": Counter(), "gcode": [],
+        })
+        self.window = Counter()  # Requests per client since the last report
+
+    def request(self, client, endpoint, bytes_in):
+        with self.lock:
+            c = self.clients[client]
+            c["requests"][endpoint] += 1
+            c["bytes_in"] += bytes_in
+            self.window[client] += 1
+
+    def add(self, client, key, n=1):
+        with self.lock:
+            self.clients[client][key] += n
+
+    def fault(self, client, kind):
+        with self.lock:
+            self.clients[client]["faults"][kind] += 1
+
+    def gcode(self, client, script):
+        with self.lock:
+            log = self.clients[client]["gcode"]
+            log.append(script)
+            del log[:-50]
+
+    def snapshot(self):
+        with self.lock:
+            elapsed = time.monotonic() - self.start
+            return {
+                "elapsed_s": round(elapsed, 1),
+                "clients": {
+                    client: {
+                        "connections": c["connections"],
+                        "requests": dict(c["requests"]),
+                        "request_rate": round(sum(c["requests"].values()) / elapsed, 3) if elapsed else 0,
+                        "bytes_in": c["bytes_in"],
+                        "bytes_out": c["bytes_out"],
+                        "bytes_rate": round((c["bytes_in"] + c["bytes_out"]) / elapsed, 1) if elapsed else 0,
+                        "ws_frames_in": c["ws_frames_in"],
+                        "ws_frames_out": c["ws_frames_out"],
+                        "faults": dict(c["faults"]),
+                        "gcode": list(c["gcode"][-10:]),
+                    } for client, c in self.clients.items()
+                },
+            }
+
+    def report(self, interval):
+        with self.lock:
+            window, self.window = self.window, Counter()
+            lines = []
+            for client, c in self.clients.items():
+                lines.append("%-15s %6.2f req/s  %s  in %d B  out %d B  ws %d/%d  faults %s" % (
+                    client, window[client] / interval,
+                    " ".join("%s=%d" % kv for kv in sorted(c["requests"].items())),
+                    c["bytes_in"], c["bytes_out"], c["ws_frames_in"], c["ws_frames_out"],
+                    dict(c["faults"]) or "-"))
+        return lines
+
+
+# --------------------------------------------------------------------------
+# HTTP and WebSocket server
+
+def endpoint_of(path):
+    path = urllib.parse.urlsplit(path).path
+    if path.startswith("/printer/objects/"):
+        return path[len("/printer/"):]
+    if path.startswith("/printer/gcode/script"):
+        return "gcode/script"
+    if path.startswith("/printer/"):
+        return path[len("/printer/"):]
+    return path.strip("/") or "/"
+
+
+def parse_query(qs):
+    """objects/query arguments to {object: [fields]}"""
+    query = {}
+    for obj, fields in urllib.parse.parse_qs(qs, keep_blank_values=True).items():
+        query[obj] = [f for f in fields[0].split(",") if f]
+    return query
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "Moonraker-mock"
+
+    def log_message(self, fmt, *args):
+        if self.server.args.verbose:
+            sys.stderr.write("%s %s\n" % (self.client_address[0], fmt % args))
+
+    @property
+    def client(self):
+        return self.client_address[0]
+
+    def setup(self):
+        super().setup()
+        self.server.stats.add(self.client_address[0], "connections")
+
+    # Fault injection ------------------------------------------------------
+
+    def faults(self):
+        f = {k: getattr(self.server.args, k) for k in FAULT_KEYS}
+        f.update(self.server.session.faults())
+        return f
+
+    def inject(self, endpoint):
+        """Delay the reply and pick the fault to apply: None, "drop", "stall" or "error" """
+        args = self.server.args
+        if args.fault_path and not any(endpoint.startswith(p) for p in args.fault_path):
+            return None
+        f = self.faults()
+        delay = f["latency_ms"] + (random.uniform(-1, 1) * f["jitter_ms"] if f["jitter_ms"] else 0)
+        if delay > 0:
+            time.sleep(delay / 1000.0)
+        for kind, p in (("drop", f["drop"]), ("stall", f["stall"]), ("error", f["error_rate"])):
+            if random.random() < p:
+                self.server.stats.fault(self.client, kind)
+                if kind == "stall":
+                    time.sleep(f["stall_s"])
+                return kind
+        return None
+
+    def http_fault(self, endpoint):
+        """Apply a fault to an HTTP request. True when no normal reply must follow."""
+        kind = self.inject(endpoint)
+        if kind is None:
+            return False
+        if kind == "error":
+            code = self.faults()["error_code"]
+            self.reply(code, {"error": {"code": code, "message": "Injected error"}})
+        else:
+            # Reset the connection, the client never sees a reply
+            self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+            self.close_connection = True
+        return True
+
+    # Replies --------------------------------------------------------------
+
+    def request_bytes(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        body = self.rfile.read(length) if length else b""
+        return len(self.raw_requestline) + len(bytes(self.headers)) + length, body
+
+    def reply(self, code, doc):
+        body = json.dumps(doc, separators=(",", ":")).encode()
+        head = "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n" % (
+            code, self.responses.get(code, ("",))[0], len(body))
+        self.log_request(code, len(body))
+        self.wfile.write(head.encode() + body)
+        self.server.stats.add(self.client, "bytes_out", len(head) + len(body))
+
+    def klippy_error(self):
+        state = self.server.session.klippy()
+        if state == "ready":
+            return False
+        self.reply(503, {"error": {"code": 503, "message": "Klippy Host not connected" if state == "disconnected"
+                                   else "Klippy is in a shutdown state"}})
+        return True
+
+    def do_GET(self):
+        if self.headers.get("Upgrade", "").lower() == "websocket":
+            return self.websocket()
+        endpoint = endpoint_of(self.path)
+        size, _ = self.request_bytes()
+        self.server.stats.request(self.client, endpoint, size)
+
+        if endpoint == "mock/stats":
+            return self.reply(200, self.server.stats.snapshot())
+        if self.http_fault(endpoint):
+            return
+        url = urllib.parse.urlsplit(self.path)
+        if url.path == "/printer/objects/query":
+            if self.klippy_error():
+                return
+            session = self.server.session
+            return self.reply(200, {"result": {"eventtime": session.eventtime(),
+                                               "status": session.status(parse_query(url.query))}})
+        if url.path == "/server/info":
+            return self.reply(200, {"result": {"klippy_state": self.server.session.klippy()}})
+        self.reply(404, {"error": {"code": 404, "message": "Not Found"}})
+
+    def do_POST(self):
+        endpoint = endpoint_of(self.path)
+        size, _ = self.request_bytes()
+        self.server.stats.request(self.client, endpoint, size)
+        if self.http_fault(endpoint):
+            return
+        url = urllib.parse.urlsplit(self.path)
+        params = urllib.parse.parse_qs(url.query)
+        if url.path == "/printer/gcode/script":
+            if self.klippy_error():
+                return
+            script = params.get("script", [""])[0]
+            self.server.stats.gcode(self.client, script)
+            if self.server.args.verbose:
+                sys.stderr.write("%s gcode %r\n" % (self.client, script))
+            return self.reply(200, {"result": "ok"})
+        if url.path in ("/printer/emergency_stop", "/printer/print/pause", "/printer/print/resume",
+                        "/printer/print/cancel", "/printer/print/start", "/printer/restart",
+                        "/printer/firmware_restart"):
+            self.server.stats.gcode(self.client, url.path + ("?" + url.query if url.query else ""))
+            return self.reply(200, {"result": "ok"})
+        self.reply(404, {"error": {"code": 404, "message": "Not Found"}})
+
+    # WebSocket --------------------------------------------------------------
+
+    def websocket(self):
+        size, _ = self.request_bytes()
+        self.server.stats.request(self.client, "websocket", size)
+        if self.http_fault("websocket"):
+            return
+        key = self.headers.get("Sec-WebSocket-Key", "")
+        accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+        head = ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: %s\r\n\r\n" % accept)
+        self.wfile.write(head.encode())
+        self.wfile.flush()
+        self.server.stats.add(self.client, "bytes_out", len(head))
+        self.close_connection = True
+
+        ws = WsConnection(self)
+        ws.run()
+
+
+class WsConnection:
+    def __init__(self, handler):
+        self.h = handler
+        self.sock = handler.connection
+        self.send_lock = threading.Lock()
+        self.subscription = None  # {object: [fields]}
+        self.last = {}
+        self.alive = True
+
+    def send(self, doc):
+        data = json.dumps(doc, separators=(",", ":")).encode()
+        header = bytes([0x81])
+        if len(data) < 126:
+            header += bytes([len(data)])
+        elif len(data) < 65536:
+            header += bytes([126]) + struct.pack(">H", len(data))
+        else:
+            header += bytes([127]) + struct.pack(">Q", len(data))
+        with self.send_lock:
+            self.sock.sendall(header + data)
+        self.h.server.stats.add(self.h.client, "ws_frames_out")
+        self.h.server.stats.add(self.h.client, "bytes_out", len(header) + len(data))
+
+    def recv_exact(self, n):
+        buf = b""
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise ConnectionError
+            buf += chunk
+        return buf
+
+    def recv_frame(self):
+        b0, b1 = self.recv_exact(2)
+        opcode = b0 & 0x0F
+        length = b1 & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", self.recv_exact(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", self.recv_exact(8))[0]
+        mask = self.recv_exact(4) if b1 & 0x80 else b"\0\0\0\0"
+        payload = bytes(c ^ mask[i % 4] for i, c in enumerate(self.recv_exact(length)))
+        self.h.server.stats.add(self.h.client, "ws_frames_in")
+        self.h.server.stats.add(self.h.client, "bytes_in", length + 6)
+        return opcode, payload
+
+    def run(self):
+        pusher = threading.Thread(target=self.push, daemon=True)
+        pusher.start()
+        try:
+            while self.alive:
+                opcode, payload = self.recv_frame()
+                if opcode == 0x8:
+                    with self.send_lock:
+                        self.sock.sendall(bytes([0x88, 0]))
+                    break
+                if opcode == 0x9:
+                    with self.send_lock:
+                        self.sock.sendall(bytes([0x8A, len(payload)]) + payload[:125])
+                    continue
+                if opcode == 0x1:
+                    self.rpc(json.loads(payload))
+        except (ConnectionError, OSError, ValueError):
+            pass
+        self.alive = False
+
+    def rpc(self, msg):
+        method = msg.get("method", "")
+        server = self.h.server
+        server.stats.request(self.h.client, "ws:" + method, 0)
+        fault = self.h.inject("ws:" + method)
+        if fault in ("drop", "stall"):
+            self.alive = False
+            self.sock.shutdown(socket.SHUT_RDWR)
+            return
+        session = server.session
+        reply = {"jsonrpc": "2.0", "id": msg.get("id")}
+        if fault == "error":
+            reply["error"] = {"code": self.h.faults()["error_code"], "message": "Injected error"}
+        elif method == "printer.objects.subscribe":
+            if session.klippy() != "ready":
+                reply["error"] = {"code": 503, "message": "Klippy Host not connected"}
+            else:
+                self.subscription = msg.get("params", {}).get("objects", {})
+                self.last = session.status(self.subscription)
+                reply["result"] = {"eventtime": session.eventtime(), "status": self.last}
+        elif method == "printer.gcode.script":
+            server.stats.gcode(self.h.client, msg.get("params", {}).get("script", ""))
+            reply["result"] = "ok"
+        elif method == "server.info":
+            reply["result"] = {"klippy_state": session.klippy()}
+        else:
+            reply["error"] = {"code": -32601, "message": "Method not found"}
+        self.send(reply)
+
+    def push(self):
+        session = self.h.server.session
+        klippy = session.klippy()
+        try:
+            while self.alive:
+                time.sleep(NOTIFY_PERIOD)
+                state = session.klippy()
+                if state != klippy:
+                    klippy = state
+                    self.send({"jsonrpc": "2.0", "method": "notify_klippy_" + state})
+                    if state != "ready":
+                        self.subscription = None
+                if self.subscription is None or state != "ready":
+                    continue
+                status = session.status(self.subscription)
+                delta = {}
+                for obj, fields in status.items():
+                    changed = {k: v for k, v in fields.items() if self.last.get(obj, {}).get(k) != v}
+                    if changed:
+                        delta[obj] = changed
+                if delta:
+                    self.last = status
+                    self.send({"jsonrpc": "2.0", "method": "notify_status_update",
+                               "params": [delta, session.eventtime()]})
+        except OSError:
+            self.alive = False
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def serve(args):
+    server = Server((args.host, args.port), Handler)
+    server.args = args
+    server.session = Session(args.session, args.speed, args.loop, args.noise)
+    server.stats = Stats()
+    print("Replaying %s (%.0f s at %gx) on %s:%d" % (server.session.name, server.session.length, args.speed,
+                                                     args.host, args.port), flush=True)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    try:
+        while True:
+            time.sleep(args.report)
+            s = server.session
+            print("t=%7.1f klippy=%s" % (s.now(), s.klippy()), flush=True)
+            for line in server.stats.report(args.report):
+                print("  " + line, flush=True)
+    except KeyboardInterrupt:
+        pass
+    server.shutdown()
+    summary = server.stats.snapshot()
+    if args.stats_json:
+        with open(args.stats_json, "w") as f:
+            json.dump(summary, f, indent=2)
+    print(json.dumps(summary, indent=2))
+
+
+# --------------------------------------------------------------------------
+# Recording a real printer
+
+RECORD_OBJECTS = {
+    "webhooks": ["state"],
+    "print_stats": ["state"],
+    "virtual_sdcard": ["progress", "file_path"],
+    "extruder": ["temperature", "target"],
+    "heater_bed": ["temperature", "target"],
+    "gcode_macro _CROWPANEL_STATUS": ["homing", "probing", "qgling", "heating_nozzle", "heating_bed"],
+}
+
+
+def record(args):
+    query = "&".join("%s=%s" % (urllib.parse.quote(o), ",".join(f)) for o, f in RECORD_OBJECTS.items())
+    url = args.url.rstrip("/") + "/printer/objects/query?" + query
+    frames, last, state, start = [], {}, "ready", time.monotonic()
+    print("Recording %s every %g s, Ctrl-C to stop" % (args.url, args.interval), flush=True)
+    try:
+        while True:
+            t = round(time.monotonic() - start, 1)
+            try:
+                with urllib.request.urlopen(url, timeout=5) as r:
+                    status = json.load(r)["result"]["status"]
+                klippy = "ready"
+            except Exception:
+                status, klippy = {}, "disconnected"
+            # Keep only what changed since the previous keyframe
+            delta = {o: {k: v for k, v in fv.items() if last.get(o, {}).get(k) != v} for o, fv in status.items()}
+            frame = {"t": t}
+            if any(delta.values()):
+                frame["status"] = {o: fv for o, fv in delta.items() if fv}
+            if klippy != state:
+                frame["klippy"] = state = klippy
+            if len(frame) > 1:
+                frames.append(frame)
+            for o, fv in status.items():
+                last.setdefault(o, {}).update(fv)
+            time.sleep(args.interval)
+    except KeyboardInterrupt:
+        pass
+    with open(args.out, "w") as f:
+        json.dump({"name": args.out, "keyframes": frames}, f, indent=1)
+    print("%d keyframes written to %s" % (len(frames), args.out))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("serve", help="replay a session")
+    p.add_argument("session", help="session keyframe file")
+    p.add_argument("--host", default="0.0.0.0")
+    p.add_argument("--port", type=int, default=7125)
+    p.add_argument("--speed", type=float, default=1.0, help="session seconds per real second")
+    p.add_argument("--loop", action="store_true", help="restart the session at its end")
+    p.add_argument("--noise", type=float, default=0.0, help="temperature noise, standard deviation in degrees")
+    p.add_argument("--latency-ms", type=float, default=0, help="delay added to every reply")
+    p.add_argument("--jitter-ms", type=float, default=0, help="uniform +/- jitter on the delay")
+    p.add_argument("--drop", type=float, default=0, help="probability of resetting the connection")
+    p.add_argument("--stall", type=float, default=0, help="probability of never answering")
+    p.add_argument("--stall-s", type=float, default=65, help="how long a stalled request is held")
+    p.add_argument("--error-rate", type=float, default=0, help="probability of an error reply")
+    p.add_argument("--error-code", type=int, default=503)
+    p.add_argument("--fault-path", action="append", help="only inject faults on endpoints with this prefix, "
+                   "e.g. objects/query, gcode/script, websocket, ws:printer.objects.subscribe")
+    p.add_argument("--report", type=float, default=10, help="seconds between statistics reports")
+    p.add_argument("--stats-json", help="write the final statistics to this file")
+    p.add_argument("-v", "--verbose", action="store_true")
+
+    r = sub.add_parser("record", help="record a session from a real Moonraker")
+    r.add_argument("url", help="e.g. http://printer.local:7125")
+    r.add_argument("out")
+    r.add_argument("--interval", type=float, default=1.0)
+
+    args = parser.parse_args()
+    serve(args) if args.command == "serve" else record(args)
+
+
+if __name__ == "__main__":
+    main()